@@ -85,7 +85,7 @@ int handleRequest(Connection& connection) {
 
     // shortcuts
     auto& resp = connection.responseStream();
-    auto requestPath = connection.request().env().getRequestPath();
+    auto const& requestPath = connection.request().env().getRequestPath();
 
     resp << "<!DOCTYPE html><html><head>"
             "<title>nawa Multipage Example</title>"
@@ -33,6 +33,8 @@
 #include <optional>
 
 namespace nawa {
+    class ConfigGuard;
+
     class RequestHandler {
         NAWA_PRIVATE_DATA()
 
@@ -92,6 +94,14 @@ namespace nawa {
          */
         [[nodiscard]] std::shared_ptr<Config const> getConfig() const noexcept;
 
+        /**
+         * Get read access to the config without copying the pointer to it, so that no reference count shared between
+         * threads has to be modified. Internal function which should only be used by request handlers (ConfigGuard is
+         * defined in an internal header).
+         * @return Guard which keeps the config valid as long as it exists.
+         */
+        [[nodiscard]] ConfigGuard readConfig() const noexcept;
+
         /**
          * Set or replace the config (thread-safe, blocking).
          * @param config The config.
@@ -25,17 +25,54 @@
 #define NAWA_CONFIG_H
 
 #include <nawa/internal/macros.h>
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace nawa {
     /**
-     * Reader for config files and accessor to config values.
+     * Reader for config files and accessor to config values. Copies of a Config container share the values until one
+     * of them is modified (copy-on-write), so copying is cheap. A Config object itself must not be modified while it
+     * is being accessed or copied by other threads.
+     *
+     * Values which are accessed frequently (e.g., for every request) can be looked up through a Config::Key handle
+     * instead of a section-key pair. Lookups through a handle are plain array accesses, and the typed accessors
+     * (getNumber(), getSwitch()) only parse a value once, when the values are read or modified.
      */
     class Config {
         NAWA_PRIVATE_DATA()
 
     public:
+        /**
+         * Handle for a config key (pair of section and name). Every section-key pair is interned once, all handles
+         * for the same pair share the same ID. Creating a handle requires a global lock, so handles should be created
+         * once (e.g., as static objects) and then reused. Values for keys which are interned after the values of a
+         * Config container have been read or modified can still be accessed, but will be looked up and parsed on
+         * every access.
+         */
+        class Key {
+            size_t id;
+
+        public:
+            /**
+             * Create a handle for the given key, interning it if it has not been interned yet.
+             * @param key Key (pair of section and name of the value), e.g., `Config::Key key({"section", "name"});`
+             */
+            explicit Key(std::pair<std::string, std::string> key);
+
+            /**
+             * Get the ID of the key, which is the same for all handles of a section-key pair.
+             * @return The ID.
+             */
+            [[nodiscard]] size_t getId() const noexcept { return id; }
+
+            /**
+             * Get the section-key pair this handle stands for.
+             * @return Reference to the section-key pair, which is valid during the whole runtime of the program.
+             */
+            [[nodiscard]] std::pair<std::string, std::string> const& getPair() const;
+        };
+
         NAWA_DEFAULT_DESTRUCTOR_DEF(Config);
 
         NAWA_DEFAULT_CONSTRUCTOR_DEF(Config);
@@ -95,6 +132,36 @@ namespace nawa {
          */
         std::string operator[](std::pair<std::string, std::string> const& key) const;
 
+        /**
+         * Check whether a key exists in this Config container.
+         * @param key Handle of the key to check for.
+         * @return True if the key exists, false if not.
+         */
+        [[nodiscard]] bool isSet(Key const& key) const;
+
+        /**
+         * Get the value belonging to the specified key from the Config container.
+         * @param key Handle of the key.
+         * @return Reference to the value belonging to the key if it exists, an empty string otherwise. The reference
+         * is valid until the Config container is modified or destroyed.
+         */
+        std::string const& operator[](Key const& key) const;
+
+        /**
+         * Get the value belonging to the specified key as an unsigned number (parsed the same way as by std::stoul).
+         * @param key Handle of the key.
+         * @return The number, or std::nullopt if the key does not exist or is not a valid number.
+         */
+        [[nodiscard]] std::optional<unsigned long> getNumber(Key const& key) const;
+
+        /**
+         * Get the value belonging to the specified key as a switch ("on" or "off").
+         * @param key Handle of the key.
+         * @return True if the value is "on", false if it is "off", and std::nullopt if the key does not exist or has
+         * another value.
+         */
+        [[nodiscard]] std::optional<bool> getSwitch(Key const& key) const;
+
         /**
          * Set a key to a new value or insert a new key with the given value.
          * @param key Pair of section and key string identifying the Config value that is to be set.
@@ -32,6 +32,7 @@
 #include <nawa/session/Session.h>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace nawa {
@@ -65,7 +66,8 @@ namespace nawa {
         /**
          * Access the NAWA configuration. This is a copy of the Config object that contains the values of the config file
          * which was read at the startup of NAWA. You can use the Config::set method to change values at runtime, however,
-         * these changes only affect the current connection.
+         * these changes only affect the current connection. The copy is only made on the first call of this function,
+         * so use the const overload if you just want to read the config.
          * @return Reference to the Config object.
          */
         nawa::Config& config() noexcept;
@@ -78,7 +80,8 @@ namespace nawa {
         [[nodiscard]] nawa::Config const& config() const noexcept;
 
         /**
-         * Stream which allows you to write stuff to the HTTP body comfortably.
+         * Stream which allows you to write stuff to the HTTP body comfortably. Everything written to it is
+         * directly appended to the response body (and may trigger an automatic flush, see write()).
          * @return Reference to the response ostream.
          */
         std::ostream& responseStream() noexcept;
@@ -89,6 +92,13 @@ namespace nawa {
          */
         explicit Connection(ConnectionInitContainer const& connectionInit);
 
+        /**
+         * Create a Connection object, moving the request data and config out of the ConnectionInitContainer instead
+         * of copying them.
+         * @param connectionInit The ConnectionInitContainer object containing the necessary parameters.
+         */
+        explicit Connection(ConnectionInitContainer&& connectionInit);
+
         /**
          * Set the HTTP response body (everything that comes after the headers). This will overwrite everything
          * that was set previously. You can use responseStream() instead to get a stream to write to.
@@ -96,6 +106,23 @@ namespace nawa {
          */
         void setResponseBody(std::string content);
 
+        /**
+         * Append content to the HTTP response body. If a high-water mark has been configured (response/high_water_mark
+         * in the NAWA config) and the buffered body reaches it, the response will be flushed automatically, so that
+         * large responses can be generated with a bounded amount of memory. Please note that you cannot set cookies
+         * and headers anymore after the response has been flushed.
+         * @param content The content to append.
+         */
+        void write(std::string_view content);
+
+        /**
+         * Send a chunk of the response body directly to the client, without copying it into the response buffer.
+         * Everything that has been buffered before (including the headers, if the response has not been flushed yet)
+         * will be flushed first. The chunk only has to stay valid during the call.
+         * @param chunk The chunk to send.
+         */
+        void flushChunk(std::string_view chunk);
+
         /**
          * Set the HTTP status code. It will be passed to the web server without checking for validity. For known
          * status codes, the textual description will be appended.
@@ -169,6 +196,9 @@ namespace nawa {
          * last-modified headers and replace the existing HTTP response body (if any) with the contents of the file.
          * You are responsible to check request headers (such as accepts and if-modified-since). If the file cannot
          * be read, a nawa::Exception with error code 1 will be thrown.
+         *
+         * The file is not loaded into memory, but sent directly from disk by the request handler when the response
+         * is flushed. It will only be read into memory if the response body is accessed or extended afterwards.
          * @param path Path to the file, including the file name of course (better use absolute paths).
          * @param contentType The content-type string (such as image/png). If left empty, NAWA will try to guess the
          * content type itself (this will only work for a few common file types), and use "application/octet-stream"
@@ -105,6 +105,23 @@ namespace nawa {
          */
         NAWA_COMPLEX_DATA_ACCESSORS_DEF(AccessFilter, regexFilter, std::regex);
 
+        /**
+         * Set the regex for regex filtering from a pattern in the ECMAScript syntax. This is equivalent to
+         * `regexFilter(std::regex(pattern))` (so a std::regex_error is thrown if the pattern is invalid), but the
+         * pattern is kept, so that an AccessFilterList can match the regexes of all its filters in one pass. Does not
+         * enable regex filtering.
+         * @param pattern The pattern.
+         * @return Reference to element.
+         */
+        AccessFilter& regexFilter(std::string const& pattern);
+
+        /**
+         * Get the pattern the regex for regex filtering has been created from.
+         * @return The pattern, or an empty string if the regex has not been set as a pattern (or might have been
+         * modified through the non-const accessor since).
+         */
+        [[nodiscard]] std::string const& regexPattern() const noexcept;
+
         /**
          * The response that will be sent to the client if the request is not forwarded to the app (i.e., the request
          * is blocked, the file to forward is not found, or access has been denied).
@@ -119,6 +136,31 @@ namespace nawa {
          * @return True if the filter matches, false otherwise.
          */
         [[nodiscard]] bool matches(std::vector<std::string> const& requestPath) const;
+
+        /**
+         * Check whether the conditions of this filter match the given request path. This overload should be used
+         * when checking multiple filters, so that the path string for regex filtering is only created once.
+         * @param requestPath The request path of the current request.
+         * @param mergedRequestPath The request path as a string, as created by mergeRequestPath().
+         * @return True if the filter matches, false otherwise.
+         */
+        [[nodiscard]] bool matches(std::vector<std::string> const& requestPath,
+                                   std::string const& mergedRequestPath) const;
+
+        /**
+         * Check whether the path and extension conditions of this filter match the given request path, ignoring the
+         * regex condition. Used by the AccessFilterList, which matches the regexes of its filters all at once.
+         * @param requestPath The request path of the current request.
+         * @return True if the path and extension conditions match, false otherwise.
+         */
+        [[nodiscard]] bool matchesPathAndExtension(std::vector<std::string> const& requestPath) const;
+
+        /**
+         * Create the string representation of a request path which is used for regex filtering.
+         * @param requestPath The request path.
+         * @return The path in the form "/dir1/dir2/file.ext" (an empty string for the root path).
+         */
+        static std::string mergeRequestPath(std::vector<std::string> const& requestPath);
     };
 }// namespace nawa
 
@@ -28,6 +28,7 @@
 #include <nawa/filter/AccessFilter/ext/BlockFilter.h>
 #include <nawa/filter/AccessFilter/ext/ForwardFilter.h>
 #include <nawa/internal/macros.h>
+#include <optional>
 #include <vector>
 
 namespace nawa {
@@ -36,6 +37,11 @@ namespace nawa {
      * be processed from the first element in a vector to the last element, block filters first, then auth filters,
      * then forward filters. If one filter leads to a block/forward/denied access, all following filters will be ignored.
      * Filters can only be applied statically on app initialization as part of the AppInit struct (for thread-safety).
+     *
+     * The RequestHandler compiles the filters into a prefix tree over the path filters and a hash map over the
+     * extension filters (see compile()), so that the cost of finding the matching filter depends on the depth of the
+     * request path rather than on the number of filters. The regexes of all filters of a list which have been set as
+     * patterns are combined into one regex, so that they are matched in one pass.
      */
     class AccessFilterList {
         NAWA_PRIVATE_DATA()
@@ -76,6 +82,80 @@ namespace nawa {
          * @return Reference to element.
          */
         NAWA_COMPLEX_DATA_ACCESSORS_DEF(AccessFilterList, forwardFilters, std::vector<ForwardFilter>);
+
+        /**
+         * Build the index used to look up the filters matching a request path. Accessing the filter lists through
+         * the non-const accessors discards the index, and filters will be checked one by one until compile() is
+         * called again. This is done by the RequestHandler automatically whenever the filters are set.
+         */
+        void compile();
+
+        /**
+         * Check whether the index built by compile() is available.
+         * @return True if the filters have been compiled and not modified since.
+         */
+        [[nodiscard]] bool isCompiled() const noexcept;
+
+        /**
+         * Check whether regex filtering is enabled for any of the filters, i.e., whether the request path string
+         * (see AccessFilter::mergeRequestPath()) is needed to find the filters applying to a request.
+         * @return True if at least one filter has regex filtering enabled.
+         */
+        [[nodiscard]] bool hasRegexFilters() const noexcept;
+
+        /**
+         * Find the first block filter that applies to the given request path (i.e., which matches, or does not match
+         * if it is inverted).
+         * @param requestPath The request path.
+         * @return Index of the filter in blockFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findBlockFilter(std::vector<std::string> const& requestPath) const;
+
+        /**
+         * Same as findBlockFilter(requestPath), but with the request path string for regex filtering already created
+         * (see AccessFilter::mergeRequestPath()), so that it can be shared between multiple lookups.
+         * @param requestPath The request path.
+         * @param mergedRequestPath The request path as a string.
+         * @return Index of the filter in blockFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findBlockFilter(std::vector<std::string> const& requestPath,
+                                                            std::string const& mergedRequestPath) const;
+
+        /**
+         * Find the first auth filter that applies to the given request path (i.e., which matches, or does not match
+         * if it is inverted).
+         * @param requestPath The request path.
+         * @return Index of the filter in authFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findAuthFilter(std::vector<std::string> const& requestPath) const;
+
+        /**
+         * Same as findAuthFilter(requestPath), but with the request path string for regex filtering already created
+         * (see AccessFilter::mergeRequestPath()), so that it can be shared between multiple lookups.
+         * @param requestPath The request path.
+         * @param mergedRequestPath The request path as a string.
+         * @return Index of the filter in authFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findAuthFilter(std::vector<std::string> const& requestPath,
+                                                           std::string const& mergedRequestPath) const;
+
+        /**
+         * Find the first forward filter that applies to the given request path (i.e., which matches, or does not
+         * match if it is inverted).
+         * @param requestPath The request path.
+         * @return Index of the filter in forwardFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findForwardFilter(std::vector<std::string> const& requestPath) const;
+
+        /**
+         * Same as findForwardFilter(requestPath), but with the request path string for regex filtering already created
+         * (see AccessFilter::mergeRequestPath()), so that it can be shared between multiple lookups.
+         * @param requestPath The request path.
+         * @param mergedRequestPath The request path as a string.
+         * @return Index of the filter in forwardFilters(), or nullopt if no filter applies.
+         */
+        [[nodiscard]] std::optional<size_t> findForwardFilter(std::vector<std::string> const& requestPath,
+                                                              std::string const& mergedRequestPath) const;
     };
 }// namespace nawa
 
@@ -75,6 +75,11 @@ namespace nawa {
 
     // session
     class Session;
+    namespace session {
+        class SessionStore;
+        class MemorySessionStore;
+        class SharedMemorySessionStore;
+    }// namespace session
 
     // util
     class MimeMultipart;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file AccessLog.h
+ * \brief Structured access log, written into a memory-mapped binary ring file.
+ */
+
+#ifndef NAWA_ACCESSLOG_H
+#define NAWA_ACCESSLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nawa::accesslog {
+    /**
+     * Maximum length of the request method stored in a record (longer methods are truncated).
+     */
+    size_t const MAX_METHOD_LENGTH = 16;
+
+    /**
+     * Maximum length of the request path (including the query string) stored in a record (longer paths are truncated).
+     */
+    size_t const MAX_PATH_LENGTH = 200;
+
+    /**
+     * A decoded access log record.
+     */
+    struct Entry {
+        uint64_t sequence = 0;    /**< Number of the record, counting from 0 since the file has been created. */
+        uint64_t timestamp = 0;   /**< Time at which the response was complete, in microseconds since the epoch. */
+        uint64_t duration = 0;    /**< Time from the start of request handling until the response was complete (µs). */
+        uint64_t bytes = 0;       /**< Response body bytes (headers not included). */
+        unsigned int status = 0;  /**< HTTP status code. */
+        uint32_t thread = 0;      /**< Number of the thread which handled the request (counting from 1). */
+        std::string method;       /**< Request method, e.g., GET. */
+        std::string path;         /**< Request URI (path and query string). */
+    };
+
+    namespace internal {
+        extern std::atomic<bool> enabled; /**< Use accesslog::enabled(). */
+    }
+
+    /**
+     * Check whether the access log is currently open. Cheap enough to be called for every request.
+     * @return True if records are written.
+     */
+    inline bool enabled() noexcept {
+        return internal::enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Open (or create) the access log file and start recording. The file consists of a fixed number of fixed-size
+     * record slots and is mapped into memory, so that writing a record neither formats text nor calls into the kernel.
+     * Once all slots are used, the oldest records are overwritten. An existing file with the same capacity is
+     * continued, an existing file of a different capacity is replaced by a new file (it is not truncated, as other
+     * processes might still have it mapped). If another file is currently open, it is closed.
+     * @param path Path to the file.
+     * @param capacity Number of records kept in the file (will be rounded up to a multiple of 16).
+     * @throws Exception (error code 1) if the file cannot be created or mapped.
+     */
+    void open(std::string const& path, size_t capacity = 65536);
+
+    /**
+     * Stop recording and close the access log file.
+     */
+    void close();
+
+    /**
+     * Write a record into the access log, if it is open. Records are written without locks (each thread reserves a
+     * few slots at a time).
+     * @param method Request method.
+     * @param path Request URI.
+     * @param status HTTP status code.
+     * @param bytes Response body bytes.
+     * @param duration Time needed to handle the request.
+     */
+    void record(std::string_view method, std::string_view path, unsigned int status, uint64_t bytes,
+                std::chrono::steady_clock::duration duration) noexcept;
+
+    /**
+     * Decode an access log file. Records which are being written while the file is read are skipped. The file can be
+     * read while another process is writing it.
+     * @param path Path to the file.
+     * @return The records, sorted by their timestamp.
+     * @throws Exception (error code 1) if the file cannot be opened, or (error code 2) if it is not an access log file.
+     */
+    std::vector<Entry> read(std::string const& path);
+}// namespace nawa::accesslog
+
+#endif//NAWA_ACCESSLOG_H
@@ -24,16 +24,34 @@
 #ifndef NAWA_LOG_H
 #define NAWA_LOG_H
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <nawa/internal/macros.h>
 #include <sstream>
+#include <string_view>
+
+/**
+ * Most verbose log level (as a number, 0 for OFF to 4 for DEBUG) for which the NLOG_* macros generate code. Messages
+ * of more verbose levels are removed at compile time. Can be set via the LogCompileLevel CMake option, or by defining
+ * it before including this header.
+ */
+#ifndef NAWA_LOG_COMPILE_LEVEL
+#define NAWA_LOG_COMPILE_LEVEL 4
+#endif
 
 namespace nawa {
+    namespace internal {
+        extern std::atomic<int> logOutputLevel; /**< Use Log::setOutputLevel() and Log::isEnabled(). */
+    }
+
     /**
      * Simple class for thread-safe logging to stderr or to any other output stream. This class uses the same ostream
      * for logging in all instances and synchronizes the output. Every instance can have its own app name.
-     * By default, the logger will write to std::cout.
+     * By default, the logger will write to stderr.
+     *
+     * Optionally, messages can be written asynchronously (see setAsync()): they are then queued in a lock-free buffer
+     * of the logging thread and written in batches by a background thread.
      */
     class Log {
         NAWA_PRIVATE_DATA()
@@ -52,6 +70,77 @@ namespace nawa {
             DEBUG
         };
 
+        /**
+         * What to do with a message in async mode if the buffer of the logging thread is full. DROP discards the
+         * message (the number of dropped messages will be logged later), BLOCK waits until there is space.
+         */
+        enum class OverflowPolicy {
+            DROP,
+            BLOCK
+        };
+
+        /**
+         * Reusable, thread-local buffer for formatting log messages, used by the NLOG_* macros instead of a new
+         * ostringstream for every message. Every thread has a few buffers, which are used in a stack-like manner
+         * (so that formatting a message may log other messages). A MessageFormatter must be destroyed in the thread
+         * which created it.
+         */
+        class MessageFormatter {
+            struct Buffer;
+            Buffer* buffer;
+
+        public:
+            MessageFormatter();
+
+            ~MessageFormatter();
+
+            MessageFormatter(MessageFormatter const&) = delete;
+
+            MessageFormatter& operator=(MessageFormatter const&) = delete;
+
+            /**
+             * Stream writing into the buffer.
+             * @return Reference to the stream.
+             */
+            std::ostream& stream() noexcept;
+
+            /**
+             * Get the formatted message.
+             * @return Reference to the message, valid as long as the MessageFormatter exists.
+             */
+            [[nodiscard]] std::string const& str() const noexcept;
+
+            /**
+             * Append a message in which every "{}" is replaced by the next argument (written using operator<<).
+             * "{{" and "}}" are written as "{" and "}", placeholders without a matching argument are written as-is.
+             * @param fmt The format string.
+             * @param args The arguments.
+             * @return Reference to this MessageFormatter.
+             */
+            template<typename... Args>
+            MessageFormatter& format(std::string_view fmt, Args const&... args) {
+                auto& out = stream();
+                auto appendNext = [&](auto const& arg) {
+                    if (appendUntilPlaceholder(fmt)) {
+                        out << arg;
+                    }
+                };
+                (appendNext(args), ...);
+                while (appendUntilPlaceholder(fmt)) {
+                    out << "{}";
+                }
+                return *this;
+            }
+
+        private:
+            /**
+             * Append the format string up to the next placeholder and remove it (including the placeholder) from fmt.
+             * @param fmt The remaining format string.
+             * @return True if a placeholder has been found.
+             */
+            bool appendUntilPlaceholder(std::string_view& fmt);
+        };
+
         /**
          * Construct a logger object with the default app name nawa and default log level STANDARD
          * (can be changed later).
@@ -100,6 +189,18 @@ namespace nawa {
          */
         static void setOutfile(std::string const& filename);
 
+        /**
+         * Reopen the log file set by setOutfile() under the same path, e.g., after it has been moved by logrotate.
+         * This also works while the output stream is locked. The new file replaces the old one atomically (the file
+         * descriptor is swapped with dup2), so threads writing at the same time are never blocked, their messages
+         * just end up in the old file. Has no effect if no log file is used. Only async-signal-safe functions are
+         * used unless an error occurs.
+         *
+         * Throws a nawa::Exception with error code 1 if the file cannot be opened (the old file will still be used
+         * then).
+         */
+        static void reopen();
+
         /**
          * Set the desired output log level. Only messages with a log level lower or equal the given level will be
          * written to the output stream. Setting the output level to OFF will completely disable logging. The default
@@ -109,6 +210,17 @@ namespace nawa {
          */
         static void setOutputLevel(Level level);
 
+        /**
+         * Check whether messages of the given log level are written with the current output log level. This is what
+         * the NLOG_* macros check before formatting a message.
+         * @param level The log level.
+         * @return True if messages of the given log level are written.
+         */
+        static bool isEnabled(Level level) noexcept {
+            return level != Level::OFF &&
+                   static_cast<int>(level) <= internal::logOutputLevel.load(std::memory_order_relaxed);
+        }
+
         /**
          * Use systemd-style extended log messages in the format
          *     {date} {time} {hostname} {process}[{PID}]: [{appname}] {message}.
@@ -119,6 +231,23 @@ namespace nawa {
          */
         static void setExtendedFormat(bool useExtendedFormat);
 
+        /**
+         * Enable or disable async mode. In async mode, messages are formatted by the logging thread and queued in a
+         * buffer of that thread (without locking), and a background thread writes them in batches. Disabling async mode
+         * writes all queued messages before returning. Async mode ends automatically when every active Log object has
+         * been destructed, and at program exit. Does not work while the output stream is locked, this function will
+         * have no effect then, and throw no exception (make sure to check isLocked() first).
+         * @param async Whether to use async mode. Off by default.
+         * @param overflowPolicy What to do when the buffer of a thread is full.
+         * @param bufferSize Number of messages which can be queued per thread.
+         */
+        static void setAsync(bool async, OverflowPolicy overflowPolicy = OverflowPolicy::DROP, size_t bufferSize = 1024);
+
+        /**
+         * Wait until all messages queued in async mode have been written. Returns immediately if async mode is off.
+         */
+        static void flush();
+
         /**
          * Lock the output stream. It will not be possible to change the output stream of the logger anymore as long as
          * there is at least one active Log object. If the output stream is already locked, this will have no effect.
@@ -146,6 +275,12 @@ namespace nawa {
          */
         void setDefaultLogLevel(Level level) noexcept;
 
+        /**
+         * Get the default log level of this logger.
+         * @return The default log level.
+         */
+        [[nodiscard]] Level getDefaultLogLevel() const noexcept;
+
         /**
          * Write a message to the log using the default log level
          * @param msg The message.
@@ -174,35 +309,61 @@ namespace nawa {
     };
 }// namespace nawa
 
-#define NLOG(Logger, Message)       \
-    {                               \
-        std::ostringstream msgs;    \
-        msgs << Message;            \
-        (Logger).write(msgs.str()); \
-    }
-#define NLOG_ERROR(Logger, Message)                          \
-    {                                                        \
-        std::ostringstream msgs;                             \
-        msgs << Message;                                     \
-        (Logger).write(msgs.str(), nawa::Log::Level::ERROR); \
-    }
-#define NLOG_WARNING(Logger, Message)                          \
-    {                                                          \
-        std::ostringstream msgs;                               \
-        msgs << Message;                                       \
-        (Logger).write(msgs.str(), nawa::Log::Level::WARNING); \
+/**
+ * Write a message of the given log level, which must be a constant expression, if the level is enabled. The message
+ * is only formatted if it is actually written, and removed at compile time if the level is more verbose than
+ * NAWA_LOG_COMPILE_LEVEL.
+ */
+#define NAWA_LOG_WITH_LEVEL(Logger, MessageLevel, Message)                        \
+    {                                                                             \
+        if constexpr (static_cast<int>(MessageLevel) <= NAWA_LOG_COMPILE_LEVEL) { \
+            if (nawa::Log::isEnabled(MessageLevel)) {                             \
+                nawa::Log::MessageFormatter msgs;                                 \
+                msgs.stream() << Message;                                         \
+                (Logger).write(msgs.str(), MessageLevel);                         \
+            }                                                                     \
+        }                                                                         \
     }
-#define NLOG_INFO(Logger, Message)                                   \
-    {                                                                \
-        std::ostringstream msgs;                                     \
-        msgs << Message;                                             \
-        (Logger).write(msgs.str(), nawa::Log::Level::INFORMATIONAL); \
+
+/**
+ * Write a message of the given log level, which must be a constant expression, if the level is enabled. The message
+ * is given as a format string with "{}" placeholders, followed by the arguments. Formatting and compile-time
+ * removal work as for NAWA_LOG_WITH_LEVEL.
+ */
+#define NAWA_LOGF_WITH_LEVEL(Logger, MessageLevel, ...)                           \
+    {                                                                             \
+        if constexpr (static_cast<int>(MessageLevel) <= NAWA_LOG_COMPILE_LEVEL) { \
+            if (nawa::Log::isEnabled(MessageLevel)) {                             \
+                nawa::Log::MessageFormatter msgs;                                 \
+                msgs.format(__VA_ARGS__);                                         \
+                (Logger).write(msgs.str(), MessageLevel);                         \
+            }                                                                     \
+        }                                                                         \
     }
-#define NLOG_DEBUG(Logger, Message)                          \
-    {                                                        \
-        std::ostringstream msgs;                             \
-        msgs << Message;                                     \
-        (Logger).write(msgs.str(), nawa::Log::Level::DEBUG); \
+
+#define NLOG(Logger, Message)                                      \
+    {                                                              \
+        if (nawa::Log::isEnabled((Logger).getDefaultLogLevel())) { \
+            nawa::Log::MessageFormatter msgs;                      \
+            msgs.stream() << Message;                              \
+            (Logger).write(msgs.str());                            \
+        }                                                          \
     }
 
+#define NLOG_ERROR(Logger, Message) NAWA_LOG_WITH_LEVEL(Logger, nawa::Log::Level::ERROR, Message)
+
+#define NLOG_WARNING(Logger, Message) NAWA_LOG_WITH_LEVEL(Logger, nawa::Log::Level::WARNING, Message)
+
+#define NLOG_INFO(Logger, Message) NAWA_LOG_WITH_LEVEL(Logger, nawa::Log::Level::INFORMATIONAL, Message)
+
+#define NLOG_DEBUG(Logger, Message) NAWA_LOG_WITH_LEVEL(Logger, nawa::Log::Level::DEBUG, Message)
+
+#define NLOGF_ERROR(Logger, ...) NAWA_LOGF_WITH_LEVEL(Logger, nawa::Log::Level::ERROR, __VA_ARGS__)
+
+#define NLOGF_WARNING(Logger, ...) NAWA_LOGF_WITH_LEVEL(Logger, nawa::Log::Level::WARNING, __VA_ARGS__)
+
+#define NLOGF_INFO(Logger, ...) NAWA_LOGF_WITH_LEVEL(Logger, nawa::Log::Level::INFORMATIONAL, __VA_ARGS__)
+
+#define NLOGF_DEBUG(Logger, ...) NAWA_LOGF_WITH_LEVEL(Logger, nawa::Log::Level::DEBUG, __VA_ARGS__)
+
 #endif//NAWA_LOG_H
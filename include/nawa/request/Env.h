@@ -48,6 +48,12 @@ namespace nawa::request {
          */
         explicit Env(RequestInitContainer const& initContainer);
 
+        /**
+         * Create Env using a RequestInitContainer, moving the environment out of it (other members remain intact).
+         * @param initContainer The RequestInitContainer.
+         */
+        explicit Env(RequestInitContainer&& initContainer);
+
         /**
          * Get an environment variable. For a list of environment variables, see \ref environmentmanual
          * @param envVar Name of the environment variable.
@@ -56,10 +62,12 @@ namespace nawa::request {
         std::string operator[](std::string const& envVar) const;
 
         /**
-         * Request path. Use ["REQUEST_URI"] to access it as a string.
-         * @return Vector of strings containing the elements of the path.
+         * Request path. Use ["REQUEST_URI"] to access it as a string. The path is split only once, when the request
+         * is created.
+         * @return Reference to a vector of strings containing the elements of the path (valid as long as the request
+         * exists).
          */
-        [[nodiscard]] std::vector<std::string> getRequestPath() const;
+        [[nodiscard]] std::vector<std::string> const& getRequestPath() const;
     };
 }// namespace nawa::request
 
@@ -51,6 +51,14 @@ namespace nawa::request {
 
         GPC(RequestInitContainer const& requestInit, Source source);
 
+        /**
+         * Create a GPC object, moving the variables of the given source out of the RequestInitContainer (other
+         * members remain intact).
+         * @param requestInit The RequestInitContainer.
+         * @param source Source of the variables.
+         */
+        GPC(RequestInitContainer&& requestInit, Source source);
+
         /**
          * Get a GET, POST, or COOKIE variable. If the query contains more than one variable of the same name,
          * only one of them (usually the first definition) will be returned. For accessing all definitions,
@@ -41,6 +41,12 @@ namespace nawa::request {
 
         explicit Post(RequestInitContainer const& requestInit);
 
+        /**
+         * Create a Post object, moving the POST data out of the RequestInitContainer (other members remain intact).
+         * @param requestInit The RequestInitContainer.
+         */
+        explicit Post(RequestInitContainer&& requestInit);
+
         /**
          * Shortcut to check for the existence of POST values (including files).
          * @return True if POST values are available.
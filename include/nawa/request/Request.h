@@ -47,6 +47,13 @@ namespace nawa {
          */
         explicit Request(RequestInitContainer const& initContainer);
 
+        /**
+         * Initialize a Request object from a RequestInitContainer, moving the request data out of it instead of
+         * copying it.
+         * @param initContainer The RequestInitContainer with data needed to create a Request object.
+         */
+        explicit Request(RequestInitContainer&& initContainer);
+
         /**
          * The Env object you should use to access environment variables.
          * @return Reference to the object.
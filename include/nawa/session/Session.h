@@ -29,6 +29,7 @@
 #include <nawa/connection/Cookie.h>
 #include <nawa/internal/fwdecl.h>
 #include <nawa/internal/macros.h>
+#include <nawa/session/SessionStore/SessionStore.h>
 
 namespace nawa {
     /**
@@ -45,6 +46,59 @@ namespace nawa {
         static void destroy();
 
     public:
+        /**
+         * Read-only view of all values of a session, as returned by Session::view(). It reflects the state of the
+         * session at the time it was created and is not affected by later modifications (also not by set() and
+         * unset() on the same Session object). Accessing values through a view does not need any synchronization,
+         * and references to the values stay valid as long as the view exists, so a view can be kept for the
+         * duration of a request.
+         */
+        class View {
+            std::shared_ptr<session::SessionStore::ValueMap const> values;
+
+        public:
+            explicit View(std::shared_ptr<session::SessionStore::ValueMap const> values) : values(std::move(values)) {}
+
+            /**
+             * Check whether there exists a value for the given key.
+             * @param key Key to check.
+             * @return True if a value exists for this key, false otherwise.
+             */
+            [[nodiscard]] bool isSet(std::string const& key) const {
+                return values->count(key) == 1;
+            }
+
+            /**
+             * Get the value at the given key.
+             * @param key Key to get value for.
+             * @return Reference to the value, or to a std::any without value if no value exists for that key.
+             */
+            [[nodiscard]] std::any const& operator[](std::string const& key) const {
+                static const std::any empty;
+                auto it = values->find(key);
+                return it != values->end() ? it->second : empty;
+            }
+
+            /**
+             * Get a pointer to the value at the given key, if it exists and is of the given type.
+             * @tparam T Type of the value.
+             * @param key Key to get value for.
+             * @return Pointer to the value, or nullptr if no value of type T exists for that key.
+             */
+            template<typename T>
+            [[nodiscard]] T const* get(std::string const& key) const {
+                return std::any_cast<T>(&(*this)[key]);
+            }
+
+            /**
+             * Get all values, e.g., for iterating over them.
+             * @return Reference to the map of all values.
+             */
+            [[nodiscard]] session::SessionStore::ValueMap const& all() const {
+                return *values;
+            }
+        };
+
         NAWA_DEFAULT_DESTRUCTOR_DEF(Session);
 
         /**
@@ -127,6 +181,14 @@ namespace nawa {
          */
         std::any operator[](std::string const& key) const;
 
+        /**
+         * Get a read-only view of all values of the current session. In contrast to operator[], values are not
+         * copied, and multiple accesses through the view are guaranteed to see the same state of the session. If
+         * no session is established, the view will be empty.
+         * @return The view.
+         */
+        [[nodiscard]] View view() const;
+
         /**
          * Set key to a value of type std::any. Throws a nawa::Exception with error code 1 if no session has been
          * established.
@@ -186,6 +248,18 @@ namespace nawa {
          */
         [[nodiscard]] std::string getID() const;
 
+        /**
+         * Replace the session store used by all sessions. By default, the store is created on the first session
+         * start according to the NAWA config (see the session section of the sample config file). The options that
+         * determine the store are only read then, later config changes do not affect it. This function can
+         * be used to plug in a custom implementation of session::SessionStore, and should then be called during
+         * initialization of the app, before any session has been started. Sessions that are currently established
+         * keep using the previous store until they end.
+         * @param store The new session store. If nullptr, a store will be created from the config again on the next
+         * session start.
+         */
+        static void setStore(std::shared_ptr<session::SessionStore> store);
+
         /**
          * RequestHandler is declared as a friend in order to be able to call destroy().
          */
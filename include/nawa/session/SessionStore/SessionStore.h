@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file SessionStore.h
+ * \brief Abstract base class for session storage backends.
+ */
+
+#ifndef NAWA_SESSIONSTORE_H
+#define NAWA_SESSIONSTORE_H
+
+#include <any>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace nawa::session {
+
+    /**
+     * A session store keeps the data of all sessions and is used by nawa::Session to look up, create, and remove
+     * sessions. All functions may be called concurrently by different threads, so implementations have to take care
+     * of synchronization. Policies such as expiry and IP validation are enforced by nawa::Session, the store only
+     * has to provide the necessary information.
+     */
+    class SessionStore {
+    public:
+        /**
+         * Map containing all values of a session.
+         */
+        using ValueMap = std::unordered_map<std::string, std::any>;
+
+        /**
+         * A handle to the data of one session, as returned by find() and create(). A nawa::Session object keeps its
+         * handle as long as the session is established. The handle must stay usable (but may become detached from
+         * the store) even if the session is removed from the store in the meantime.
+         */
+        class Handle {
+        public:
+            virtual ~Handle() = default;
+
+            /**
+             * Get the IP address of the client which initiated the session.
+             * @return The source IP address.
+             */
+            [[nodiscard]] virtual std::string sourceIP() const = 0;
+
+            /**
+             * Get the expiry time of the session.
+             * @return The time when the session expires.
+             */
+            [[nodiscard]] virtual time_t expires() const = 0;
+
+            /**
+             * Set the expiry time of the session.
+             * @param expires The time when the session should expire.
+             */
+            virtual void expires(time_t expires) = 0;
+
+            /**
+             * Check whether a value has been stored for the given key.
+             * @param key The key.
+             * @return True if a value exists for this key, false otherwise.
+             */
+            [[nodiscard]] virtual bool isSet(std::string const& key) const = 0;
+
+            /**
+             * Get the value stored for the given key.
+             * @param key The key.
+             * @return The value, or an empty std::any if no value exists for this key.
+             */
+            [[nodiscard]] virtual std::any get(std::string const& key) const = 0;
+
+            /**
+             * Store a value. May throw a nawa::Exception with an error code >=10 if the store cannot hold the value.
+             * @param key The key.
+             * @param value The value.
+             */
+            virtual void set(std::string key, std::any const& value) = 0;
+
+            /**
+             * Remove the value stored for the given key, if any.
+             * @param key The key.
+             */
+            virtual void unset(std::string const& key) = 0;
+
+            /**
+             * Get an immutable snapshot of all values of the session. The snapshot is consistent (i.e., it reflects
+             * the state of the session at one point in time) and is not affected by later modifications.
+             * @return Pointer to the snapshot.
+             */
+            [[nodiscard]] virtual std::shared_ptr<ValueMap const> values() const = 0;
+        };
+
+        virtual ~SessionStore() = default;
+
+        /**
+         * Look up the session with the given ID. Expired sessions may still be returned, checking the expiry time is
+         * up to the caller.
+         * @param sessionId The session ID.
+         * @return A handle to the session, or nullptr if no such session exists.
+         */
+        [[nodiscard]] virtual std::shared_ptr<Handle> find(std::string const& sessionId) = 0;
+
+        /**
+         * Create a new, empty session. May throw a nawa::Exception with an error code >=10 if the store is full.
+         * @param sessionId The ID of the new session.
+         * @param sourceIP IP address of the client initiating the session.
+         * @param expires Expiry time of the new session.
+         * @return A handle to the new session, or nullptr if a session with the given ID already exists.
+         */
+        [[nodiscard]] virtual std::shared_ptr<Handle>
+        create(std::string const& sessionId, std::string const& sourceIP, time_t expires) = 0;
+
+        /**
+         * Remove the session with the given ID from the store (if it exists).
+         * @param sessionId The session ID.
+         */
+        virtual void remove(std::string const& sessionId) = 0;
+
+        /**
+         * Remove all expired sessions from the store. Called by nawa::Session in 1/gc_divisor of all session starts,
+         * unless the store takes care of that itself (see collectsGarbageInBackground()).
+         */
+        virtual void collectGarbage() = 0;
+
+        /**
+         * Check whether the store removes expired sessions on its own, so that nawa::Session does not need to call
+         * collectGarbage().
+         * @return True if garbage collection happens in the background, false otherwise.
+         */
+        [[nodiscard]] virtual bool collectsGarbageInBackground() const {
+            return false;
+        }
+
+        /**
+         * Called by nawa on shutdown (while the RequestHandler is destroyed), before the store is released. Stores
+         * which persist their sessions should do so here, as the destructor may run during static destruction, when
+         * logging and other facilities might not be available anymore.
+         */
+        virtual void shutdown() {}
+    };
+
+}// namespace nawa::session
+
+#endif//NAWA_SESSIONSTORE_H
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file MemorySessionStore.h
+ * \brief Session store keeping all sessions in the memory of the current process.
+ */
+
+#ifndef NAWA_MEMORYSESSIONSTORE_H
+#define NAWA_MEMORYSESSIONSTORE_H
+
+#include <nawa/internal/macros.h>
+#include <nawa/session/SessionStore/SessionStore.h>
+
+namespace nawa::session {
+    /**
+     * Session store keeping all sessions in the memory of the current process. This is the default store. Sessions
+     * are distributed over independently locked shards, so that concurrent requests only contend if their sessions
+     * happen to be located in the same shard. Session values can be of arbitrary types.
+     */
+    class MemorySessionStore : public SessionStore {
+        NAWA_PRIVATE_DATA()
+
+    public:
+        NAWA_DEFAULT_DESTRUCTOR_OVERRIDE_DEF(MemorySessionStore);
+
+        /**
+         * Create a memory session store.
+         * @param backgroundGC If true, expired sessions will be removed by a background thread in small slices
+         * instead of by calls to collectGarbage().
+         * @param snapshotFile If not empty, the sessions will be restored from this snapshot file (if it exists)
+         * on construction, and saved to it by shutdown(), so that sessions survive a restart. Errors will be
+         * logged, but not thrown.
+         */
+        explicit MemorySessionStore(bool backgroundGC = false, std::string snapshotFile = "");
+
+        /**
+         * Save all sessions that have not yet expired into a binary snapshot file. The file is written atomically
+         * (by writing a temporary file and renaming it). Values of types that have not been registered in the
+         * session::ValueRegistry are skipped. Throws a nawa::Exception with error code 1 if the file cannot be
+         * written.
+         * @param path Path of the snapshot file.
+         * @return Number of saved sessions.
+         */
+        size_t saveSnapshot(std::string const& path) const;
+
+        /**
+         * Restore sessions from a binary snapshot file written by saveSnapshot(). The file is memory-mapped for
+         * reading. Expired sessions and values of unknown types are skipped, and existing sessions with the same ID
+         * are kept. Throws a nawa::Exception with error code 2 if the file cannot be opened, and with error code 3
+         * if it is not a valid snapshot file.
+         * @param path Path of the snapshot file.
+         * @return Number of restored sessions.
+         */
+        size_t loadSnapshot(std::string const& path);
+
+        [[nodiscard]] std::shared_ptr<Handle> find(std::string const& sessionId) override;
+
+        [[nodiscard]] std::shared_ptr<Handle>
+        create(std::string const& sessionId, std::string const& sourceIP, time_t expires) override;
+
+        void remove(std::string const& sessionId) override;
+
+        void collectGarbage() override;
+
+        /**
+         * Save the sessions to the snapshot file, if one has been given to the constructor. The destructor does not
+         * save anything.
+         */
+        void shutdown() override;
+
+        [[nodiscard]] bool collectsGarbageInBackground() const override;
+    };
+}// namespace nawa::session
+
+#endif//NAWA_MEMORYSESSIONSTORE_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file SharedMemorySessionStore.h
+ * \brief Session store keeping all sessions in a POSIX shared memory segment.
+ */
+
+#ifndef NAWA_SHAREDMEMORYSESSIONSTORE_H
+#define NAWA_SHAREDMEMORYSESSIONSTORE_H
+
+#include <nawa/internal/macros.h>
+#include <nawa/session/SessionStore/SessionStore.h>
+
+namespace nawa::session {
+    /**
+     * Session store keeping all sessions in a POSIX shared memory segment, so that several processes on the same
+     * host (e.g., multiple nawarun instances behind one FastCGI pool) can share their sessions. The segment consists
+     * of a fixed number of slots of a fixed size, one slot per session. Reading session data is lock-free (every
+     * slot is protected by a sequence lock), writers lock the affected slot only. Locks held by a process which
+     * crashed are recovered, discarding the session the process was modifying. All operations throw a
+     * nawa::Exception with error code 14 if a lock is held by a live process for more than 5 seconds.
+     *
+     * As the data has to be serialized, only values of types registered in the session::ValueRegistry can be stored
+     * (by default, strings, bools, and numbers). All values of a session (including their keys) must fit into one
+     * slot.
+     */
+    class SharedMemorySessionStore : public SessionStore {
+        NAWA_PRIVATE_DATA()
+
+    public:
+        NAWA_DEFAULT_DESTRUCTOR_OVERRIDE_DEF(SharedMemorySessionStore);
+
+        /**
+         * Open (or create, if it does not exist yet) the shared memory segment. All processes using the same segment
+         * must use the same slot count and size. Throws a nawa::Exception with error code 1 if the segment cannot
+         * be created or mapped, and with error code 2 if an existing segment has an incompatible layout.
+         * @param name Name of the shared memory segment, must start with a slash (e.g., "/nawa_sessions").
+         * @param slotCount Maximum number of sessions that can exist at the same time.
+         * @param slotSize Size of one slot in bytes, including approx. 200 bytes of metadata.
+         */
+        explicit SharedMemorySessionStore(std::string const& name, size_t slotCount = 4096, size_t slotSize = 4096);
+
+        [[nodiscard]] std::shared_ptr<Handle> find(std::string const& sessionId) override;
+
+        /**
+         * Create a new session. Throws a nawa::Exception with error code 10 if all slots are in use, and with error
+         * code 11 if the session ID or source IP are too long.
+         * @param sessionId The ID of the new session.
+         * @param sourceIP IP address of the client initiating the session.
+         * @param expires Expiry time of the new session.
+         * @return A handle to the new session, or nullptr if a session with the given ID already exists.
+         */
+        [[nodiscard]] std::shared_ptr<Handle>
+        create(std::string const& sessionId, std::string const& sourceIP, time_t expires) override;
+
+        void remove(std::string const& sessionId) override;
+
+        void collectGarbage() override;
+    };
+}// namespace nawa::session
+
+#endif//NAWA_SHAREDMEMORYSESSIONSTORE_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file ValueRegistry.h
+ * \brief Registry of session value types that can be serialized.
+ */
+
+#ifndef NAWA_VALUEREGISTRY_H
+#define NAWA_VALUEREGISTRY_H
+
+#include <any>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeindex>
+#include <utility>
+
+namespace nawa::session {
+    /**
+     * Registry of the types of session values that can be serialized, e.g., for storing them in shared memory or for
+     * saving sessions in a snapshot file. Every type is registered with a unique name, which identifies it in the
+     * serialized data. The following types are registered by default: std::string, bool, int, unsigned int, long,
+     * unsigned long, long long, unsigned long long, float, double.
+     *
+     * Types should be registered during initialization of the app, i.e., before any session is started (or restored).
+     */
+    class ValueRegistry {
+    public:
+        /**
+         * A serializer converts a value (the std::any is guaranteed to contain the registered type) into bytes.
+         */
+        using Serializer = std::function<std::string(std::any const&)>;
+
+        /**
+         * A deserializer converts bytes back into a value. It should return an empty std::any if the bytes are
+         * invalid.
+         */
+        using Deserializer = std::function<std::any(std::string_view)>;
+
+        /**
+         * Register a type. An already registered type or name will be replaced.
+         * @param type The type.
+         * @param typeName Unique name of the type, used in the serialized data.
+         * @param serializer The serializer.
+         * @param deserializer The deserializer.
+         */
+        static void registerType(std::type_index type, std::string const& typeName, Serializer serializer,
+                                 Deserializer deserializer);
+
+        /**
+         * Register a type with typed serialization functions.
+         * @tparam T The type.
+         * @param typeName Unique name of the type, used in the serialized data.
+         * @param serializer Function converting a value into bytes.
+         * @param deserializer Function converting bytes into a value.
+         */
+        template<typename T>
+        static void registerType(std::string const& typeName, std::function<std::string(T const&)> serializer,
+                                 std::function<T(std::string_view)> deserializer) {
+            registerType(
+                    std::type_index(typeid(T)), typeName,
+                    [serializer = std::move(serializer)](std::any const& value) {
+                        return serializer(std::any_cast<T const&>(value));
+                    },
+                    [deserializer = std::move(deserializer)](std::string_view bytes) {
+                        return std::any(deserializer(bytes));
+                    });
+        }
+
+        /**
+         * Register a trivially copyable type, which will be serialized by copying its object representation. Only
+         * use this for types without pointers (as they would not be valid anymore after deserialization).
+         * @tparam T The type.
+         * @param typeName Unique name of the type, used in the serialized data.
+         */
+        template<typename T>
+        static void registerTrivialType(std::string const& typeName) {
+            auto [serializer, deserializer] = trivialSerialization<T>();
+            registerType(std::type_index(typeid(T)), typeName, std::move(serializer), std::move(deserializer));
+        }
+
+        /**
+         * Get the serializer and deserializer for a trivially copyable type, which copy its object representation
+         * (as used by registerTrivialType() and for the default types).
+         * @tparam T The type.
+         * @return The serializer and deserializer.
+         */
+        template<typename T>
+        static std::pair<Serializer, Deserializer> trivialSerialization() {
+            static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable.");
+            return {[](std::any const& value) {
+                        return std::string(reinterpret_cast<char const*>(std::any_cast<T>(&value)), sizeof(T));
+                    },
+                    [](std::string_view bytes) {
+                        if (bytes.size() != sizeof(T)) {
+                            return std::any();
+                        }
+                        T value;
+                        std::memcpy(&value, bytes.data(), sizeof(T));
+                        return std::any(value);
+                    }};
+        }
+
+        /**
+         * Check whether values of the given type can be serialized.
+         * @param type The type.
+         * @return True if the type has been registered (or is void, i.e., an empty std::any), false otherwise.
+         */
+        static bool isRegistered(std::type_index type);
+
+        /**
+         * Serialize a value.
+         * @param value The value.
+         * @return The name of the type and the serialized bytes, or nullopt if the type has not been registered.
+         * An empty std::any is serialized as an empty type name.
+         */
+        static std::optional<std::pair<std::string, std::string>> serialize(std::any const& value);
+
+        /**
+         * Deserialize a value.
+         * @param typeName The name of the type (empty for an empty std::any).
+         * @param bytes The serialized bytes.
+         * @return The value, or nullopt if the type is not known or the bytes are invalid.
+         */
+        static std::optional<std::any> deserialize(std::string_view typeName, std::string_view bytes);
+    };
+}// namespace nawa::session
+
+#endif//NAWA_VALUEREGISTRY_H
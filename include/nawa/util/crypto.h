@@ -85,6 +85,24 @@ namespace nawa::crypto {
      */
     std::string md5(std::string const& input, bool hex = true);
 
+    /**
+     * Fill a buffer with cryptographically secure random bytes. This uses the private DRBG of OpenSSL, which exists
+     * per thread, is seeded from the operating system (getrandom) on first use, and is reseeded automatically, so
+     * that no syscall is needed per call. Throws a nawa::Exception with error code 1 if the DRBG fails.
+     * @param buffer The buffer to fill.
+     * @param size Number of random bytes to write into the buffer.
+     */
+    void randomBytes(unsigned char* buffer, size_t size);
+
+    /**
+     * Generate a random token (e.g., a session ID) from cryptographically secure random bytes (see randomBytes()).
+     * The token is encoded in base64url without padding, so it can be safely used in URLs and cookies.
+     * Throws a nawa::Exception with error code 1 if the DRBG fails.
+     * @param bytes Number of random bytes. The default of 32 bytes (256 bits) results in a token of 43 chars.
+     * @return The random token.
+     */
+    std::string randomToken(size_t bytes = 32);
+
     /**
      * Create a (hopefully) secure password hash using a hash algorithm (bcrypt by default). \n
      * This function returns one-way hashes with pseudo-random salts. Use passwordVerify to validate a password.\n
@@ -65,6 +65,12 @@ namespace nawa::encoding {
      */
     std::string urlDecode(std::string input);
 
+    /**
+     * Decode a percent-encoded string (byte-wise, in URLs always utf-8) in place, without allocating memory.
+     * @param input Percent-encoded string, which will be replaced by the decoded string.
+     */
+    void urlDecodeInPlace(std::string& input);
+
     /**
      * Check if a string contains only valid base64 characters and could be valid base64.
      * @param input Input string.
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file metrics.h
+ * \brief Built-in request metrics (counters and latency histograms), collected per thread.
+ */
+
+#ifndef NAWA_METRICS_H
+#define NAWA_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nawa::metrics {
+    /**
+     * Counters maintained by NAWA.
+     */
+    enum class Counter {
+        REQUESTS,          /**< Requests passed to the request handler. */
+        FILTERED_REQUESTS, /**< Requests answered by an access filter. */
+        FLUSHES,           /**< Calls to the flush callback of the request handler. */
+        BYTES_OUT          /**< Response body bytes passed to the request handler (headers not included). */
+    };
+
+    /**
+     * Histograms maintained by NAWA. Durations are recorded in microseconds, sizes in bytes.
+     */
+    enum class Histogram {
+        QUEUE_WAIT,   /**< Time from the arrival of a request (including reading the body) until it is handled. */
+        FILTER_TIME,  /**< Time spent applying the access filters. */
+        APP_TIME,     /**< Time spent in the request handling function of the app. */
+        FLUSH_TIME,   /**< Time spent in the flush callback of the request handler. */
+        RESPONSE_SIZE /**< Response body bytes per request. */
+    };
+
+    /**
+     * Aggregated values of a histogram. Values are sorted into log-linear buckets (four buckets per power of two),
+     * so quantiles have a relative error of less than 25%.
+     */
+    struct HistogramSnapshot {
+        std::vector<uint64_t> buckets; /**< Number of values per bucket. */
+        uint64_t count = 0;            /**< Number of recorded values. */
+        uint64_t sum = 0;              /**< Sum of all recorded values. */
+
+        /**
+         * Estimate a quantile.
+         * @param q The quantile, between 0 and 1 (e.g., 0.99).
+         * @return Upper bound of the bucket containing the quantile, or 0 if no values have been recorded.
+         */
+        [[nodiscard]] uint64_t quantile(double q) const;
+
+        /**
+         * Get the number of recorded values which are less than 2^exponent.
+         * @param exponent The exponent.
+         * @return The number of values.
+         */
+        [[nodiscard]] uint64_t countBelowPowerOfTwo(unsigned int exponent) const;
+    };
+
+    namespace internal {
+        extern std::atomic<bool> enabled; /**< Use metrics::enabled() and metrics::enable(). */
+    }
+
+    /**
+     * Check whether metrics are collected. Instrumentation should be skipped entirely if they are not.
+     * @return True if metrics are collected.
+     */
+    inline bool enabled() noexcept {
+        return internal::enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Enable or disable collecting metrics. This happens automatically according to metrics/enabled in the NAWA
+     * config whenever the config of the request handler is set.
+     * @param enable True to enable, false to disable.
+     */
+    void enable(bool enable = true) noexcept;
+
+    /**
+     * Increment a counter of the current thread, if metrics are enabled.
+     * @param counter The counter.
+     * @param amount Value to add.
+     */
+    void count(Counter counter, uint64_t amount = 1) noexcept;
+
+    /**
+     * Record a value in a histogram of the current thread, if metrics are enabled.
+     * @param histogram The histogram.
+     * @param value The value.
+     */
+    void record(Histogram histogram, uint64_t value) noexcept;
+
+    /**
+     * Get the current time for measuring a duration with recordSince().
+     * @return The current time, or a default-constructed time point if metrics are disabled (so that measurements
+     * are only done when necessary).
+     */
+    inline std::chrono::steady_clock::time_point startTimer() noexcept {
+        return enabled() ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    }
+
+    /**
+     * Record the time elapsed since a time point in a histogram, if metrics are enabled.
+     * @param histogram The histogram.
+     * @param start Time point as returned by startTimer(). Nothing will be recorded if it is default-constructed.
+     */
+    void recordSince(Histogram histogram, std::chrono::steady_clock::time_point start) noexcept;
+
+    /**
+     * Aggregate a counter over all threads.
+     * @param counter The counter.
+     * @return The sum of the counter over all threads.
+     */
+    uint64_t getCounter(Counter counter);
+
+    /**
+     * Aggregate a histogram over all threads.
+     * @param histogram The histogram.
+     * @return The aggregated histogram.
+     */
+    HistogramSnapshot getHistogram(Histogram histogram);
+
+    /**
+     * Aggregate all metrics and format them in the Prometheus text exposition format. The metrics can be served
+     * automatically under a path given in metrics/path in the NAWA config.
+     * @return The metrics in Prometheus text format.
+     */
+    std::string prometheusText();
+}// namespace nawa::metrics
+
+#endif//NAWA_METRICS_H
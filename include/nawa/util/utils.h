@@ -26,7 +26,9 @@
 
 #include <regex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace nawa::utils {
     /**
@@ -100,11 +102,19 @@ namespace nawa::utils {
      * Create a time_t value (UNIX timestamp) from a HTTP header date/time string. May throw an Exception with
      * error code 1 if parsing fails.
      * @param httpTime Time string in the format:
-     * "<day-name(3)>, <day(2)> <month(3)> <year(4)> <hour(2)>:<minute(2)>:<second(2)> GMT".
+     * "<day-name(3)>, <day(2)> <month(3)> <year(4)> <hour(2)>:<minute(2)>:<second(2)> GMT". The obsolete formats
+     * defined in RFC 7231 (RFC 850 and asctime() format) are accepted as well.
      * @return UNIX timestamp value (time_t).
      */
     time_t readHttpTime(std::string const& httpTime);
 
+    /**
+     * Get the current time as a HTTP header compatible date/time string (as needed for the date header). The string
+     * is only generated once per second and thread.
+     * @return Reference to the time string, which is valid in the current thread until the next call.
+     */
+    std::string const& currentHttpTime();
+
     /**
      * Convert a time_t value (UNIX timestamp) to a SMTP header compatible date/time string. May throw an Exception
      * with error code 1 if interpretation of the UNIX timestamp fails.
@@ -187,6 +197,14 @@ namespace nawa::utils {
      */
     std::unordered_multimap<std::string, std::string> splitQueryString(std::string const& queryString);
 
+    /**
+     * Split a query string (the ?k1=v1&k2=v2... part of a URL) into key-value pairs without copying anything. Values
+     * are not URL-decoded (use encoding::urlDecodeInPlace() on a copy if needed).
+     * @param queryString Query string or URL containing a query string.
+     * @return Vector of key-value pairs, in the order of the query string, pointing into queryString.
+     */
+    std::vector<std::pair<std::string_view, std::string_view>> splitQueryStringView(std::string_view queryString);
+
     /**
      * Parse a block of headers into a map.
      * @param rawHeaders The raw block of headers.
@@ -194,6 +212,15 @@ namespace nawa::utils {
      */
     std::unordered_map<std::string, std::string> parseHeaders(std::string rawHeaders);
 
+    /**
+     * Split a block of headers into key-value pairs without copying anything. Leading whitespace is removed from the
+     * values, and lines without a colon or value are skipped.
+     * @param rawHeaders The raw block of headers.
+     * @return Vector of key-value pairs, in the order of the header block, pointing into rawHeaders (keys are not
+     * transformed to lowercase).
+     */
+    std::vector<std::pair<std::string_view, std::string_view>> parseHeadersView(std::string_view rawHeaders);
+
     /**
      * Parse cookies sent by the browser.
      * @param rawCookies The content of the "Cookie" header.
@@ -201,6 +228,14 @@ namespace nawa::utils {
      */
     std::unordered_multimap<std::string, std::string> parseCookies(std::string const& rawCookies);
 
+    /**
+     * Split the content of a "Cookie" header into key-value pairs without copying anything. Cookies without a value
+     * are skipped.
+     * @param rawCookies The content of the "Cookie" header.
+     * @return Vector of key-value pairs, pointing into rawCookies.
+     */
+    std::vector<std::pair<std::string_view, std::string_view>> parseCookiesView(std::string_view rawCookies);
+
     /**
      * Convert any iterable map to an unordered_multimap.
      * @tparam KeyType Key type (automatically deduced).
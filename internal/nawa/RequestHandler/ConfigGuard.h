@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file ConfigGuard.h
+ * \brief Read access to the config of a RequestHandler without reference counting.
+ */
+
+#ifndef NAWA_CONFIGGUARD_H
+#define NAWA_CONFIGGUARD_H
+
+#include <nawa/config/Config.h>
+#include <nawa/util/AtomicSnapshot.h>
+
+namespace nawa {
+    struct RequestHandlerGeneration;
+
+    /**
+     * Read access to the current config of a RequestHandler (see RequestHandler::readConfig()). The config stays
+     * valid as long as the guard exists, even if it is replaced in the meantime. As the generation is protected by a
+     * hazard pointer, creating a guard does not write to memory shared between threads. A guard must be destroyed in
+     * the thread which created it.
+     */
+    class ConfigGuard {
+        AtomicSnapshot<RequestHandlerGeneration>::Guard generation;
+        Config const* config;
+
+    public:
+        /**
+         * Protect the current generation of the request handler. Implemented in RequestHandler.cpp.
+         * @param snapshot The generation snapshot of the request handler.
+         */
+        explicit ConfigGuard(AtomicSnapshot<RequestHandlerGeneration> const& snapshot) noexcept;
+
+        ConfigGuard(ConfigGuard const&) = delete;
+        ConfigGuard& operator=(ConfigGuard const&) = delete;
+
+        Config const& operator*() const noexcept { return *config; }
+
+        Config const* operator->() const noexcept { return config; }
+    };
+}// namespace nawa
+
+#endif//NAWA_CONFIGGUARD_H
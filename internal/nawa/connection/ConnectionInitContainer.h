@@ -37,7 +37,12 @@ namespace nawa {
          * Callback function which takes a `nawa::FlushCallbackContainer` and flushes the response to the user.
          */
         FlushCallbackFunction flushCallback;
-        Config config;                    /**< The NAWA config. */
+        Config config;                    /**< The NAWA config, if sharedConfig is not set. */
+        /**
+         * The config of the request handler, used instead of config to avoid copying it for every request. Must stay
+         * valid until the Connection has been destroyed (e.g., by keeping a ConfigGuard).
+         */
+        Config const* sharedConfig = nullptr;
         RequestInitContainer requestInit; /**< The RequestInitContainer containing necessary request data. */
     };
 }// namespace nawa
@@ -25,7 +25,9 @@
 #define NAWA_FLUSHCALLBACKCONTAINER_H
 
 #include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace nawa {
@@ -34,16 +36,50 @@ namespace nawa {
      */
     struct FlushCallbackContainer {
         unsigned int status;                                       /**< The HTTP response status as an unsigned integer. */
-        std::unordered_multimap<std::string, std::string> headers; /**< The multimap of response headers. */
-        std::string body;                                          /**< The response body. */
+        /**
+         * The multimap of response headers. Only filled when flushing for the first time.
+         */
+        std::unordered_multimap<std::string, std::string> headers;
+        /**
+         * The (part of the) response body to be sent. Points into the buffer of the Connection (or to a chunk passed
+         * to Connection::flushChunk) and is only valid during the callback, so it has to be sent (or copied) there.
+         */
+        std::string_view body;
         bool flushedBefore;                                        /**< True if the response has been flushed before, false otherwise. */
 
+        /**
+         * A file which has to be sent after the body (see Connection::sendFile), so that it does not need to be
+         * loaded into memory.
+         */
+        struct FileBody {
+            int fd;      /**< File descriptor of the file, only valid during the callback. */
+            size_t size; /**< Number of bytes to send, starting at offset 0. */
+        };
+
+        std::optional<FileBody> file; /**< The file to be sent after the body, if any. */
+
+        /**
+         * Read the file (if any) in chunks of the given size and pass them to the callback function, so that only
+         * one chunk has to be held in memory at a time. Implemented in Connection.cpp.
+         * @param callback Function to be called for every chunk. The chunk is only valid during the call.
+         * @param chunkSize Maximum size of the chunks.
+         * @return True on success, false if the file could not be read completely.
+         */
+        bool forEachFileChunk(std::function<void(std::string_view)> const& callback, size_t chunkSize = 65536) const;
+
         /**
          * Get a textual representation of the HTTP status (such as "200 OK"). Implemented in Connection.cpp.
          * @return Textual representation of the HTTP status.
          */
         std::string getStatusString() const;
 
+        /**
+         * Generate the raw HTTP headers (including the empty line terminating them) when flushing for the first
+         * time, or an empty string otherwise. The HTTP status is not included. Implemented in Connection.cpp.
+         * @return The raw HTTP headers.
+         */
+        std::string getHeaderString() const;
+
         /**
          * Generate a full raw HTTP source, including headers when flushing for the first time
          * (but without HTTP status). Implemented in Connection.cpp.
@@ -52,7 +88,7 @@ namespace nawa {
         std::string getFullHttp() const;
     };
 
-    using FlushCallbackFunction = std::function<void(FlushCallbackContainer)>;
+    using FlushCallbackFunction = std::function<void(FlushCallbackContainer const&)>;
 }// namespace nawa
 
 #endif//NAWA_FLUSHCALLBACKCONTAINER_H
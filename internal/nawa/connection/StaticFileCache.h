@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * \file StaticFileCache.h
+ * \brief Size-bounded LRU cache for files served by forward filters.
+ */
+
+#ifndef NAWA_STATICFILECACHE_H
+#define NAWA_STATICFILECACHE_H
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <nawa/internal/macros.h>
+#include <string>
+
+namespace nawa {
+    /**
+     * Size-bounded LRU cache for files served by forward filters. Entries hold the file content along with the
+     * precomputed headers, so that frequently requested files can be served without touching the file system. An entry
+     * is revalidated with stat() once the revalidation interval has passed since the last check, and reloaded if the
+     * file has been changed. Hits on recently used files do not reorder the LRU list, so that they only need a shared
+     * lock, which makes the eviction order approximate.
+     */
+    class StaticFileCache {
+        NAWA_PRIVATE_DATA()
+
+    public:
+        /**
+         * A cached file. Entries are immutable and can be used after they have been evicted from the cache.
+         */
+        struct Entry {
+            std::string content;      /**< Content of the file. */
+            std::string contentType;  /**< Content type, as guessed from the file extension. */
+            std::string etag;         /**< Strong ETag (including the quotes), derived from the content. */
+            std::string lastModified; /**< Time of the last modification as a HTTP date string. */
+            time_t lastModifiedTime;  /**< Time of the last modification as a UNIX timestamp. */
+        };
+
+        NAWA_DEFAULT_DESTRUCTOR_DEF(StaticFileCache);
+
+        /**
+         * Create a static file cache.
+         * @param capacity Maximum total size (in bytes) of the cached file contents.
+         * @param maxFileSize Maximum size (in bytes) of a single file to be cached. Larger files will not be cached.
+         * @param revalidateInterval Minimum time between two checks whether a cached file has been modified.
+         */
+        StaticFileCache(size_t capacity, size_t maxFileSize, std::chrono::steady_clock::duration revalidateInterval);
+
+        /**
+         * Get the cache entry for a file, loading the file into the cache if necessary.
+         * @param path Path of the file.
+         * @return The cache entry, or nullptr if the file does not exist, cannot be read, or is too large to be
+         * cached (in this case, it should be sent without the cache).
+         */
+        std::shared_ptr<Entry const> get(std::string const& path);
+
+        /**
+         * Remove all entries from the cache.
+         */
+        void clear();
+
+        /**
+         * Get the total size of all cached file contents.
+         * @return Size in bytes.
+         */
+        [[nodiscard]] size_t size() const;
+
+        /**
+         * Get the capacity this cache has been created with.
+         * @return Maximum total size in bytes.
+         */
+        [[nodiscard]] size_t capacity() const;
+
+        /**
+         * Get the maximum file size this cache has been created with.
+         * @return Maximum size of a single file in bytes.
+         */
+        [[nodiscard]] size_t maxFileSize() const;
+
+        /**
+         * Get the revalidation interval this cache has been created with.
+         * @return The revalidation interval.
+         */
+        [[nodiscard]] std::chrono::steady_clock::duration revalidateInterval() const;
+    };
+}// namespace nawa
+
+#endif//NAWA_STATICFILECACHE_H
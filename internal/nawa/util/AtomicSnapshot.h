@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file AtomicSnapshot.h
+ * \brief Atomically replaceable immutable object, protected by hazard pointers.
+ */
+
+#ifndef NAWA_ATOMICSNAPSHOT_H
+#define NAWA_ATOMICSNAPSHOT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace nawa {
+    namespace hazard {
+        /**
+         * Number of hazard pointers available per thread. If a thread needs more at the same time (which only
+         * happens if snapshots are accessed recursively), readers fall back to locking.
+         */
+        size_t const SLOTS_PER_THREAD = 4;
+
+        /**
+         * Get a free hazard pointer of the current thread.
+         * @return The hazard pointer, or nullptr if all hazard pointers of the current thread are in use.
+         */
+        std::atomic<void const*>* acquire() noexcept;
+
+        /**
+         * Check whether any thread currently protects the given object.
+         * @param object The object.
+         * @return True if at least one hazard pointer points to the object.
+         */
+        bool isProtected(void const* object) noexcept;
+    }// namespace hazard
+
+    /**
+     * Holds an immutable object which is read very frequently (e.g., for every request) and replaced rarely. Readers
+     * announce the object they are using in a hazard pointer of their thread, so reading does not write to any memory
+     * shared with other threads (no locks, no reference counting). Replaced objects are deleted as soon as no hazard
+     * pointer refers to them anymore, which is checked whenever the object is replaced again (and on destruction).
+     * @tparam T Type of the object, must be copy-constructible.
+     */
+    template<typename T>
+    class AtomicSnapshot {
+        std::atomic<T const*> current;
+        std::vector<T const*> retired; /**< Replaced objects which have not been deleted yet, guarded by writeLock. */
+        mutable std::shared_mutex writeLock;
+
+        /**
+         * Delete all retired objects which are not protected anymore. Caller must hold writeLock exclusively.
+         */
+        void reclaim() {
+            std::vector<T const*> stillProtected;
+            for (auto object : retired) {
+                if (hazard::isProtected(object)) {
+                    stillProtected.push_back(object);
+                } else {
+                    delete object;
+                }
+            }
+            retired = std::move(stillProtected);
+        }
+
+    public:
+        /**
+         * Read access to the current object. The object stays valid (though it may not be current anymore) as long as
+         * the Guard exists. A Guard must be destroyed in the thread which created it.
+         */
+        class Guard {
+            T const* object = nullptr;
+            std::atomic<void const*>* hazardPointer = nullptr;
+            std::shared_lock<std::shared_mutex> fallbackLock;
+
+            friend class AtomicSnapshot;
+
+            explicit Guard(AtomicSnapshot const& snapshot) : hazardPointer(hazard::acquire()) {
+                if (!hazardPointer) {
+                    fallbackLock = std::shared_lock(snapshot.writeLock);
+                    object = snapshot.current.load(std::memory_order_acquire);
+                    return;
+                }
+                // publish the hazard pointer and make sure that the object has not been replaced in the meantime
+                T const* expected;
+                do {
+                    expected = snapshot.current.load(std::memory_order_acquire);
+                    hazardPointer->store(expected, std::memory_order_seq_cst);
+                    object = snapshot.current.load(std::memory_order_seq_cst);
+                } while (object != expected);
+            }
+
+        public:
+            Guard(Guard const&) = delete;
+            Guard& operator=(Guard const&) = delete;
+
+            ~Guard() {
+                if (hazardPointer) {
+                    hazardPointer->store(nullptr, std::memory_order_release);
+                }
+            }
+
+            T const& operator*() const noexcept { return *object; }
+
+            T const* operator->() const noexcept { return object; }
+        };
+
+        /**
+         * Create the snapshot holder with an initial object.
+         * @param initial The initial object.
+         */
+        explicit AtomicSnapshot(T initial = T()) : current(new T(std::move(initial))) {}
+
+        AtomicSnapshot(AtomicSnapshot const&) = delete;
+        AtomicSnapshot& operator=(AtomicSnapshot const&) = delete;
+
+        /**
+         * Delete the current and all retired objects. No Guard must exist anymore.
+         */
+        ~AtomicSnapshot() {
+            delete current.load();
+            for (auto object : retired) {
+                delete object;
+            }
+        }
+
+        /**
+         * Get read access to the current object.
+         * @return Guard providing access to the object.
+         */
+        [[nodiscard]] Guard read() const { return Guard(*this); }
+
+        /**
+         * Replace the current object by a modified copy. Calls to update() are serialized, readers are never blocked
+         * (unless they had to fall back to locking).
+         * @param modify Function which receives a reference to the copy and modifies it.
+         */
+        template<typename Modifier>
+        void update(Modifier modify) {
+            std::unique_lock lockGuard(writeLock);
+            auto replacement = std::make_unique<T>(*current.load(std::memory_order_relaxed));
+            modify(*replacement);
+            retired.push_back(current.exchange(replacement.release(), std::memory_order_seq_cst));
+            reclaim();
+        }
+    };
+}// namespace nawa
+
+#endif//NAWA_ATOMICSNAPSHOT_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * \file ThreadLocalPool.h
+ * \brief Per-thread free list for recycling objects (such as buffers) between requests.
+ */
+
+#ifndef NAWA_THREADLOCALPOOL_H
+#define NAWA_THREADLOCALPOOL_H
+
+#include <utility>
+#include <vector>
+
+namespace nawa {
+    /**
+     * Per-thread free list of objects of type T. Objects released into the pool keep their allocated memory (e.g.,
+     * the capacity of a string or the buckets of a map), so that the next request handled by the same thread can
+     * reuse it instead of allocating again. No locking is needed, as every thread has its own free list.
+     * @tparam T Type of the pooled objects, must be default-constructible and movable.
+     * @tparam MaxPooled Maximum number of objects kept per thread.
+     */
+    template<typename T, size_t MaxPooled = 4>
+    class ThreadLocalPool {
+        static std::vector<T>& freeList() {
+            thread_local std::vector<T> list;
+            return list;
+        }
+
+    public:
+        /**
+         * Take an object from the pool of the current thread, or create a new one if the pool is empty.
+         * @return The object, in the state it has been released in.
+         */
+        static T acquire() {
+            auto& list = freeList();
+            if (list.empty()) {
+                return T();
+            }
+            T obj = std::move(list.back());
+            list.pop_back();
+            return obj;
+        }
+
+        /**
+         * Put an object into the pool of the current thread, or destroy it if the pool is full. The object should
+         * be reset (e.g., cleared) by the caller beforehand.
+         * @param obj The object.
+         */
+        static void release(T&& obj) {
+            auto& list = freeList();
+            if (list.size() < MaxPooled) {
+                if (list.capacity() == 0) {
+                    list.reserve(MaxPooled);
+                }
+                list.push_back(std::move(obj));
+            }
+        }
+    };
+}// namespace nawa
+
+#endif//NAWA_THREADLOCALPOOL_H
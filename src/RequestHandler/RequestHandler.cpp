@@ -21,59 +21,113 @@
  * \brief Implementation of the RequestHandler class.
  */
 
-#include <mutex>
+#include <nawa/RequestHandler/ConfigGuard.h>
 #include <nawa/RequestHandler/RequestHandler.h>
 #include <nawa/RequestHandler/impl/FastcgiRequestHandler.h>
 #include <nawa/RequestHandler/impl/HttpRequestHandler.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/session/Session.h>
+#include <nawa/systemconfig.h>
+#include <nawa/util/AtomicSnapshot.h>
 #include <nawa/util/encoding.h>
-#include <shared_mutex>
+#include <nawa/util/metrics.h>
+#include <nawa/util/utils.h>
+
+#ifdef NAWA_OS_LINUX
+#include <nawa/RequestHandler/impl/EpollHttpRequestHandler.h>
+#endif
 
 using namespace nawa;
 using namespace std;
 
-struct RequestHandler::Data {
-    shared_mutex configurationMutex;
+/**
+ * Everything needed to handle a request. A generation is immutable, reconfiguration creates a new one.
+ */
+struct nawa::RequestHandlerGeneration {
     shared_ptr<HandleRequestFunctionWrapper> handleRequestFunction;
-    shared_ptr<AccessFilterList> accessFilters;
-    shared_ptr<Config> config;
+    shared_ptr<AccessFilterList const> accessFilters;
+    shared_ptr<Config const> config;
+    optional<vector<string>> metricsPath; /**< Path under which the metrics are served, as given in the config. */
+};
+
+namespace {
+    Config::Key const metricsEnabledKey({"metrics", "enabled"});
+    Config::Key const metricsPathKey({"metrics", "path"});
+
+    /**
+     * Serve the metrics in the Prometheus text format.
+     * @param connection The connection.
+     */
+    void serveMetrics(Connection& connection) {
+        connection.setHeader("content-type", "text/plain; version=0.0.4; charset=utf-8");
+        connection.setHeader("cache-control", "no-store");
+        connection.setResponseBody(metrics::prometheusText());
+    }
+}// namespace
+
+struct RequestHandler::Data {
+    /**
+     * The current generation. Reading it does not write to memory shared between threads, so that handling requests
+     * scales with the number of cores.
+     */
+    AtomicSnapshot<RequestHandlerGeneration> generation;
 };
 
 NAWA_DEFAULT_CONSTRUCTOR_IMPL(RequestHandler)
 
 void RequestHandler::setAppRequestHandler(std::shared_ptr<HandleRequestFunctionWrapper> handleRequestFunction) noexcept {
-    unique_lock l(data->configurationMutex);
-    data->handleRequestFunction = std::move(handleRequestFunction);
+    reconfigure(std::move(handleRequestFunction), nullopt, nullopt);
 }
 
 void RequestHandler::setAccessFilters(AccessFilterList accessFilters) noexcept {
-    unique_lock l(data->configurationMutex);
-    data->accessFilters = make_shared<AccessFilterList>(std::move(accessFilters));
+    reconfigure(nullopt, std::move(accessFilters), nullopt);
 }
 
 void RequestHandler::setConfig(Config config) noexcept {
-    unique_lock l(data->configurationMutex);
-    data->config = make_shared<Config>(std::move(config));
+    reconfigure(nullopt, nullopt, std::move(config));
 }
 
 std::shared_ptr<Config const> RequestHandler::getConfig() const noexcept {
-    return data->config;
+    return data->generation.read()->config;
+}
+
+ConfigGuard::ConfigGuard(AtomicSnapshot<RequestHandlerGeneration> const& snapshot) noexcept
+    : generation(snapshot.read()), config(generation->config.get()) {}
+
+ConfigGuard RequestHandler::readConfig() const noexcept {
+    return ConfigGuard(data->generation);
 }
 
 void RequestHandler::reconfigure(std::optional<std::shared_ptr<HandleRequestFunctionWrapper>> handleRequestFunction,
                                  std::optional<AccessFilterList> accessFilters,
                                  std::optional<Config> config) noexcept {
-    unique_lock l(data->configurationMutex);
-    if (handleRequestFunction) {
-        data->handleRequestFunction = *handleRequestFunction;
-    }
+    // compile the filters before creating the new generation, so that reconfiguration is not blocked in the meantime
+    shared_ptr<AccessFilterList> compiledAccessFilters;
     if (accessFilters) {
-        data->accessFilters = make_shared<AccessFilterList>(std::move(*accessFilters));
+        compiledAccessFilters = make_shared<AccessFilterList>(std::move(*accessFilters));
+        compiledAccessFilters->compile();
     }
+    shared_ptr<Config const> newConfig;
+    optional<vector<string>> metricsPath;
     if (config) {
-        data->config = make_shared<Config>(std::move(*config));
+        newConfig = make_shared<Config const>(std::move(*config));
+        metrics::enable(newConfig->getSwitch(metricsEnabledKey) == true);
+        if (!(*newConfig)[metricsPathKey].empty()) {
+            metricsPath = utils::splitPath((*newConfig)[metricsPathKey]);
+        }
     }
+    data->generation.update([&](RequestHandlerGeneration& generation) {
+        if (handleRequestFunction) {
+            generation.handleRequestFunction = std::move(*handleRequestFunction);
+        }
+        if (compiledAccessFilters) {
+            generation.accessFilters = std::move(compiledAccessFilters);
+        }
+        if (newConfig) {
+            generation.config = std::move(newConfig);
+            generation.metricsPath = std::move(metricsPath);
+        }
+    });
 }
 
 void nawa::RequestHandler::reconfigure(HandleRequestFunction handleRequestFunction, std::optional<AccessFilterList> accessFilters,
@@ -83,24 +137,38 @@ void nawa::RequestHandler::reconfigure(HandleRequestFunction handleRequestFuncti
 }
 
 void RequestHandler::handleRequest(Connection& connection) {
-    shared_ptr<HandleRequestFunctionWrapper> handleRequestFunction;
-    shared_ptr<AccessFilterList> accessFilters;
-    shared_ptr<Config> config;
-    {
-        shared_lock l(data->configurationMutex);
-        handleRequestFunction = data->handleRequestFunction;
-        accessFilters = data->accessFilters;
-    }
+    // the generation stays valid until the request has been handled, even if it is replaced in the meantime
+    auto generation = data->generation.read();
+    metrics::count(metrics::Counter::REQUESTS);
+
     // test filters and run app if no filter was triggered
-    if (!accessFilters || !connection.applyFilters(*accessFilters)) {
-        (*handleRequestFunction)(connection);
+    if (generation->accessFilters) {
+        auto filterStart = metrics::startTimer();
+        bool filtered = connection.applyFilters(*generation->accessFilters);
+        metrics::recordSince(metrics::Histogram::FILTER_TIME, filterStart);
+        if (filtered) {
+            metrics::count(metrics::Counter::FILTERED_REQUESTS);
+            return;
+        }
+    }
+    if (generation->metricsPath && connection.request().env().getRequestPath() == *generation->metricsPath) {
+        serveMetrics(connection);
+        return;
     }
+    auto appStart = metrics::startTimer();
+    (*generation->handleRequestFunction)(connection);
+    metrics::recordSince(metrics::Histogram::APP_TIME, appStart);
 }
 
 std::unique_ptr<RequestHandler>
 RequestHandler::newRequestHandler(std::shared_ptr<HandleRequestFunctionWrapper> const& handleRequestFunction,
                                   Config config, int concurrency) {
     if (config[{"system", "request_handler"}] == "http") {
+#ifdef NAWA_OS_LINUX
+        if (config[{"http", "engine"}] != "netlib") {
+            return make_unique<EpollHttpRequestHandler>(handleRequestFunction, std::move(config), concurrency);
+        }
+#endif
         return make_unique<HttpRequestHandler>(handleRequestFunction, std::move(config), concurrency);
     }
     return make_unique<FastcgiRequestHandler>(handleRequestFunction, std::move(config), concurrency);
@@ -0,0 +1,1116 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file EpollHttpRequestHandler.cpp
+ * \brief Implementation of the EpollHttpRequestHandler class.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <nawa/Exception.h>
+#include <nawa/RequestHandler/ConfigGuard.h>
+#include <nawa/RequestHandler/impl/EpollHttpRequestHandler.h>
+#include <nawa/connection/Connection.h>
+#include <nawa/connection/ConnectionInitContainer.h>
+#include <nawa/logging/Log.h>
+#include <nawa/util/MimeMultipart.h>
+#include <nawa/util/metrics.h>
+#include <nawa/util/utils.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    Log logger;
+
+    size_t const MAX_HEADER_SIZE = 64 * 1024;  /**< Maximum size of the request line and headers. */
+    size_t const READ_BUFFER_SIZE = 64 * 1024; /**< Maximum number of bytes received at once. */
+    /**
+     * Unprocessed input of a connection above which no more data is read until the buffered requests have been
+     * handled (so that pipelining clients cannot make the buffer grow without limit).
+     */
+    size_t const MAX_BUFFERED_INPUT = 4 * READ_BUFFER_SIZE;
+    /**
+     * Output of a connection buffered in memory above which no further requests of this connection are read or
+     * handled. Files sent with sendfile() do not count. A response which is being streamed never waits for its
+     * client, its remaining output stays queued and is sent by the event loop.
+     */
+    size_t const OUTPUT_HIGH_WATER_MARK = 1024 * 1024;
+    /**
+     * Number of queued output segments above which the output is backlogged as well, so that pipelined requests for
+     * files cannot make a connection hold an unlimited number of file descriptors.
+     */
+    size_t const MAX_OUTPUT_SEGMENTS = 64;
+    size_t const MAX_COALESCED_SIZE = 64 * 1024; /**< Small outputs are appended to the previous one up to this size. */
+    int const MAX_EVENTS = 256;
+    int const MAX_IOVECS = 16;
+
+    // config keys accessed on every request
+    Config::Key const postRawAccessKey({"post", "raw_access"});
+    Config::Key const postMaxSizeKey({"post", "max_size"});
+    Config::Key const keepaliveTimeoutKey({"http", "keepalive_timeout"});
+
+    /**
+     * Stores the raw post access level, as read from the config file.
+     */
+    enum class RawPostAccess {
+        NEVER,
+        NONSTANDARD,
+        ALWAYS
+    };
+
+    enum class State {
+        RUNNING,
+        STOPPING,
+        TERMINATING
+    };
+
+    /**
+     * Settings and resources shared by all worker threads.
+     */
+    struct Server {
+        RequestHandler* requestHandler = nullptr;
+        int listenFd = -1;
+        int stopFd = -1; /**< Event file descriptor which becomes readable when the state changes. */
+        atomic<State> state{State::RUNNING};
+        string listenAddress;
+        string listenPort;
+    };
+
+    /**
+     * Part of the output of a connection: data in a buffer, or a range of a file which is sent with sendfile().
+     */
+    struct OutputSegment {
+        string data;
+        int fd = -1;      /**< Duplicated file descriptor of the file, -1 if this segment contains data. */
+        off_t offset = 0; /**< Offset of the next byte to be sent (in the data or the file). */
+        size_t size = 0;  /**< Remaining bytes of the file (for data segments, use data.size() - offset). */
+
+        explicit OutputSegment(string data) : data(std::move(data)) {}
+
+        OutputSegment(int fd, size_t size) : fd(fd), size(size) {}
+
+        OutputSegment(OutputSegment&& other) noexcept : data(std::move(other.data)), fd(other.fd),
+                                                        offset(other.offset), size(other.size) {
+            other.fd = -1;
+        }
+
+        OutputSegment& operator=(OutputSegment&& other) noexcept {
+            swap(data, other.data);
+            swap(fd, other.fd);
+            swap(offset, other.offset);
+            swap(size, other.size);
+            return *this;
+        }
+
+        ~OutputSegment() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+
+    /**
+     * Queue of output segments.
+     */
+    struct OutputQueue {
+        deque<OutputSegment> segments;
+        size_t size = 0;       /**< Number of bytes in the queue. */
+        size_t memorySize = 0; /**< Number of bytes in the queue which are buffered in memory (i.e., not files). */
+
+        void append(string_view data) {
+            if (data.empty()) {
+                return;
+            }
+            if (!segments.empty() && segments.back().fd < 0 &&
+                segments.back().data.size() + data.size() <= MAX_COALESCED_SIZE) {
+                segments.back().data.append(data);
+            } else {
+                segments.emplace_back(string(data));
+            }
+            size += data.size();
+            memorySize += data.size();
+        }
+
+        /**
+         * Append the file of a flush. The file descriptor is duplicated, so that the file can be sent after the
+         * flush callback has returned (if that fails, or duplication is not allowed, the file is read into memory).
+         * @param file The file.
+         * @param duplicate Whether the file descriptor may be duplicated.
+         */
+        void append(FlushCallbackContainer::FileBody const& file, bool duplicate) {
+            if (file.size == 0) {
+                return;
+            }
+            int fd = duplicate ? fcntl(file.fd, F_DUPFD_CLOEXEC, 0) : -1;
+            if (fd >= 0) {
+                segments.emplace_back(fd, file.size);
+                size += file.size;
+                return;
+            }
+            FlushCallbackContainer container{};
+            container.file = file;
+            if (!container.forEachFileChunk([this](string_view chunk) { append(chunk); })) {
+                NLOG_ERROR(logger, "Could not read the file to be sent completely")
+            }
+        }
+
+        void append(OutputQueue&& other) {
+            for (auto& segment : other.segments) {
+                segments.push_back(std::move(segment));
+            }
+            size += other.size;
+            memorySize += other.memorySize;
+            other.segments.clear();
+            other.size = 0;
+            other.memorySize = 0;
+        }
+    };
+
+    /**
+     * A parsed request line and header block, waiting for its body.
+     */
+    struct RequestHead {
+        RequestInitContainer requestInit;
+        size_t headerSize = 0;
+        size_t contentLength = 0;
+        bool http10 = false;
+        bool keepAlive = true;
+        bool expectContinue = false;
+        chrono::steady_clock::time_point arrival; /**< Time at which the headers were complete (for metrics). */
+    };
+
+    /**
+     * A client connection. Only accessed by the worker thread which has accepted it.
+     */
+    struct Client {
+        int fd;
+        string remoteAddress;
+        string remotePort;
+        string input;                 /**< Received data which has not been processed yet. */
+        size_t headerScanOffset = 0;  /**< Position up to which the input has been searched for the end of the headers. */
+        unique_ptr<RequestHead> head; /**< Parsed headers of the current request, if its body is still incomplete. */
+        bool continueSent = false;    /**< Whether a 100 Continue response has been sent for the current request. */
+        OutputQueue output;
+        bool readable = true;         /**< Whether the socket might have unread data (edge-triggered). */
+        bool writable = true;         /**< False if the last write has been incomplete, until epoll reports EPOLLOUT. */
+        bool peerClosed = false;      /**< The client will not send anything anymore. */
+        bool closeAfterOutput = false;
+        bool broken = false;          /**< Reading or writing has failed, close as soon as possible. */
+        bool closed = false;
+        chrono::steady_clock::time_point lastActivity = chrono::steady_clock::now();
+
+        explicit Client(int fd) : fd(fd) {}
+
+        Client(Client const&) = delete;
+
+        Client& operator=(Client const&) = delete;
+
+        ~Client() {
+            close(fd);
+        }
+    };
+
+    /**
+     * A response which is being generated. The response is buffered until the request has been handled, so that the
+     * content-length is known. If the app flushes earlier, the rest of the response is sent with chunked transfer
+     * encoding (or, for HTTP/1.0 clients, by closing the connection at the end).
+     */
+    struct Response {
+        bool headRequest = false;
+        bool http10 = false;
+        bool keepAlive = true;
+        bool headersSent = false;
+        bool chunked = false;
+        unsigned int status = 0;
+        string head;         /**< Status line and headers, without framing headers and the empty line. */
+        OutputQueue body;    /**< Body buffered until the request has been handled or the app flushes again. */
+        size_t bodySize = 0; /**< Size of the buffered body (also counted for HEAD requests, without buffering). */
+
+        [[nodiscard]] bool hasBody() const {
+            return !headRequest && status >= 200 && status != 204 && status != 304;
+        }
+    };
+
+    /**
+     * Parse the request line and the header fields. Header names are converted to lowercase and written to the
+     * environment, repeated fields are combined.
+     * @param head The request line and headers, including the terminating empty line.
+     * @param request The request to fill.
+     * @return 0 on success, otherwise the HTTP status of the error response.
+     */
+    unsigned int parseRequestHead(string_view head, RequestHead& request) {
+        auto lineEnd = head.find("\r\n");
+        auto requestLine = head.substr(0, lineEnd);
+        auto methodEnd = requestLine.find(' ');
+        auto targetEnd = requestLine.rfind(' ');
+        if (methodEnd == string_view::npos || methodEnd == 0 || targetEnd <= methodEnd + 1) {
+            return 400;
+        }
+        auto target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        auto version = requestLine.substr(targetEnd + 1);
+        if (target[0] != '/' || version.substr(0, 5) != "HTTP/") {
+            return 400;
+        }
+        if (version == "HTTP/1.0") {
+            request.http10 = true;
+        } else if (version != "HTTP/1.1") {
+            return 505;
+        }
+
+        auto& environment = request.requestInit.environment;
+        environment["REQUEST_METHOD"] = requestLine.substr(0, methodEnd);
+        environment["REQUEST_URI"] = target;
+
+        for (auto pos = lineEnd + 2; pos < head.size();) {
+            auto end = head.find("\r\n", pos);
+            if (end == pos) {
+                break;
+            }
+            auto line = head.substr(pos, end - pos);
+            pos = end + 2;
+            auto colon = line.find(':');
+            // whitespace between the field name and the colon is not allowed (RFC 7230, section 3.2.4)
+            if (colon == string_view::npos || colon == 0 || line[colon - 1] == ' ' || line[colon - 1] == '\t') {
+                return 400;
+            }
+            auto value = line.substr(colon + 1);
+            auto valueStart = value.find_first_not_of(" \t");
+            value = valueStart == string_view::npos
+                            ? string_view()
+                            : value.substr(valueStart, value.find_last_not_of(" \t") - valueStart + 1);
+            auto [it, inserted] = environment.try_emplace(utils::toLowercase(string(line.substr(0, colon))), value);
+            if (!inserted) {
+                it->second.append(it->first == "cookie" ? "; " : ", ").append(value);
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Fill the POST variables, files, and raw POST data from the request body.
+     * @param requestInit The request.
+     * @param postBody The request body.
+     * @param rawPostAccess Raw POST access level.
+     */
+    void processPostBody(RequestInitContainer& requestInit, string postBody, RawPostAccess rawPostAccess) {
+        string const multipartContentType = "multipart/form-data";
+        string const plainTextContentType = "text/plain";
+        auto postContentType = utils::toLowercase(requestInit.environment["content-type"]);
+
+        if (rawPostAccess == RawPostAccess::ALWAYS) {
+            requestInit.rawPost = make_shared<string>(postBody);
+        }
+
+        if (postContentType == "application/x-www-form-urlencoded") {
+            requestInit.postContentType = postContentType;
+            requestInit.postVars = utils::splitQueryString(postBody);
+        } else if (postContentType.substr(0, multipartContentType.length()) == multipartContentType) {
+            try {
+                MimeMultipart postData(requestInit.environment["content-type"], std::move(postBody));
+                for (auto const& p : postData.parts()) {
+                    // find out whether the part is a file
+                    if (!p.filename().empty() || (!p.contentType().empty() &&
+                                                  p.contentType().substr(0, plainTextContentType.length()) !=
+                                                          plainTextContentType)) {
+                        File pf = File(p.content()).contentType(p.contentType()).filename(p.filename());
+                        requestInit.postFiles.insert({p.partName(), std::move(pf)});
+                    } else {
+                        requestInit.postVars.insert({p.partName(), p.content()});
+                    }
+                }
+            } catch (Exception const&) {}
+        } else if (rawPostAccess == RawPostAccess::NONSTANDARD) {
+            requestInit.rawPost = make_shared<string>(std::move(postBody));
+        }
+    }
+
+    /**
+     * Event loop of a worker thread. Every worker has its own epoll instance and serves the connections it has
+     * accepted, including the request handling.
+     */
+    class Worker {
+        Server& server;
+        int epollFd = -1;
+        unordered_map<Client*, unique_ptr<Client>> clients;
+        vector<Client*> closedClients; /**< Clients closed during the current iteration, deleted afterwards. */
+        vector<char> readBuffer = vector<char>(READ_BUFFER_SIZE);
+        chrono::seconds keepaliveTimeout{60}; /**< From the config, read once per loop iteration by readConfig(). */
+        unsigned long maxPostSize = 0;        /**< From the config (in bytes), read once per loop iteration. */
+
+        /**
+         * Read the config values needed by the event loop itself, so that they do not have to be looked up for
+         * every request.
+         */
+        void readConfig() {
+            auto configGuard = server.requestHandler->readConfig();
+            keepaliveTimeout = chrono::seconds(configGuard->getNumber(keepaliveTimeoutKey).value_or(60));
+            maxPostSize = configGuard->getNumber(postMaxSizeKey).value_or(0) * 1024;
+        }
+
+        void closeClient(Client& client) {
+            if (!client.closed) {
+                client.closed = true;
+                closedClients.push_back(&client);
+            }
+        }
+
+        /**
+         * Check whether the output of a client is backlogged, so that no further requests should be handled for now.
+         */
+        static bool isBacklogged(Client const& client) {
+            return client.output.memorySize >= OUTPUT_HIGH_WATER_MARK ||
+                   client.output.segments.size() >= MAX_OUTPUT_SEGMENTS;
+        }
+
+        /**
+         * Update the state of a client according to an epoll event.
+         * @return The client, or nullptr if the event does not belong to an open client connection.
+         */
+        Client* clientForEvent(epoll_event const& event) {
+            auto ptr = event.data.ptr;
+            if (ptr == &server.listenFd || ptr == &server.stopFd) {
+                return nullptr;
+            }
+            auto client = static_cast<Client*>(ptr);
+            if (client->closed) {
+                return nullptr;
+            }
+            if (event.events & EPOLLERR) {
+                client->broken = true;
+                closeClient(*client);
+                return nullptr;
+            }
+            if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                client->readable = true;
+            }
+            if (event.events & EPOLLOUT) {
+                client->writable = true;
+            }
+            return client;
+        }
+
+        void removeClosedClients() {
+            for (auto client : closedClients) {
+                clients.erase(client);
+            }
+            closedClients.clear();
+        }
+
+        void acceptClients() {
+            while (true) {
+                sockaddr_storage address{};
+                socklen_t addressLength = sizeof address;
+                int fd = accept4(server.listenFd, reinterpret_cast<sockaddr*>(&address), &addressLength,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        NLOG_ERROR(logger, "Could not accept connection: " << strerror(errno))
+                    }
+                    return;
+                }
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+                auto client = make_unique<Client>(fd);
+                char host[NI_MAXHOST];
+                char port[NI_MAXSERV];
+                if (getnameinfo(reinterpret_cast<sockaddr*>(&address), addressLength, host, sizeof host, port,
+                                sizeof port, NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+                    client->remoteAddress = host;
+                    client->remotePort = port;
+                }
+
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = client.get();
+                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0) {
+                    auto clientPtr = client.get();
+                    clients.emplace(clientPtr, std::move(client));
+                }
+            }
+        }
+
+        /**
+         * Read from the socket until it would block, the peer has closed the connection, or enough input is buffered.
+         * @return True if anything has happened.
+         */
+        bool readInput(Client& client) {
+            // the body of the current request has to be buffered completely (its size is limited by post/max_size)
+            auto limit = MAX_BUFFERED_INPUT;
+            if (client.head) {
+                limit = max(limit, client.head->headerSize + client.head->contentLength);
+            }
+            bool progress = false;
+            while (client.input.size() < limit) {
+                auto received = recv(client.fd, readBuffer.data(), readBuffer.size(), 0);
+                if (received > 0) {
+                    client.input.append(readBuffer.data(), received);
+                    progress = true;
+                    // a short read means that the socket has been drained, further data will trigger a new event
+                    if (static_cast<size_t>(received) < readBuffer.size()) {
+                        client.readable = false;
+                        break;
+                    }
+                    continue;
+                }
+                if (received < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (received == 0) {
+                    client.peerClosed = true;
+                    progress = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    client.broken = true;
+                }
+                client.readable = false;
+                break;
+            }
+            if (progress) {
+                client.lastActivity = chrono::steady_clock::now();
+            }
+            return progress;
+        }
+
+        /**
+         * Send as much of the queued output as possible without blocking.
+         * @return False if the connection is broken.
+         */
+        bool writeOutput(Client& client) {
+            auto& segments = client.output.segments;
+            while (!segments.empty() && client.writable) {
+                ssize_t written;
+                if (segments.front().fd < 0) {
+                    // send consecutive data segments at once
+                    iovec iov[MAX_IOVECS];
+                    int count = 0;
+                    for (auto it = segments.begin(); it != segments.end() && it->fd < 0 && count < MAX_IOVECS; ++it) {
+                        iov[count++] = {it->data.data() + it->offset, it->data.size() - it->offset};
+                    }
+                    msghdr message{};
+                    message.msg_iov = iov;
+                    message.msg_iovlen = count;
+                    written = sendmsg(client.fd, &message, MSG_NOSIGNAL);
+                } else {
+                    auto& segment = segments.front();
+                    written = sendfile(client.fd, segment.fd, &segment.offset, segment.size);
+                    if (written == 0) {
+                        // the file has been truncated, the response cannot be completed anymore
+                        client.broken = true;
+                        return false;
+                    }
+                }
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        client.writable = false;
+                        break;
+                    }
+                    client.broken = true;
+                    return false;
+                }
+
+                client.output.size -= written;
+                client.lastActivity = chrono::steady_clock::now();
+                auto remaining = static_cast<size_t>(written);
+                while (!segments.empty() && (remaining > 0 || segments.front().size == 0)) {
+                    auto& segment = segments.front();
+                    if (segment.fd >= 0) {
+                        // sendfile has already advanced the offset
+                        segment.size -= remaining;
+                        remaining = 0;
+                        if (segment.size > 0) {
+                            break;
+                        }
+                    } else {
+                        auto segmentRemaining = segment.data.size() - segment.offset;
+                        if (remaining < segmentRemaining) {
+                            segment.offset += static_cast<off_t>(remaining);
+                            client.output.memorySize -= remaining;
+                            break;
+                        }
+                        remaining -= segmentRemaining;
+                        client.output.memorySize -= segmentRemaining;
+                    }
+                    segments.pop_front();
+                }
+            }
+            return true;
+        }
+
+        void queue(Client& client, string_view data) {
+            if (!client.broken) {
+                client.output.append(data);
+            }
+        }
+
+        /**
+         * Queue a complete error response and close the connection afterwards.
+         */
+        void sendError(Client& client, unsigned int status) {
+            FlushCallbackContainer statusContainer{};
+            statusContainer.status = status;
+            auto body = utils::generateErrorPage(status);
+            queue(client, "HTTP/1.1 " + statusContainer.getStatusString() +
+                                  "\r\ncontent-type: text/html; charset=utf-8\r\ncontent-length: " +
+                                  to_string(body.size()) + "\r\ndate: " + utils::currentHttpTime() +
+                                  "\r\nconnection: close\r\n\r\n" + body);
+            client.closeAfterOutput = true;
+        }
+
+        /**
+         * Queue the status line and headers of a response, followed by the buffered body.
+         * @param streaming Whether the app will flush more data, so that the length of the body is not known yet.
+         */
+        void sendHead(Client& client, Response& response, bool streaming) {
+            auto head = std::move(response.head);
+            if (!streaming) {
+                if (response.status >= 200 && response.status != 204 && response.status != 304) {
+                    head.append("content-length: ").append(to_string(response.bodySize)).append("\r\n");
+                }
+            } else if (response.hasBody()) {
+                // HTTP/1.0 does not know chunked encoding, the end of the body is marked by closing the connection
+                if (response.http10) {
+                    response.keepAlive = false;
+                } else {
+                    response.chunked = true;
+                    head.append("transfer-encoding: chunked\r\n");
+                }
+            }
+            if (!response.keepAlive) {
+                head.append("connection: close\r\n");
+            } else if (response.http10) {
+                head.append("connection: keep-alive\r\n");
+            }
+            head.append("\r\n");
+            queue(client, head);
+            response.headersSent = true;
+
+            if (response.body.size > 0) {
+                sendBody(client, response, std::move(response.body));
+            }
+            response.bodySize = 0;
+        }
+
+        void sendBody(Client& client, Response& response, OutputQueue&& body) {
+            if (response.chunked) {
+                char chunkHeader[24];
+                queue(client, string_view(chunkHeader, snprintf(chunkHeader, sizeof chunkHeader, "%zx\r\n",
+                                                                body.size)));
+            }
+            if (!client.broken) {
+                client.output.append(std::move(body));
+            }
+            if (response.chunked) {
+                queue(client, "\r\n");
+            }
+        }
+
+        void flush(Client& client, Response& response, FlushCallbackContainer const& flushInfo) {
+            if (!flushInfo.flushedBefore) {
+                response.status = flushInfo.status;
+                response.head = "HTTP/1.1 " + flushInfo.getStatusString() + "\r\n";
+                bool hasDate = false;
+                for (auto const& [key, value] : flushInfo.headers) {
+                    // the framing of the response is up to the server
+                    if (key == "content-length" || key == "transfer-encoding") {
+                        continue;
+                    }
+                    if (key == "connection") {
+                        if (utils::toLowercase(value) == "close") {
+                            response.keepAlive = false;
+                        }
+                        continue;
+                    }
+                    hasDate = hasDate || key == "date";
+                    response.head.append(key).append(": ").append(value).append("\r\n");
+                }
+                // as there is no web server in front of nawa, the date header has to be added here
+                if (!hasDate) {
+                    response.head.append("date: ").append(utils::currentHttpTime()).append("\r\n");
+                }
+            } else if (!response.headersSent) {
+                // the app flushes again before the request has been handled, so the response has to be streamed
+                sendHead(client, response, true);
+            }
+
+            OutputQueue body;
+            if (response.hasBody()) {
+                body.append(flushInfo.body);
+                if (flushInfo.file) {
+                    // a streaming response must not make the connection hold an unlimited number of files
+                    body.append(*flushInfo.file, client.output.segments.size() + response.body.segments.size() <
+                                                         MAX_OUTPUT_SEGMENTS);
+                }
+            }
+            if (!response.headersSent) {
+                response.bodySize += flushInfo.body.size() + (flushInfo.file ? flushInfo.file->size : 0);
+                response.body.append(std::move(body));
+                return;
+            }
+            if (body.size > 0) {
+                // send as much as possible right away, the rest is sent by the event loop after the request
+                sendBody(client, response, std::move(body));
+                writeOutput(client);
+            }
+        }
+
+        void handleRequest(Client& client, RequestHead& request, string body) {
+            auto configGuard = server.requestHandler->readConfig();
+            auto& requestInit = request.requestInit;
+            auto& environment = requestInit.environment;
+            environment["REMOTE_ADDR"] = client.remoteAddress;
+            environment["REMOTE_PORT"] = client.remotePort;
+            environment["SERVER_ADDR"] = server.listenAddress;
+            environment["SERVER_PORT"] = server.listenPort;
+            environment["SERVER_SOFTWARE"] = "NAWA Development Web Server";
+
+            {
+                // the base URL is the URL without the request URI, e.g., https://www.example.com
+                auto const& requestUri = environment["REQUEST_URI"];
+                auto host = environment.find("host");
+                auto baseUrl = "http://" + (host != environment.end()
+                                                    ? host->second
+                                                    : server.listenAddress + ":" + server.listenPort);
+                auto queryStart = requestUri.find_first_of('?');
+                environment["FULL_URL_WITH_QS"] = baseUrl + requestUri;
+                environment["FULL_URL_WITHOUT_QS"] = baseUrl + requestUri.substr(0, queryStart);
+                if (queryStart != string::npos) {
+                    requestInit.getVars = utils::splitQueryString(requestUri);
+                }
+                environment["BASE_URL"] = std::move(baseUrl);
+            }
+            auto cookies = environment.find("cookie");
+            if (cookies != environment.end()) {
+                requestInit.cookieVars = utils::parseCookies(cookies->second);
+            }
+
+            Response response;
+            response.headRequest = environment["REQUEST_METHOD"] == "HEAD";
+            response.http10 = request.http10;
+            response.keepAlive = request.keepAlive && server.state.load(memory_order_relaxed) == State::RUNNING;
+
+            if (environment["REQUEST_METHOD"] == "POST" && !body.empty()) {
+                auto const& rawPostStr = (*configGuard)[postRawAccessKey];
+                processPostBody(requestInit, std::move(body),
+                                (rawPostStr == "never")
+                                        ? RawPostAccess::NEVER
+                                        : ((rawPostStr == "always") ? RawPostAccess::ALWAYS
+                                                                    : RawPostAccess::NONSTANDARD));
+            }
+
+            ConnectionInitContainer connectionInit;
+            connectionInit.requestInit = std::move(requestInit);
+            // the guard keeps the config valid until the connection has been destroyed, so that it need not be copied
+            connectionInit.sharedConfig = &*configGuard;
+            connectionInit.flushCallback = [this, &client, &response](FlushCallbackContainer const& flushInfo) {
+                flush(client, response, flushInfo);
+            };
+
+            try {
+                Connection connection(std::move(connectionInit));
+                metrics::recordSince(metrics::Histogram::QUEUE_WAIT, request.arrival);
+                server.requestHandler->handleRequest(connection);
+                connection.flushResponse();
+            } catch (exception const& e) {
+                NLOG_ERROR(logger, "Request handling failed: " << e.what())
+                if (!response.headersSent) {
+                    sendError(client, 500);
+                } else {
+                    client.broken = true;
+                }
+                return;
+            }
+
+            if (!response.headersSent) {
+                sendHead(client, response, false);
+            } else if (response.chunked) {
+                queue(client, "0\r\n\r\n");
+            }
+            if (!response.keepAlive) {
+                client.closeAfterOutput = true;
+            }
+        }
+
+        /**
+         * Check the framing headers of a request which has been parsed.
+         * @return 0 if the request is acceptable, otherwise the HTTP status of the error response.
+         */
+        unsigned int checkRequest(RequestHead& request) {
+            auto const& environment = request.requestInit.environment;
+            // request bodies are only accepted with a content-length
+            if (environment.count("transfer-encoding")) {
+                return 501;
+            }
+            auto contentLength = environment.find("content-length");
+            if (contentLength != environment.end()) {
+                auto const& value = contentLength->second;
+                if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != string::npos) {
+                    return 400;
+                }
+                request.contentLength = stoull(value);
+                if (request.contentLength > maxPostSize) {
+                    return 413;
+                }
+            }
+            auto connection = environment.find("connection");
+            auto connectionValue = connection != environment.end() ? utils::toLowercase(connection->second) : string();
+            request.keepAlive = request.http10 ? connectionValue.find("keep-alive") != string::npos
+                                               : connectionValue.find("close") == string::npos;
+            auto expect = environment.find("expect");
+            request.expectContinue = !request.http10 && expect != environment.end() &&
+                                     utils::toLowercase(expect->second) == "100-continue";
+            return 0;
+        }
+
+        /**
+         * Handle the complete requests in the input buffer, in order.
+         * @return True if anything has happened.
+         */
+        bool processInput(Client& client) {
+            bool progress = false;
+            while (!client.closeAfterOutput && !client.broken && !isBacklogged(client)) {
+                if (!client.head) {
+                    // only search the new part of the input for the end of the headers
+                    auto headerEnd = client.input.find("\r\n\r\n", client.headerScanOffset);
+                    if (headerEnd == string::npos) {
+                        if (client.input.size() > MAX_HEADER_SIZE) {
+                            sendError(client, 431);
+                            progress = true;
+                        } else {
+                            client.headerScanOffset = client.input.size() > 3 ? client.input.size() - 3 : 0;
+                        }
+                        break;
+                    }
+                    client.headerScanOffset = 0;
+                    auto request = make_unique<RequestHead>();
+                    request->headerSize = headerEnd + 4;
+                    request->arrival = metrics::startTimer();
+                    auto status = request->headerSize > MAX_HEADER_SIZE
+                                          ? 431
+                                          : parseRequestHead(string_view(client.input).substr(0, request->headerSize),
+                                                             *request);
+                    if (status == 0) {
+                        status = checkRequest(*request);
+                    }
+                    progress = true;
+                    if (status != 0) {
+                        sendError(client, status);
+                        break;
+                    }
+                    client.head = std::move(request);
+                }
+
+                auto& request = *client.head;
+                if (client.input.size() < request.headerSize + request.contentLength) {
+                    if (request.expectContinue && !client.continueSent) {
+                        queue(client, "HTTP/1.1 100 Continue\r\n\r\n");
+                        client.continueSent = true;
+                        progress = true;
+                    }
+                    break;
+                }
+                auto body = client.input.substr(request.headerSize, request.contentLength);
+                client.input.erase(0, request.headerSize + request.contentLength);
+                auto head = std::move(client.head);
+                client.continueSent = false;
+                handleRequest(client, *head, std::move(body));
+                progress = true;
+            }
+            return progress;
+        }
+
+        /**
+         * Read, handle requests, and write, as long as anything happens.
+         */
+        void serviceClient(Client& client) {
+            while (!client.broken) {
+                bool progress = false;
+                if (client.readable && !client.peerClosed && !isBacklogged(client)) {
+                    progress = readInput(client);
+                }
+                progress = processInput(client) || progress;
+                auto outputBefore = client.output.size;
+                if (!writeOutput(client)) {
+                    break;
+                }
+                // reading and request handling are paused above the high-water mark, so sending output counts as
+                // progress if there is more to do (there will be no further event if all output has been sent)
+                if (!progress &&
+                    (client.output.size == outputBefore || (client.input.empty() && !client.readable))) {
+                    break;
+                }
+            }
+            if (client.broken || (client.output.size == 0 && (client.closeAfterOutput || client.peerClosed))) {
+                closeClient(client);
+            }
+        }
+
+        void closeIdleClients() {
+            auto deadline = chrono::steady_clock::now() - keepaliveTimeout;
+            for (auto& [clientPtr, client] : clients) {
+                if (client->lastActivity < deadline) {
+                    closeClient(*client);
+                }
+            }
+            removeClosedClients();
+        }
+
+    public:
+        explicit Worker(Server& server) : server(server) {}
+
+        Worker(Worker const&) = delete;
+
+        Worker& operator=(Worker const&) = delete;
+
+        ~Worker() {
+            clients.clear();
+            if (epollFd >= 0) {
+                close(epollFd);
+            }
+        }
+
+        void run() {
+            // a client closing its connection must not kill the process (sendfile has no MSG_NOSIGNAL)
+            sigset_t sigpipe;
+            sigemptyset(&sigpipe);
+            sigaddset(&sigpipe, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+            epollFd = epoll_create1(EPOLL_CLOEXEC);
+            epoll_event event{};
+            // only one of the waiting workers is woken up for new connections
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+            event.data.ptr = &server.listenFd;
+            bool listening = epollFd >= 0 && epoll_ctl(epollFd, EPOLL_CTL_ADD, server.listenFd, &event) == 0;
+            event.events = EPOLLIN;
+            event.data.ptr = &server.stopFd;
+            if (!listening || epoll_ctl(epollFd, EPOLL_CTL_ADD, server.stopFd, &event) != 0) {
+                NLOG_ERROR(logger, "Could not set up the event loop: " << strerror(errno))
+                return;
+            }
+
+            epoll_event events[MAX_EVENTS];
+            auto nextTimeoutCheck = chrono::steady_clock::now() + chrono::seconds(1);
+            while (true) {
+                auto state = server.state.load(memory_order_acquire);
+                if (state == State::TERMINATING) {
+                    break;
+                }
+                if (state == State::STOPPING) {
+                    if (listening) {
+                        // stop accepting connections, remove the stop event (it stays readable)
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, server.listenFd, nullptr);
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, server.stopFd, nullptr);
+                        listening = false;
+                    }
+                    // finish requests in progress, close idle connections
+                    for (auto& [clientPtr, client] : clients) {
+                        if (client->output.size == 0 && client->input.empty()) {
+                            closeClient(*client);
+                        }
+                    }
+                    removeClosedClients();
+                    if (clients.empty()) {
+                        break;
+                    }
+                }
+
+                auto count = epoll_wait(epollFd, events, MAX_EVENTS, 1000);
+                if (count < 0 && errno != EINTR) {
+                    NLOG_ERROR(logger, "Event loop failed: " << strerror(errno))
+                    break;
+                }
+                readConfig();
+                for (int i = 0; i < count; ++i) {
+                    auto ptr = events[i].data.ptr;
+                    if (ptr == &server.listenFd) {
+                        if (listening) {
+                            acceptClients();
+                        }
+                        continue;
+                    }
+                    if (auto client = clientForEvent(events[i])) {
+                        serviceClient(*client);
+                    }
+                }
+                removeClosedClients();
+
+                auto now = chrono::steady_clock::now();
+                if (now >= nextTimeoutCheck) {
+                    closeIdleClients();
+                    nextTimeoutCheck = now + chrono::seconds(1);
+                }
+            }
+        }
+    };
+}// namespace
+
+struct EpollHttpRequestHandler::Data {
+    Server server;
+    int concurrency = 1;
+    vector<thread> threadPool;
+    bool requestHandlingActive = false;
+    bool joined = false;
+
+    /**
+     * Change the state and wake up all workers.
+     */
+    void setState(State state) {
+        server.state.store(state, memory_order_release);
+        uint64_t one = 1;
+        if (write(server.stopFd, &one, sizeof one) < 0) {
+            NLOG_ERROR(logger, "Could not notify the worker threads: " << strerror(errno))
+        }
+    }
+};
+
+EpollHttpRequestHandler::EpollHttpRequestHandler(std::shared_ptr<HandleRequestFunctionWrapper> handleRequestFunction,
+                                                 Config config, int concurrency) {
+    data = make_unique<Data>();
+
+    setAppRequestHandler(std::move(handleRequestFunction));
+    setConfig(std::move(config));
+    auto configGuard = readConfig();
+
+    logger.setAppname("EpollHttpRequestHandler");
+
+    // set options from config
+    auto& server = data->server;
+    server.requestHandler = this;
+    server.listenAddress = (*configGuard)[{"http", "listen"}].empty() ? "127.0.0.1" : (*configGuard)[{"http", "listen"}];
+    server.listenPort = (*configGuard)[{"http", "port"}].empty() ? "8080" : (*configGuard)[{"http", "port"}];
+    bool reuseAddr = (*configGuard)[{"http", "reuseaddr"}] != "off";
+    if (concurrency > 0) {
+        data->concurrency = concurrency;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    addrinfo* addresses;
+    auto error = getaddrinfo(server.listenAddress.c_str(), server.listenPort.c_str(), &hints, &addresses);
+    if (error != 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not listen to host/port.", gai_strerror(error));
+    }
+    string errorMessage;
+    for (auto address = addresses; address && server.listenFd < 0; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        address->ai_protocol);
+        if (fd < 0) {
+            errorMessage = strerror(errno);
+            continue;
+        }
+        int one = 1;
+        if ((reuseAddr && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) != 0) ||
+            bind(fd, address->ai_addr, address->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0) {
+            errorMessage = strerror(errno);
+            close(fd);
+            continue;
+        }
+        server.listenFd = fd;
+    }
+    freeaddrinfo(addresses);
+    if (server.listenFd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not listen to host/port.", errorMessage);
+    }
+
+    server.stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server.stopFd < 0) {
+        close(server.listenFd);
+        throw Exception(__PRETTY_FUNCTION__, 2, "Could not create event file descriptor.", strerror(errno));
+    }
+}
+
+EpollHttpRequestHandler::~EpollHttpRequestHandler() {
+    if (!data->joined) {
+        terminate();
+        join();
+    }
+    close(data->server.listenFd);
+    close(data->server.stopFd);
+}
+
+void EpollHttpRequestHandler::start() {
+    if (data->requestHandlingActive) {
+        return;
+    }
+    if (data->joined) {
+        throw Exception(__PRETTY_FUNCTION__, 10, "EpollHttpRequestHandler was already joined.");
+    }
+    try {
+        for (int i = 0; i < data->concurrency; ++i) {
+            data->threadPool.emplace_back([this] {
+                make_unique<Worker>(data->server)->run();
+            });
+        }
+        data->requestHandlingActive = true;
+    } catch (exception const& e) {
+        throw Exception(__PRETTY_FUNCTION__, 1,
+                        string("An error occurred during start of request handling."),
+                        e.what());
+    }
+}
+
+void EpollHttpRequestHandler::stop() noexcept {
+    if (data->joined) {
+        return;
+    }
+    auto expected = State::RUNNING;
+    if (data->server.state.compare_exchange_strong(expected, State::STOPPING)) {
+        data->setState(State::STOPPING);
+    }
+}
+
+void EpollHttpRequestHandler::terminate() noexcept {
+    if (data->joined) {
+        return;
+    }
+    data->setState(State::TERMINATING);
+}
+
+void EpollHttpRequestHandler::join() noexcept {
+    if (data->joined) {
+        return;
+    }
+    for (auto& t : data->threadPool) {
+        t.join();
+    }
+    data->joined = true;
+    data->threadPool.clear();
+}
@@ -25,11 +25,13 @@
 #include <fastcgi++/manager.hpp>
 #include <fastcgi++/request.hpp>
 #include <nawa/Exception.h>
+#include <nawa/RequestHandler/ConfigGuard.h>
 #include <nawa/RequestHandler/RequestHandler.h>
 #include <nawa/RequestHandler/impl/FastcgiRequestHandler.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/connection/ConnectionInitContainer.h>
 #include <nawa/logging/Log.h>
+#include <nawa/util/metrics.h>
 #include <nawa/util/utils.h>
 
 using namespace nawa;
@@ -38,6 +40,8 @@ using namespace std;
 namespace {
     Log logger("fastcgi");
 
+    Config::Key const postRawAccessKey({"post", "raw_access"}); /**< Accessed on every POST request. */
+
     /**
      * Stores the raw post access level, as read from the config file.
      */
@@ -49,13 +53,14 @@ namespace {
 
     class FastcgippRequestAdapter : public Fastcgipp::Request<char> {
         shared_ptr<string> rawPost;
+        chrono::steady_clock::time_point arrival; /**< Arrival of the request (for metrics). */
 
     public:
         /**
          * Request handling happens through a child class of Fastcgipp::Request. All necessary objects from outside that
          * we need are induced by the fastcgipp-lite manager (which has been modified to achieve that).
          */
-        FastcgippRequestAdapter() : Fastcgipp::Request<char>() {}
+        FastcgippRequestAdapter() : Fastcgipp::Request<char>(), arrival(metrics::startTimer()) {}
 
         /**
          * The response function is responsible for handling the request in fastcgipp-lite.
@@ -134,18 +139,27 @@ bool FastcgippRequestAdapter::response() {
 
     ConnectionInitContainer connectionInit;
     connectionInit.requestInit = std::move(requestInit);
-    connectionInit.config = *requestHandler->getConfig();
+    // the guard keeps the config valid until the connection has been destroyed, so that it need not be copied
+    auto configGuard = requestHandler->readConfig();
+    connectionInit.sharedConfig = &*configGuard;
 
-    connectionInit.flushCallback = [this](FlushCallbackContainer flushInfo) {
-        string response;
+    connectionInit.flushCallback = [this](FlushCallbackContainer const& flushInfo) {
+        // headers and body are dumped separately, so that the body does not need to be copied
         if (!flushInfo.flushedBefore) {
-            response = "status: " + flushInfo.getStatusString() + "\r\n";
+            auto headers = "status: " + flushInfo.getStatusString() + "\r\n" + flushInfo.getHeaderString();
+            dump(headers.c_str(), headers.size());
+        }
+        if (!flushInfo.body.empty()) {
+            dump(flushInfo.body.data(), flushInfo.body.size());
+        }
+        // files are streamed in fixed-size chunks, so that they never need to be loaded completely
+        if (!flushInfo.forEachFileChunk([this](string_view chunk) { dump(chunk.data(), chunk.size()); })) {
+            NLOG_ERROR(logger, "Could not read the file to be sent completely")
         }
-        response += flushInfo.getFullHttp();
-        dump(response.c_str(), response.size());
     };
 
-    Connection connection(connectionInit);
+    Connection connection(std::move(connectionInit));
+    metrics::recordSince(metrics::Histogram::QUEUE_WAIT, arrival);
     requestHandler->handleRequest(connection);
     connection.flushResponse();
 
@@ -155,9 +169,9 @@ bool FastcgippRequestAdapter::response() {
 bool FastcgippRequestAdapter::inProcessor() {
     auto requestHandler = any_cast<RequestHandler*>(m_externalObject);
     auto postContentType = environment().contentType;
-    auto configPtr = requestHandler->getConfig();
+    auto configGuard = requestHandler->readConfig();
 
-    string rawPostAccess = (*configPtr)[{"post", "raw_access"}];
+    auto const& rawPostAccess = (*configGuard)[postRawAccessKey];
     if (postContentType.empty() || rawPostAccess == "never" ||
         (rawPostAccess != "always" && (postContentType == "multipart/form-data" || postContentType == "application/x-www-form-urlencoded"))) {
         return false;
@@ -180,12 +194,12 @@ FastcgiRequestHandler::FastcgiRequestHandler(std::shared_ptr<HandleRequestFuncti
 
     setAppRequestHandler(std::move(handleRequestFunction));
     setConfig(std::move(config));
-    auto configPtr = getConfig();
+    auto configGuard = readConfig();
 
     size_t postMax = 0;
     try {
-        postMax = configPtr->isSet({"post", "max_size"})
-                          ? static_cast<size_t>(stoul((*configPtr)[{"post", "max_size"}])) * 1024
+        postMax = configGuard->isSet({"post", "max_size"})
+                          ? static_cast<size_t>(stoul((*configGuard)[{"post", "max_size"}])) * 1024
                           : 0;
     } catch (invalid_argument& e) {
         NLOG_WARNING(logger, "WARNING: Invalid value given for post/max_size given in the config file.")
@@ -220,10 +234,10 @@ FastcgiRequestHandler::FastcgiRequestHandler(std::shared_ptr<HandleRequestFuncti
                                                                                       static_cast<RequestHandler*>(this));
 
     // socket handling
-    string mode = (*configPtr)[{"fastcgi", "mode"}];
+    string mode = (*configGuard)[{"fastcgi", "mode"}];
     if (mode == "tcp") {
-        auto fastcgiListen = (*configPtr)[{"fastcgi", "listen"}];
-        auto fastcgiPort = (*configPtr)[{"fastcgi", "port"}];
+        auto fastcgiListen = (*configGuard)[{"fastcgi", "listen"}];
+        auto fastcgiPort = (*configGuard)[{"fastcgi", "port"}];
         if (fastcgiListen.empty())
             fastcgiListen = "127.0.0.1";
         char const* fastcgiListenC = fastcgiListen.c_str();
@@ -237,7 +251,7 @@ FastcgiRequestHandler::FastcgiRequestHandler(std::shared_ptr<HandleRequestFuncti
         }
     } else if (mode == "unix") {
         uint32_t permissions = 0xffffffffUL;
-        string permStr = (*configPtr)[{"fastcgi", "permissions"}];
+        string permStr = (*configGuard)[{"fastcgi", "permissions"}];
         // convert the value from the config file
         if (!permStr.empty()) {
             char const* psptr = permStr.c_str();
@@ -248,12 +262,12 @@ FastcgiRequestHandler::FastcgiRequestHandler(std::shared_ptr<HandleRequestFuncti
             }
         }
 
-        auto fastcgiSocketPath = (*configPtr)[{"fastcgi", "path"}];
+        auto fastcgiSocketPath = (*configGuard)[{"fastcgi", "path"}];
         if (fastcgiSocketPath.empty()) {
             fastcgiSocketPath = "/etc/nawarun/sock.d/nawarun.sock";
         }
-        auto fastcgiOwner = (*configPtr)[{"fastcgi", "owner"}];
-        auto fastcgiGroup = (*configPtr)[{"fastcgi", "group"}];
+        auto fastcgiOwner = (*configGuard)[{"fastcgi", "owner"}];
+        auto fastcgiGroup = (*configGuard)[{"fastcgi", "group"}];
 
         if (!data->fastcgippManager->listen(fastcgiSocketPath.c_str(), permissions,
                                             fastcgiOwner.empty() ? nullptr : fastcgiOwner.c_str(),
@@ -267,7 +281,7 @@ FastcgiRequestHandler::FastcgiRequestHandler(std::shared_ptr<HandleRequestFuncti
     }
 
     // tell fastcgi to use SO_REUSEADDR if enabled in config
-    if ((*configPtr)[{"fastcgi", "reuseaddr"}] != "off") {
+    if ((*configGuard)[{"fastcgi", "reuseaddr"}] != "off") {
         data->fastcgippManager->reuseAddress(true);
     }
 }
@@ -22,14 +22,20 @@
  */
 
 #include <boost/network/protocol/http/server.hpp>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
 #include <nawa/Exception.h>
+#include <nawa/RequestHandler/ConfigGuard.h>
 #include <nawa/RequestHandler/RequestHandler.h>
 #include <nawa/RequestHandler/impl/HttpRequestHandler.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/connection/ConnectionInitContainer.h>
 #include <nawa/logging/Log.h>
 #include <nawa/util/MimeMultipart.h>
+#include <nawa/util/metrics.h>
 #include <nawa/util/utils.h>
+#include <unistd.h>
 
 using namespace nawa;
 using namespace std;
@@ -40,6 +46,15 @@ using HttpServer = http::server<HttpHandler>;
 namespace {
     Log logger;
 
+    /**
+     * Maximum number of bytes of a file body which are passed to the connection in one write.
+     */
+    size_t const HTTP_FILE_SLICE_SIZE = 1024 * 1024;
+
+    // config keys accessed on every POST request
+    Config::Key const postRawAccessKey({"post", "raw_access"});
+    Config::Key const postMaxSizeKey({"post", "max_size"});
+
     /**
      * Stores the raw post access level, as read from the config file.
      */
@@ -55,12 +70,151 @@ namespace {
         httpConn->write(utils::generateErrorPage(500));
     };
 
-    inline string getListenAddr(shared_ptr<Config const> const& configPtr) {
-        return (*configPtr)[{"http", "listen"}].empty() ? "127.0.0.1" : (*configPtr)[{"http", "listen"}];
+    /**
+     * Passes the response of one request to the cpp-netlib connection in order. cpp-netlib copies everything passed to
+     * write() into its own buffers without any backpressure, so files are read one slice at a time, and the next
+     * slice is only read and written from the completion callback of the previous one.
+     */
+    class HttpOutputQueue : public enable_shared_from_this<HttpOutputQueue> {
+        struct Part {
+            string data;       /**< Body part to be sent (if fd is -1). */
+            int fd = -1;       /**< Duplicated descriptor of the file to be sent, or -1. */
+            size_t size = 0;   /**< Size of the file. */
+            size_t offset = 0; /**< Number of bytes of the file which have already been sent. */
+        };
+
+        HttpServer::connection_ptr httpConn;
+        mutex queueMutex;
+        deque<Part> parts;
+        bool writing = false; /**< Whether a write is outstanding, whose completion will send the remaining parts. */
+        string slice;         /**< Buffer for the current file slice, only used by the outstanding write. */
+
+        void clear() {
+            for (auto const& part : parts) {
+                if (part.fd >= 0) {
+                    close(part.fd);
+                }
+            }
+            parts.clear();
+        }
+
+        bool readSlice(Part const& part, size_t sliceSize) {
+            slice.resize(sliceSize);
+            size_t bytesRead = 0;
+            while (bytesRead < sliceSize) {
+                auto result = pread(part.fd, &slice[bytesRead], sliceSize - bytesRead,
+                                    static_cast<off_t>(part.offset + bytesRead));
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result <= 0) {
+                    return false;
+                }
+                bytesRead += result;
+            }
+            return true;
+        }
+
+        /**
+         * Write the queued parts up to (and including) the next file slice. Must only be called by the owner of the
+         * outstanding write, i.e., after setting writing to true, or from the completion callback.
+         */
+        void writeNext() {
+            unique_lock<mutex> lock(queueMutex);
+            try {
+                while (!parts.empty()) {
+                    auto& part = parts.front();
+                    if (part.fd < 0) {
+                        httpConn->write(part.data);
+                        parts.pop_front();
+                        continue;
+                    }
+                    if (part.offset >= part.size) {
+                        close(part.fd);
+                        parts.pop_front();
+                        continue;
+                    }
+                    auto sliceSize = min(HTTP_FILE_SLICE_SIZE, part.size - part.offset);
+                    if (!readSlice(part, sliceSize)) {
+                        NLOG_ERROR(logger, "Could not read the file to be sent completely")
+                        break;
+                    }
+                    part.offset += sliceSize;
+                    auto self = shared_from_this();
+                    httpConn->write(slice, [self](boost::system::error_code const& ec) {
+                        if (ec) {
+                            lock_guard<mutex> lock(self->queueMutex);
+                            self->clear();
+                            self->writing = false;
+                            return;
+                        }
+                        self->writeNext();
+                    });
+                    return;
+                }
+            } catch (exception const& e) {
+                // cpp-netlib throws if the connection has failed before
+                NLOG_DEBUG(logger, "Could not write to the connection: " << e.what())
+            }
+            clear();
+            writing = false;
+        }
+
+    public:
+        explicit HttpOutputQueue(HttpServer::connection_ptr httpConn) : httpConn(std::move(httpConn)) {}
+
+        ~HttpOutputQueue() {
+            clear();
+        }
+
+        /**
+         * Write a part of the body, after everything queued before.
+         * @param body The body part, which is copied if it cannot be passed on immediately.
+         */
+        void write(string_view body) {
+            {
+                lock_guard<mutex> lock(queueMutex);
+                if (writing) {
+                    if (!body.empty()) {
+                        parts.push_back({string(body)});
+                    }
+                    return;
+                }
+            }
+            // also write empty bodies, as cpp-netlib only sends the headers on the first write
+            httpConn->write(body);
+        }
+
+        /**
+         * Write a file, after everything queued before.
+         * @param fd Descriptor of the file, which is duplicated, as it is only valid during the flush callback.
+         * @param size Number of bytes to send.
+         * @return False if the descriptor could not be duplicated.
+         */
+        bool writeFile(int fd, size_t size) {
+            int ownFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (ownFd < 0) {
+                return false;
+            }
+            {
+                lock_guard<mutex> lock(queueMutex);
+                parts.push_back({string(), ownFd, size});
+                if (writing) {
+                    return true;
+                }
+                writing = true;
+            }
+            writeNext();
+            return true;
+        }
+    };
+
+    inline string getListenAddr(Config const& config) {
+        return config[{"http", "listen"}].empty() ? "127.0.0.1" : config[{"http", "listen"}];
     }
 
-    inline string getListenPort(shared_ptr<Config const> const& configPtr) {
-        return (*configPtr)[{"http", "port"}].empty() ? "8080" : (*configPtr)[{"http", "port"}];
+    inline string getListenPort(Config const& config) {
+        return config[{"http", "port"}].empty() ? "8080" : config[{"http", "port"}];
         ;
     }
 }// namespace
@@ -72,11 +226,13 @@ struct InputConsumingHttpHandler : public enable_shared_from_this<InputConsuming
     size_t expectedSize;
     string postBody;
     RawPostAccess rawPostAccess;
+    chrono::steady_clock::time_point arrival; /**< Arrival of the request (for metrics). */
 
     InputConsumingHttpHandler(RequestHandler* requestHandler, ConnectionInitContainer connectionInit,
-                              ssize_t maxPostSize, size_t expectedSize, RawPostAccess rawPostAccess)
+                              ssize_t maxPostSize, size_t expectedSize, RawPostAccess rawPostAccess,
+                              chrono::steady_clock::time_point arrival)
         : requestHandler(requestHandler), connectionInit(std::move(connectionInit)), maxPostSize(maxPostSize),
-          expectedSize(expectedSize), rawPostAccess(rawPostAccess) {}
+          expectedSize(expectedSize), rawPostAccess(rawPostAccess), arrival(arrival) {}
 
     void operator()(HttpServer::connection::input_range input, boost::system::error_code ec,
                     size_t bytesTransferred, HttpServer::connection_ptr httpConn) {
@@ -139,7 +295,8 @@ struct InputConsumingHttpHandler : public enable_shared_from_this<InputConsuming
         }
 
         // finally handle the request
-        Connection connection(connectionInit);
+        Connection connection(std::move(connectionInit));
+        metrics::recordSince(metrics::Histogram::QUEUE_WAIT, arrival);
         requestHandler->handleRequest(connection);
         connection.flushResponse();
     }
@@ -149,7 +306,8 @@ struct HttpHandler {
     RequestHandler* requestHandler = nullptr;
 
     void operator()(HttpServer::request const& request, HttpServer::connection_ptr httpConn) {
-        auto configPtr = requestHandler->getConfig();
+        auto arrival = metrics::startTimer();
+        auto configGuard = requestHandler->readConfig();
 
         RequestInitContainer requestInit;
         requestInit.environment = {
@@ -157,8 +315,8 @@ struct HttpHandler {
                 {"REQUEST_URI", request.destination},
                 {"REMOTE_PORT", to_string(request.source_port)},
                 {"REQUEST_METHOD", request.method},
-                {"SERVER_ADDR", getListenAddr(configPtr)},
-                {"SERVER_PORT", getListenPort(configPtr)},
+                {"SERVER_ADDR", getListenAddr(*configGuard)},
+                {"SERVER_PORT", getListenPort(*configGuard)},
                 {"SERVER_SOFTWARE", "NAWA Development Web Server"},
         };
 
@@ -194,36 +352,54 @@ struct HttpHandler {
 
         ConnectionInitContainer connectionInit;
         connectionInit.requestInit = std::move(requestInit);
-        connectionInit.config = (*configPtr);
 
-        connectionInit.flushCallback = [httpConn](FlushCallbackContainer flushInfo) {
+        auto outputQueue = make_shared<HttpOutputQueue>(httpConn);
+        connectionInit.flushCallback = [httpConn, outputQueue](FlushCallbackContainer const& flushInfo) {
             if (!flushInfo.flushedBefore) {
                 httpConn->set_status(HttpServer::connection::status_t(flushInfo.status));
-                httpConn->set_headers(flushInfo.headers);
+                // as there is no web server in front of nawa, the date header has to be added here
+                if (flushInfo.headers.count("date") == 0) {
+                    auto headers = flushInfo.headers;
+                    headers.insert({"date", utils::currentHttpTime()});
+                    httpConn->set_headers(headers);
+                } else {
+                    httpConn->set_headers(flushInfo.headers);
+                }
+            }
+            outputQueue->write(flushInfo.body);
+            if (flushInfo.file && flushInfo.file->size > 0 &&
+                !outputQueue->writeFile(flushInfo.file->fd, flushInfo.file->size)) {
+                NLOG_ERROR(logger, "Could not send the file, as its descriptor could not be duplicated")
             }
-            httpConn->write(flushInfo.body);
         };
 
         // is there POST data to be handled?
         if (request.method == "POST" && connectionInit.requestInit.environment.count("content-length")) {
             try {
-                string rawPostStr = (*configPtr)[{"post", "raw_access"}];
+                auto const& rawPostStr = (*configGuard)[postRawAccessKey];
                 auto rawPostAccess = (rawPostStr == "never")
                                              ? RawPostAccess::NEVER
                                              : ((rawPostStr == "always") ? RawPostAccess::ALWAYS
                                                                          : RawPostAccess::NONSTANDARD);
 
                 auto contentLength = stoul(connectionInit.requestInit.environment.at("content-length"));
-                ssize_t maxPostSize = stol((*configPtr)[{"post", "max_size"}]) * 1024;
+                auto maxPostSizeKiB = configGuard->getNumber(postMaxSizeKey);
+                if (!maxPostSizeKiB) {
+                    return;
+                }
+                ssize_t maxPostSize = static_cast<ssize_t>(*maxPostSizeKiB * 1024);
 
                 if (contentLength > maxPostSize) {
                     sendServerError(httpConn);
                     return;
                 }
 
+                // the request is handled after reading the POST data, possibly in another thread, so it needs a copy
+                connectionInit.config = *configGuard;
                 auto inputConsumingHandler = make_shared<InputConsumingHttpHandler>(requestHandler,
                                                                                     std::move(connectionInit), maxPostSize,
-                                                                                    contentLength, rawPostAccess);
+                                                                                    contentLength, rawPostAccess,
+                                                                                    arrival);
                 httpConn->read([inputConsumingHandler](HttpServer::connection::input_range input,
                                                        boost::system::error_code ec, size_t bytesTransferred,
                                                        HttpServer::connection_ptr httpConn) {
@@ -234,7 +410,10 @@ struct HttpHandler {
             return;
         }
 
-        Connection connection(connectionInit);
+        // the guard keeps the config valid until the connection has been destroyed, so that it need not be copied
+        connectionInit.sharedConfig = &*configGuard;
+        Connection connection(std::move(connectionInit));
+        metrics::recordSince(metrics::Histogram::QUEUE_WAIT, arrival);
         requestHandler->handleRequest(connection);
         connection.flushResponse();
     }
@@ -256,7 +435,7 @@ HttpRequestHandler::HttpRequestHandler(std::shared_ptr<HandleRequestFunctionWrap
 
     setAppRequestHandler(std::move(handleRequestFunction));
     setConfig(std::move(config));
-    auto configPtr = getConfig();
+    auto configGuard = readConfig();
 
     logger.setAppname("HttpRequestHandler");
 
@@ -265,9 +444,9 @@ HttpRequestHandler::HttpRequestHandler(std::shared_ptr<HandleRequestFunctionWrap
     HttpServer::options httpServerOptions(*data->handler);
 
     // set options from config
-    string listenAddr = getListenAddr(configPtr);
-    string listenPort = getListenPort(configPtr);
-    bool reuseAddr = (*configPtr)[{"http", "reuseaddr"}] != "off";
+    string listenAddr = getListenAddr(*configGuard);
+    string listenPort = getListenPort(*configGuard);
+    bool reuseAddr = (*configGuard)[{"http", "reuseaddr"}] != "off";
     data->server = make_unique<HttpServer>(
             httpServerOptions.address(listenAddr).port(listenPort).reuse_address(reuseAddr));
 
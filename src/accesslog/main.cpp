@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file main.cpp
+ * \brief Decoder for access log files written by NAWA (nawa-accesslog).
+ */
+
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <nawa/Exception.h>
+#include <nawa/logging/AccessLog.h>
+#include <optional>
+#include <sstream>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    /**
+     * Filter criteria given on the command line.
+     */
+    struct Filter {
+        optional<unsigned int> status;      /**< Exact status code, or the first digit if statusClass is set. */
+        bool statusClass = false;           /**< Whether the filter is a status class like 5xx. */
+        optional<string> method;            /**< Exact request method. */
+        optional<string> pathPrefix;        /**< Prefix of the request URI. */
+        optional<uint64_t> minDuration;     /**< Minimum duration in microseconds. */
+        optional<uint32_t> thread;          /**< Thread number. */
+        optional<size_t> tail;              /**< Only print the last n matching records. */
+
+        [[nodiscard]] bool matches(accesslog::Entry const& entry) const {
+            if (status && (statusClass ? entry.status / 100 != *status : entry.status != *status)) {
+                return false;
+            }
+            if (method && entry.method != *method) {
+                return false;
+            }
+            if (pathPrefix && entry.path.compare(0, pathPrefix->size(), *pathPrefix) != 0) {
+                return false;
+            }
+            if (minDuration && entry.duration < *minDuration) {
+                return false;
+            }
+            return !thread || entry.thread == *thread;
+        }
+    };
+
+    void printHelpAndExit(int exitCode) {
+        (exitCode == 0 ? cout : cerr)
+                << "nawa-accesslog decodes access log files written by NAWA.\n\n"
+                   "Usage: nawa-accesslog [<filters>] [--csv] <file>\n\n"
+                   "Filters:\n"
+                   "  --status=<code>         only records with the given status (e.g., 404) or status\n"
+                   "                          class (e.g., 5xx)\n"
+                   "  --method=<method>       only records with the given request method\n"
+                   "  --path=<prefix>         only records whose request URI starts with the prefix\n"
+                   "  --min-duration=<us>     only records which took at least the given number of\n"
+                   "                          microseconds\n"
+                   "  --thread=<n>            only records written by the given thread\n"
+                   "  --tail=<n>              only the last n matching records\n\n"
+                   "Records are printed in the order of their completion, as\n"
+                   "<time> <thread> <method> <uri> <status> <bytes> <duration in us>\n"
+                   "or as comma-separated values with --csv.\n";
+        exit(exitCode);
+    }
+
+    /**
+     * Format a timestamp (microseconds since the epoch) as UTC time in ISO 8601 format.
+     */
+    string formatTimestamp(uint64_t timestamp) {
+        time_t seconds = timestamp / 1000000;
+        tm utc{};
+        gmtime_r(&seconds, &utc);
+        char buffer[32];
+        strftime(buffer, sizeof buffer, "%Y-%m-%dT%H:%M:%S", &utc);
+        ostringstream formatted;
+        formatted << buffer << '.' << setw(6) << setfill('0') << timestamp % 1000000 << 'Z';
+        return formatted.str();
+    }
+
+    /**
+     * Quote a value for CSV output if necessary.
+     */
+    string csvValue(string const& value) {
+        if (value.find_first_of(",\"\r\n") == string::npos) {
+            return value;
+        }
+        string quoted = "\"";
+        for (char c : value) {
+            if (c == '"') {
+                quoted += '"';
+            }
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+}// namespace
+
+int main(int argc, char** argv) {
+    Filter filter;
+    bool csv = false;
+    optional<string> path;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg(argv[i]);
+            auto separator = arg.find('=');
+            auto name = arg.substr(0, separator);
+            auto value = separator == string::npos ? string() : arg.substr(separator + 1);
+            if (arg == "--help" || arg == "-h") {
+                printHelpAndExit(0);
+            } else if (arg == "--csv") {
+                csv = true;
+            } else if (name == "--status" && value.size() == 3 && value.compare(1, 2, "xx") == 0) {
+                filter.status = stoul(value.substr(0, 1));
+                filter.statusClass = true;
+            } else if (name == "--status") {
+                filter.status = stoul(value);
+            } else if (name == "--method") {
+                filter.method = value;
+            } else if (name == "--path") {
+                filter.pathPrefix = value;
+            } else if (name == "--min-duration") {
+                filter.minDuration = stoull(value);
+            } else if (name == "--thread") {
+                filter.thread = stoul(value);
+            } else if (name == "--tail") {
+                filter.tail = stoul(value);
+            } else if (i == argc - 1 && arg.substr(0, 2) != "--") {
+                path = arg;
+            } else {
+                cerr << "Invalid argument: " << arg << "\n\n";
+                printHelpAndExit(2);
+            }
+        }
+    } catch (logic_error const&) {
+        cerr << "Invalid filter value.\n\n";
+        printHelpAndExit(2);
+    }
+    if (!path) {
+        printHelpAndExit(2);
+    }
+
+    vector<accesslog::Entry> entries;
+    try {
+        entries = accesslog::read(*path);
+    } catch (Exception const& e) {
+        cerr << "Error: " << e.getMessage() << '\n';
+        return 1;
+    }
+
+    vector<accesslog::Entry const*> matching;
+    for (auto const& entry : entries) {
+        if (filter.matches(entry)) {
+            matching.push_back(&entry);
+        }
+    }
+    size_t first = filter.tail && *filter.tail < matching.size() ? matching.size() - *filter.tail : 0;
+
+    if (csv) {
+        cout << "time,thread,method,uri,status,bytes,duration_us\n";
+    }
+    char const separator = csv ? ',' : ' ';
+    for (size_t i = first; i < matching.size(); ++i) {
+        auto const& entry = *matching[i];
+        cout << formatTimestamp(entry.timestamp) << separator << entry.thread << separator
+             << (csv ? csvValue(entry.method) : entry.method) << separator
+             << (csv ? csvValue(entry.path) : entry.path) << separator << entry.status << separator << entry.bytes
+             << separator << entry.duration << '\n';
+    }
+    return 0;
+}
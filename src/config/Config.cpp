@@ -25,14 +25,116 @@
 #include <inih/ini.h>
 #include <nawa/Exception.h>
 #include <nawa/config/Config.h>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 using namespace nawa;
 using namespace std;
 
+namespace {
+    using ValueMap = unordered_map<pair<string, string>, string, boost::hash<pair<string, string>>>;
+
+    /**
+     * Registry of all interned keys. Keys are never removed, so references to them stay valid.
+     */
+    struct KeyRegistry {
+        mutex lock;
+        unordered_map<pair<string, string>, size_t, boost::hash<pair<string, string>>> ids;
+        deque<pair<string, string>> keys; /**< Indexed by key ID. */
+    };
+
+    KeyRegistry& keyRegistry() {
+        static KeyRegistry registry;
+        return registry;
+    }
+
+    /**
+     * A value and its parsed representations.
+     */
+    struct CachedValue {
+        string const* value = nullptr; /**< Points into the ValueMap, or nullptr if the key is not set. */
+        optional<unsigned long> number;
+        optional<bool> switchValue;
+
+        explicit CachedValue(string const* value = nullptr) : value(value) {
+            if (!value) {
+                return;
+            }
+            try {
+                number = stoul(*value);
+            } catch (logic_error const&) {}
+            if (*value == "on") {
+                switchValue = true;
+            } else if (*value == "off") {
+                switchValue = false;
+            }
+        }
+    };
+
+    /**
+     * The values of a Config container, along with the parsed values of all interned keys.
+     */
+    struct Values {
+        ValueMap map;
+        vector<CachedValue> byKey; /**< Indexed by key ID, covers all keys interned at the time of compile(). */
+
+        explicit Values(ValueMap map = {}) : map(std::move(map)) {}
+
+        /**
+         * Rebuild the cached values of all interned keys. Must be called after every modification of the map.
+         */
+        void compile() {
+            auto& registry = keyRegistry();
+            lock_guard<mutex> lockGuard(registry.lock);
+            byKey.clear();
+            byKey.reserve(registry.keys.size());
+            for (auto const& key : registry.keys) {
+                auto it = map.find(key);
+                byKey.emplace_back(it != map.end() ? &it->second : nullptr);
+            }
+        }
+    };
+}// namespace
+
 // implementation
 struct Config::Data {
-    std::unordered_map<std::pair<std::string, std::string>, std::string, boost::hash<std::pair<std::string, std::string>>> values;
+    /**
+     * The values, shared between copies of the Config container until one of them is modified (copy-on-write), so
+     * that copying a Config (e.g., for every request) does not copy the values.
+     */
+    shared_ptr<Values> values = make_shared<Values>();
+
+    /**
+     * Modify the values, copying them first if they are shared with another Config container, and update the cached
+     * values afterwards.
+     * @param modify Function which modifies the map of values.
+     */
+    template<typename Modifier>
+    void modify(Modifier modify) {
+        if (values.use_count() > 1) {
+            values = make_shared<Values>(values->map);
+        }
+        modify(values->map);
+        values->compile();
+    }
+
+    /**
+     * Get the cached value for a key.
+     * @param key The key.
+     * @return The cached value, which is only valid until the values are modified if the key has been interned after
+     * the last modification (as it has to be created on the fly then).
+     */
+    CachedValue const& get(Key const& key) const {
+        if (key.getId() < values->byKey.size()) {
+            return values->byKey[key.getId()];
+        }
+        thread_local CachedValue uncached;
+        auto it = values->map.find(key.getPair());
+        uncached = CachedValue(it != values->map.end() ? &it->second : nullptr);
+        return uncached;
+    }
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL(Config)
@@ -47,8 +149,24 @@ NAWA_MOVE_ASSIGNMENT_OPERATOR_IMPL(Config)
 
 NAWA_DEFAULT_CONSTRUCTOR_IMPL(Config)
 
+Config::Key::Key(std::pair<std::string, std::string> key) {
+    auto& registry = keyRegistry();
+    lock_guard<mutex> lockGuard(registry.lock);
+    auto [it, inserted] = registry.ids.try_emplace(std::move(key), registry.keys.size());
+    if (inserted) {
+        registry.keys.push_back(it->first);
+    }
+    id = it->second;
+}
+
+std::pair<std::string, std::string> const& Config::Key::getPair() const {
+    auto& registry = keyRegistry();
+    lock_guard<mutex> lockGuard(registry.lock);
+    return registry.keys[id];
+}
+
 Config::Config(std::initializer_list<std::pair<std::pair<std::string, std::string>, std::string>> init) : Config() {
-    data->values.insert(init.begin(), init.end());
+    insert(init);
 }
 
 Config::Config(std::string const& iniFile) : Config() {
@@ -57,42 +175,64 @@ Config::Config(std::string const& iniFile) : Config() {
 
 void Config::read(std::string const& iniFile) {
     auto valueHandler = [](void* obj, char const* section, char const* name, char const* value) -> int {
-        auto _this = (Config*) obj;
+        auto values = (ValueMap*) obj;
         pair<string, string> keyToInsert(section, name);
         pair<pair<string, string>, string> pairToInsert(keyToInsert, value);
-        _this->data->values.insert(pairToInsert);
+        values->insert(pairToInsert);
         return 1;
     };
-    if (ini_parse(iniFile.c_str(), valueHandler, this) < 0) {
+    int result;
+    data->modify([&](ValueMap& values) { result = ini_parse(iniFile.c_str(), valueHandler, &values); });
+    if (result < 0) {
         throw Exception(__PRETTY_FUNCTION__, 1, "Could not read config file.");
     }
 }
 
 void Config::insert(std::initializer_list<std::pair<std::pair<std::string, std::string>, std::string>> init) {
-    data->values.insert(init.begin(), init.end());
+    data->modify([&init](ValueMap& values) { values.insert(init.begin(), init.end()); });
 }
 
 void Config::override(std::vector<std::pair<std::pair<std::string, std::string>, std::string>> const& overrides) {
-    for (auto& [k, v] : overrides) {
-        data->values[k] = v;
-    }
+    data->modify([&overrides](ValueMap& values) {
+        for (auto& [k, v] : overrides) {
+            values[k] = v;
+        }
+    });
 }
 
 bool Config::isSet(std::pair<std::string, std::string> const& key) const {
-    return (data->values.count(key) == 1);
+    return (data->values->map.count(key) == 1);
 }
 
 std::string Config::operator[](std::pair<std::string, std::string> const& key) const {
-    if (data->values.count(key) == 1) {
-        return data->values.at(key);
-    } else {
-        return {};
+    auto it = data->values->map.find(key);
+    if (it != data->values->map.end()) {
+        return it->second;
     }
+    return {};
+}
+
+bool Config::isSet(Key const& key) const {
+    return data->get(key).value != nullptr;
+}
+
+std::string const& Config::operator[](Key const& key) const {
+    static string const empty;
+    auto value = data->get(key).value;
+    return value ? *value : empty;
+}
+
+std::optional<unsigned long> Config::getNumber(Key const& key) const {
+    return data->get(key).number;
+}
+
+std::optional<bool> Config::getSwitch(Key const& key) const {
+    return data->get(key).switchValue;
 }
 
 // doxygen bug requires std:: here
 void Config::set(std::pair<string, string> key, std::string value) {
-    data->values[std::move(key)] = std::move(value);
+    data->modify([&key, &value](ValueMap& values) { values[std::move(key)] = std::move(value); });
 }
 
 void Config::set(std::string section, std::string key, std::string value) {
@@ -21,18 +21,24 @@
  * \brief Implementation of the Connection and FlushCallbackContainer classes.
  */
 
-#include <fstream>
+#include <cerrno>
+#include <fcntl.h>
 #include <nawa/Exception.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/connection/ConnectionInitContainer.h>
+#include <nawa/connection/StaticFileCache.h>
 #include <nawa/filter/AccessFilterList.h>
+#include <nawa/logging/AccessLog.h>
 #include <nawa/logging/Log.h>
 #include <nawa/oss.h>
+#include <nawa/util/ThreadLocalPool.h>
 #include <nawa/util/encoding.h>
+#include <nawa/util/metrics.h>
 #include <nawa/util/utils.h>
 #include <regex>
 #include <sstream>
 #include <sys/stat.h>
+#include <unistd.h>
 
 using namespace nawa;
 using namespace std;
@@ -98,75 +104,315 @@ namespace {
             {508, "Loop Detected"},
             {510, "Not Extended"},
             {511, "Network Authentication Required"}};
+
+    /**
+     * A file opened by Connection::sendFile, which is closed on destruction.
+     */
+    struct OpenFile {
+        int fd;
+        size_t size;
+
+        OpenFile(int fd, size_t size) : fd(fd), size(size) {}
+
+        OpenFile(OpenFile const&) = delete;
+
+        OpenFile& operator=(OpenFile const&) = delete;
+
+        ~OpenFile() {
+            close(fd);
+        }
+    };
+
+    /**
+     * Read (a part of) a file from the given offset, retrying on interruptions and short reads.
+     * @param fd The file descriptor.
+     * @param buffer The buffer to read into.
+     * @param size Number of bytes to read.
+     * @param offset Offset in the file.
+     * @return True if all bytes have been read, false otherwise.
+     */
+    bool preadFully(int fd, char* buffer, size_t size, off_t offset) {
+        while (size > 0) {
+            auto bytesRead = pread(fd, buffer, size, offset);
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytesRead <= 0) {
+                return false;
+            }
+            buffer += bytesRead;
+            size -= bytesRead;
+            offset += bytesRead;
+        }
+        return true;
+    }
+
+    /**
+     * Maximum capacity of a response body buffer to be kept for reuse by the next request.
+     */
+    size_t const MAX_RECYCLED_BODY_CAPACITY = 1024 * 1024;
+
+    shared_ptr<StaticFileCache> staticFileCache; /**< Must only be accessed through atomic_load and atomic_store. */
+
+    // config keys accessed on every request (or every forward filter hit)
+    Config::Key const highWaterMarkKey({"response", "high_water_mark"});
+    Config::Key const sessionAutostartKey({"session", "autostart"});
+    Config::Key const staticCacheSizeKey({"static_cache", "size"});
+    Config::Key const staticCacheMaxFileSizeKey({"static_cache", "max_file_size"});
+    Config::Key const staticCacheRevalidateIntervalKey({"static_cache", "revalidate_interval"});
+
+    /**
+     * Get the static file cache for forward filters, creating (or recreating) it if the config has been changed.
+     * @param config The config.
+     * @return The static file cache, or nullptr if it is disabled.
+     */
+    shared_ptr<StaticFileCache> getStaticFileCache(Config const& config) {
+        size_t capacity = config.getNumber(staticCacheSizeKey).value_or(0) * 1024;
+        if (capacity == 0) {
+            return nullptr;
+        }
+        size_t maxFileSize = config.getNumber(staticCacheMaxFileSizeKey).value_or(1024) * 1024;
+        chrono::steady_clock::duration revalidateInterval =
+                chrono::seconds(config.getNumber(staticCacheRevalidateIntervalKey).value_or(2));
+
+        auto cache = atomic_load(&staticFileCache);
+        if (!cache || cache->capacity() != capacity || cache->maxFileSize() != maxFileSize ||
+            cache->revalidateInterval() != revalidateInterval) {
+            cache = make_shared<StaticFileCache>(capacity, maxFileSize, revalidateInterval);
+            atomic_store(&staticFileCache, cache);
+        }
+        return cache;
+    }
+
+    /**
+     * Check the conditional request headers (if-none-match and, if it is not present, if-modified-since).
+     * @param env The request environment.
+     * @param etag The ETag of the requested resource, or an empty string if it has none (if-none-match will be
+     * ignored then).
+     * @param lastModified Time of the last modification of the requested resource.
+     * @return True if the resource has not been modified and a 304 response should be sent.
+     */
+    bool isNotModified(request::Env const& env, string const& etag, time_t lastModified) {
+        auto ifNoneMatch = etag.empty() ? string() : env["if-none-match"];
+        if (!ifNoneMatch.empty()) {
+            // weak comparison, as required for if-none-match (RFC 7232, section 3.2)
+            for (auto tag : utils::splitString(ifNoneMatch, ',', true)) {
+                auto first = tag.find_first_not_of(' ');
+                if (first == string::npos) {
+                    continue;
+                }
+                tag = tag.substr(first, tag.find_last_not_of(' ') - first + 1);
+                if (tag == "*" || tag == etag || (tag.size() > 2 && tag.compare(0, 2, "W/") == 0 &&
+                                                  tag.compare(2, string::npos, etag) == 0)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        auto ifModifiedSince = env["if-modified-since"];
+        if (!ifModifiedSince.empty()) {
+            try {
+                return utils::readHttpTime(ifModifiedSince) >= lastModified;
+            } catch (Exception const&) {}
+        }
+        return false;
+    }
 }// namespace
 
 struct Connection::Data {
-    string bodyString;
+    /**
+     * Stream buffer writing directly into the response body, so that the response stream does not keep its own copy
+     * of the output.
+     */
+    class BodyStreamBuf : public streambuf {
+        Data& base;
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                base.materializeBody();
+                base.bodyString.push_back(traits_type::to_char_type(c));
+                base.checkHighWaterMark();
+            }
+            return traits_type::not_eof(c);
+        }
+
+        streamsize xsputn(char const* s, streamsize n) override {
+            base.materializeBody();
+            base.bodyString.append(s, n);
+            base.checkHighWaterMark();
+            return n;
+        }
+
+    public:
+        explicit BodyStreamBuf(Data& base) : base(base) {}
+    };
+
+    Connection* connection;
+    string bodyString = ThreadLocalPool<string>::acquire(); /**< Recycled from previous requests (see ~Data()). */
     unsigned int responseStatus = 200;
-    unordered_map<string, vector<string>> headers;
+    unordered_map<string, vector<string>> headers = ThreadLocalPool<unordered_map<string, vector<string>>>::acquire();
     unordered_map<string, Cookie> cookies;
     Cookie cookiePolicy;
     bool isFlushed = false;
     FlushCallbackFunction flushCallback;
+    size_t highWaterMark = 0; /**< Buffered body size (in bytes) which triggers a flush, 0 if disabled. */
+    size_t bytesOut = 0;      /**< Body bytes flushed so far (for metrics and the access log). */
+    chrono::steady_clock::time_point start; /**< Creation time, only set if the access log is enabled. */
+    /**
+     * File to be sent after bodyString, as set by sendFile(). The file is only read into memory if the body is
+     * accessed or modified afterwards (see materializeBody()).
+     */
+    unique_ptr<OpenFile> file;
+    /**
+     * Body shared with the static file cache, used instead of bodyString (which is empty then) to avoid copying
+     * cached files (see materializeBody()).
+     */
+    shared_ptr<string const> sharedBody;
 
     Request request;
     Session session;
-    Config config;
-    stringstream responseStream;
+    Config config;                        /**< Own copy of the config, once the app has requested a modifiable one. */
+    Config const* sharedConfig = nullptr; /**< Config of the request handler, used until a copy has been made. */
+    BodyStreamBuf responseStreamBuf;
+    ostream responseStream;
+
+    /**
+     * If a file or a shared body has been set as the body, copy it into bodyString, so that the body can be accessed
+     * or extended.
+     */
+    void materializeBody() {
+        if (sharedBody) {
+            bodyString.append(*sharedBody);
+            sharedBody.reset();
+        }
+        if (!file) {
+            return;
+        }
+        auto offset = bodyString.size();
+        bodyString.resize(offset + file->size);
+        if (!preadFully(file->fd, &bodyString[offset], file->size, 0)) {
+            bodyString.resize(offset);
+            NLOG_ERROR(logger, "Could not read file for the response body")
+        }
+        file.reset();
+    }
 
-    void clearStream() {
-        responseStream.str(string());
-        responseStream.clear();
+    /**
+     * Flush the response if the buffered body has reached the high-water mark.
+     */
+    void checkHighWaterMark() {
+        if (highWaterMark > 0 && bodyString.size() >= highWaterMark) {
+            connection->flushResponse();
+        }
+    }
+
+    Data(Connection* base, ConnectionInitContainer&& connectionInit) : connection(base),
+                                                                       flushCallback(
+                                                                               std::move(connectionInit.flushCallback)),
+                                                                       request(std::move(connectionInit.requestInit)),
+                                                                       config(std::move(connectionInit.config)),
+                                                                       sharedConfig(connectionInit.sharedConfig),
+                                                                       session(*base),
+                                                                       responseStreamBuf(*this),
+                                                                       responseStream(&responseStreamBuf) {
+        if (accesslog::enabled()) {
+            start = chrono::steady_clock::now();
+        }
     }
 
-    void mergeStream() {
-        bodyString += responseStream.str();
-        clearStream();
+    /**
+     * Get the config for reading (without making a copy of a shared config).
+     */
+    [[nodiscard]] Config const& readConfig() const noexcept {
+        return sharedConfig ? *sharedConfig : config;
     }
 
-    Data(Connection* base, ConnectionInitContainer const& connectionInit) : request(connectionInit.requestInit),
-                                                                            config(connectionInit.config),
-                                                                            session(*base) {}
+    /**
+     * Pass a flush to the flush callback, measuring it if metrics are enabled.
+     * @param flushInfo The flush.
+     */
+    void flush(FlushCallbackContainer const& flushInfo) {
+        auto flushStart = metrics::startTimer();
+        flushCallback(flushInfo);
+        size_t bytes = flushInfo.body.size() + (flushInfo.file ? flushInfo.file->size : 0);
+        bytesOut += bytes;
+        if (metrics::enabled()) {
+            metrics::recordSince(metrics::Histogram::FLUSH_TIME, flushStart);
+            metrics::count(metrics::Counter::FLUSHES);
+            metrics::count(metrics::Counter::BYTES_OUT, bytes);
+        }
+    }
+
+    ~Data() {
+        if (isFlushed) {
+            metrics::record(metrics::Histogram::RESPONSE_SIZE, bytesOut);
+            // the response is complete now, so the access log gets the final status and size of all flushes
+            if (accesslog::enabled() && start != chrono::steady_clock::time_point()) {
+                auto const& env = request.env();
+                accesslog::record(env["REQUEST_METHOD"], env["REQUEST_URI"], responseStatus, bytesOut,
+                                  chrono::steady_clock::now() - start);
+            }
+        }
+        // keep the memory of the body buffer and header map for the next request handled by this thread
+        // (unless the buffer has grown very large)
+        if (bodyString.capacity() <= MAX_RECYCLED_BODY_CAPACITY) {
+            bodyString.clear();
+            ThreadLocalPool<string>::release(std::move(bodyString));
+        }
+        headers.clear();
+        ThreadLocalPool<unordered_map<string, vector<string>>>::release(std::move(headers));
+    }
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL(Connection)
 
 void Connection::setResponseBody(std::string content) {
     data->bodyString = std::move(content);
-    data->clearStream();
+    data->file.reset();
+    data->sharedBody.reset();
+}
+
+void Connection::write(std::string_view content) {
+    data->materializeBody();
+    data->bodyString.append(content);
+    data->checkHighWaterMark();
+}
+
+void Connection::flushChunk(std::string_view chunk) {
+    if (!data->bodyString.empty() || data->file || data->sharedBody || !data->isFlushed) {
+        flushResponse();
+    }
+    data->flush(FlushCallbackContainer{
+            .status = data->responseStatus,
+            .headers = {},
+            .body = chunk,
+            .flushedBefore = true,
+            .file = nullopt});
 }
 
 void Connection::sendFile(std::string const& path, std::string const& contentType, bool forceDownload,
                           std::string const& downloadFilename, bool checkIfModifiedSince) {
 
-    // open file as binary
-    ifstream f(path, ifstream::binary);
+    // open the file, it will be sent by the request handler directly from the file descriptor
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
 
     // throw exception if file cannot be opened
-    if (!f) {
+    if (fd < 0) {
         throw Exception(__PRETTY_FUNCTION__, 1, "Cannot open file for reading");
     }
+    auto file = make_unique<OpenFile>(fd, 0);
 
-    // get time of last modification
+    // get file size and time of last modification
     struct stat fileStat {};
     time_t lastModified = 0;
-    if (stat(path.c_str(), &fileStat) == 0) {
-        lastModified = oss::getLastModifiedTimeOfFile(fileStat);
-    }
-
-    // check if-modified if requested
-    time_t ifModifiedSince = 0;
-    try {
-        ifModifiedSince = stol(data->request.env()["if-modified-since"]);
-    } catch (invalid_argument const&) {
-    } catch (out_of_range const&) {}
-    if (checkIfModifiedSince && ifModifiedSince >= lastModified) {
-        setStatus(304);
-        setResponseBody(string());
-        return;
+    if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Cannot open file for reading");
     }
+    lastModified = oss::getLastModifiedTimeOfFile(fileStat);
+    file->size = fileStat.st_size;
 
-    // set content-type header
+    // set content-type header (also for a 304 response, instead of the default text/html)
     if (!contentType.empty()) {
         setHeader("content-type", contentType);
     } else {
@@ -174,6 +420,13 @@ void Connection::sendFile(std::string const& path, std::string const& contentTyp
         setHeader("content-type", utils::contentTypeByExtension(utils::getFileExtension(path)));
     }
 
+    // check if-modified-since if requested
+    if (checkIfModifiedSince && isNotModified(data->request.env(), string(), lastModified)) {
+        setStatus(304);
+        setResponseBody(string());
+        return;
+    }
+
     // set the content-disposition header
     if (forceDownload) {
         if (!downloadFilename.empty()) {
@@ -190,11 +443,7 @@ void Connection::sendFile(std::string const& path, std::string const& contentTyp
     }
 
     // set the content-length header
-    // get file size
-    f.seekg(0, ios::end);
-    long fs = f.tellg();
-    f.seekg(0);
-    setHeader("content-length", to_string(fs));
+    setHeader("content-length", to_string(file->size));
 
     // set the last-modified header (if possible)
     if (lastModified > 0) {
@@ -206,13 +455,10 @@ void Connection::sendFile(std::string const& path, std::string const& contentTyp
         }
     }
 
-    // resize the bodyString, fill it with \0 chars if needed, make sure char fs [(fs+1)th] is \0, and insert file contents
-    data->bodyString.resize(static_cast<unsigned long>(fs) + 1, '\0');
-    data->bodyString[fs] = '\0';
-    f.read(&data->bodyString[0], fs);
-
-    // also clear the stream so that it doesn't mess with our file
-    data->clearStream();
+    // the file replaces the existing body
+    data->bodyString.clear();
+    data->sharedBody.reset();
+    data->file = std::move(file);
 }
 
 void Connection::setHeader(std::string key, std::string value) {
@@ -295,18 +541,25 @@ std::unordered_multimap<std::string, std::string> Connection::getHeaders(bool in
 }
 
 string Connection::getResponseBody() {
-    data->mergeStream();
+    data->materializeBody();
     return data->bodyString;
 }
 
-Connection::Connection(ConnectionInitContainer const& connectionInit) {
-    data = make_unique<Data>(this, connectionInit);
-    data->flushCallback = connectionInit.flushCallback;
+Connection::Connection(ConnectionInitContainer const& connectionInit)
+    : Connection(ConnectionInitContainer(connectionInit)) {}
+
+Connection::Connection(ConnectionInitContainer&& connectionInit) {
+    data = make_unique<Data>(this, std::move(connectionInit));
 
     data->headers["content-type"] = {"text/html; charset=utf-8"};
+
+    // flush automatically if the buffered body grows too large
+    if (auto highWaterMark = data->readConfig().getNumber(highWaterMarkKey)) {
+        data->highWaterMark = *highWaterMark * 1024;
+    }
     // autostart of session must happen here (as config is not yet accessible in Session constructor)
     // check if autostart is enabled in config and if yes, directly call ::start
-    if (data->config[{"session", "autostart"}] == "on") {
+    if (data->readConfig().getSwitch(sessionAutostartKey) == true) {
         data->session.start();
     }
 }
@@ -330,16 +583,22 @@ void Connection::unsetCookie(std::string const& key) {
 }
 
 void Connection::flushResponse() {
-    // use callback to flush response
-    data->flushCallback(FlushCallbackContainer{
+    // use callback to flush response, the body is passed as a view and not copied
+    // headers are only needed when flushing for the first time
+    data->flush(FlushCallbackContainer{
             .status = data->responseStatus,
-            .headers = getHeaders(true),
-            .body = getResponseBody(),
-            .flushedBefore = data->isFlushed});
+            .headers = data->isFlushed ? unordered_multimap<string, string>() : getHeaders(true),
+            .body = data->sharedBody ? string_view(*data->sharedBody) : string_view(data->bodyString),
+            .flushedBefore = data->isFlushed,
+            .file = data->file ? make_optional(FlushCallbackContainer::FileBody{data->file->fd, data->file->size})
+                               : nullopt});
     // response has been flushed now
     data->isFlushed = true;
-    // also, empty the Connection object, so that content will not be sent more than once
-    setResponseBody("");
+    data->file.reset();
+    data->sharedBody.reset();
+    // also, empty the body, so that content will not be sent more than once
+    // (clear() keeps the capacity, so that streaming a large response reuses the same buffer)
+    data->bodyString.clear();
 }
 
 void Connection::setStatus(unsigned int status) {
@@ -367,11 +626,16 @@ Session const& Connection::session() const noexcept {
 }
 
 Config& Connection::config() noexcept {
+    // the app may modify the config, so it gets its own (copy-on-write) copy
+    if (data->sharedConfig) {
+        data->config = *data->sharedConfig;
+        data->sharedConfig = nullptr;
+    }
     return data->config;
 }
 
 Config const& Connection::config() const noexcept {
-    return data->config;
+    return data->readConfig();
 }
 
 ostream& Connection::responseStream() noexcept {
@@ -383,15 +647,13 @@ bool Connection::applyFilters(AccessFilterList const& accessFilters) {
     if (!accessFilters.filtersEnabled())
         return false;
 
-    auto requestPath = data->request.env().getRequestPath();
+    auto const& requestPath = data->request.env().getRequestPath();
+    // the path string for regex filters is created only once for all filters, and only if there are regex filters
+    auto mergedRequestPath = accessFilters.hasRegexFilters() ? AccessFilter::mergeRequestPath(requestPath) : string();
 
-    // check block filters
-    for (auto const& flt : accessFilters.blockFilters()) {
-        // if the filter does not apply (or does in case of an inverted filter), go to the next
-        bool matches = flt.matches(requestPath);
-        if ((!matches && !flt.invert()) || (matches && flt.invert())) {
-            continue;
-        }
+    // check block filters (only the first filter that applies is relevant)
+    if (auto blockFilterID = accessFilters.findBlockFilter(requestPath, mergedRequestPath)) {
+        auto const& flt = accessFilters.blockFilters()[*blockFilterID];
 
         // filter matches -> apply block
         setStatus(flt.status());
@@ -405,15 +667,9 @@ bool Connection::applyFilters(AccessFilterList const& accessFilters) {
         return true;
     }
 
-    // the ID is used to identify the exact filter for session cookie creation
-    int authFilterID = -1;
-    for (auto const& flt : accessFilters.authFilters()) {
-        ++authFilterID;
-
-        bool matches = flt.matches(requestPath);
-        if ((!matches && !flt.invert()) || (matches && flt.invert())) {
-            continue;
-        }
+    // check auth filters, the ID is used to identify the exact filter for session cookie creation
+    if (auto authFilterID = accessFilters.findAuthFilter(requestPath, mergedRequestPath)) {
+        auto const& flt = accessFilters.authFilters()[*authFilterID];
 
         bool isAuthenticated = false;
         string sessionVarKey;
@@ -421,7 +677,7 @@ bool Connection::applyFilters(AccessFilterList const& accessFilters) {
         // check session variable for this filter, if session usage is on
         if (flt.useSessions()) {
             data->session.start();
-            sessionVarKey = "_nawa_authfilter" + to_string(authFilterID);
+            sessionVarKey = "_nawa_authfilter" + to_string(*authFilterID);
             if (data->session.isSet(sessionVarKey)) {
                 isAuthenticated = true;
             }
@@ -479,30 +735,46 @@ bool Connection::applyFilters(AccessFilterList const& accessFilters) {
         }
 
         // if the user is authenticated, we can continue to process forward filters
-        break;
     }
 
     // check forward filters
-    for (auto const& flt : accessFilters.forwardFilters()) {
-        bool matches = flt.matches(requestPath);
-        if ((!matches && !flt.invert()) || (matches && flt.invert())) {
-            continue;
-        }
+    if (auto forwardFilterID = accessFilters.findForwardFilter(requestPath, mergedRequestPath)) {
+        auto const& flt = accessFilters.forwardFilters()[*forwardFilterID];
 
-        stringstream filePath;
-        filePath << flt.basePath();
+        auto filePath = flt.basePath();
         if (flt.basePathExtension() == ForwardFilter::BasePathExtension::BY_PATH) {
             for (auto const& e : requestPath) {
-                filePath << '/' << e;
+                filePath.append(1, '/').append(e);
             }
         } else {
-            filePath << '/' << requestPath.back();
+            filePath.append(1, '/').append(requestPath.back());
+        }
+
+        // serve the file from the static file cache, if enabled and the file can be cached
+        auto cache = getStaticFileCache(data->readConfig());
+        auto cacheEntry = cache ? cache->get(filePath) : nullptr;
+        if (cacheEntry) {
+            // the content type is also sent with a 304 response, instead of the default text/html
+            setHeader("content-type", cacheEntry->contentType);
+            setHeader("etag", cacheEntry->etag);
+            if (!cacheEntry->lastModified.empty()) {
+                setHeader("last-modified", cacheEntry->lastModified);
+            }
+            if (isNotModified(data->request.env(), cacheEntry->etag, cacheEntry->lastModifiedTime)) {
+                setStatus(304);
+                setResponseBody(string());
+                return true;
+            }
+            setHeader("content-length", to_string(cacheEntry->content.size()));
+            data->bodyString.clear();
+            data->file.reset();
+            data->sharedBody = shared_ptr<string const>(cacheEntry, &cacheEntry->content);
+            return true;
         }
 
         // send file if it exists, catch the "file does not exist" nawa::Exception and send 404 document if not
-        auto filePathStr = filePath.str();
         try {
-            sendFile(filePathStr, "", false, "", true);
+            sendFile(filePath, "", false, "", true);
         } catch (Exception&) {
             // file does not exist, send 404
             setStatus(404);
@@ -531,16 +803,36 @@ std::string FlushCallbackContainer::getStatusString() const {
     return hval.str();
 }
 
-std::string FlushCallbackContainer::getFullHttp() const {
-    stringstream raw;
+std::string FlushCallbackContainer::getHeaderString() const {
+    string raw;
     // include headers and cookies, but only when flushing for the first time
     if (!flushedBefore) {
-        // Add headers, incl. cookies, to the raw HTTP source
-        for (auto const& e : headers) {
-            raw << e.first << ": " << e.second << "\r\n";
+        for (auto const& [key, value] : headers) {
+            raw.append(key).append(": ").append(value).append("\r\n");
+        }
+        raw.append("\r\n");
+    }
+    return raw;
+}
+
+std::string FlushCallbackContainer::getFullHttp() const {
+    auto raw = getHeaderString();
+    raw.append(body);
+    return raw;
+}
+
+bool FlushCallbackContainer::forEachFileChunk(std::function<void(std::string_view)> const& callback,
+                                              size_t chunkSize) const {
+    if (!file) {
+        return true;
+    }
+    auto buffer = make_unique<char[]>(min(chunkSize, file->size));
+    for (size_t offset = 0; offset < file->size; offset += chunkSize) {
+        auto currentChunkSize = min(chunkSize, file->size - offset);
+        if (!preadFully(file->fd, buffer.get(), currentChunkSize, offset)) {
+            return false;
         }
-        raw << "\r\n";
+        callback(string_view(buffer.get(), currentChunkSize));
     }
-    raw << body;
-    return raw.str();
+    return true;
 }
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * \file StaticFileCache.cpp
+ * \brief Implementation of the StaticFileCache class.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <list>
+#include <mutex>
+#include <nawa/Exception.h>
+#include <nawa/connection/StaticFileCache.h>
+#include <nawa/oss.h>
+#include <nawa/util/utils.h>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    /**
+     * Properties of a file which are compared on revalidation to find out whether the file has been modified.
+     */
+    struct FileIdentity {
+        dev_t device = 0;
+        ino_t inode = 0;
+        off_t size = 0;
+        time_t lastModified = 0;
+
+        explicit FileIdentity(struct stat const& fileStat) : device(fileStat.st_dev), inode(fileStat.st_ino),
+                                                             size(fileStat.st_size),
+                                                             lastModified(oss::getLastModifiedTimeOfFile(fileStat)) {}
+
+        bool operator==(FileIdentity const& other) const {
+            return device == other.device && inode == other.inode && size == other.size &&
+                   lastModified == other.lastModified;
+        }
+    };
+
+    struct CachedFile {
+        string path;
+        shared_ptr<StaticFileCache::Entry const> entry;
+        FileIdentity identity;
+        chrono::steady_clock::time_point validatedAt;
+        uint64_t promotedAt; /**< Value of the promotion counter when the file was moved to the front of the list. */
+    };
+
+    /**
+     * Generate a strong ETag from the file content (64 bit FNV-1a hash and the length).
+     * @param content The file content.
+     * @return The ETag, including the quotes.
+     */
+    string generateEtag(string const& content) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : content) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        char etag[48];
+        snprintf(etag, sizeof etag, "\"%016llx-%llx\"", static_cast<unsigned long long>(hash),
+                 static_cast<unsigned long long>(content.size()));
+        return etag;
+    }
+
+    /**
+     * Open and read a file completely.
+     * @param path Path of the file.
+     * @param maxFileSize Maximum size of the file.
+     * @return The content and identity of the file, or nullopt if it cannot be read or is too large.
+     */
+    optional<pair<string, FileIdentity>> readFile(string const& path, size_t maxFileSize) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullopt;
+        }
+        struct stat fileStat {};
+        if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) ||
+            static_cast<size_t>(fileStat.st_size) > maxFileSize) {
+            close(fd);
+            return nullopt;
+        }
+        string content(fileStat.st_size, '\0');
+        size_t offset = 0;
+        while (offset < content.size()) {
+            auto bytesRead = read(fd, &content[offset], content.size() - offset);
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytesRead <= 0) {
+                break;
+            }
+            offset += bytesRead;
+        }
+        close(fd);
+        // the file has been truncated while reading, it will be read again on the next request
+        if (offset != content.size()) {
+            return nullopt;
+        }
+        return make_pair(std::move(content), FileIdentity(fileStat));
+    }
+}// namespace
+
+struct StaticFileCache::Data {
+    size_t capacity;
+    size_t maxFileSize;
+    chrono::steady_clock::duration revalidateInterval;
+
+    /**
+     * Lock for the cache. Hits on files near the front of the LRU list only need a shared lock, as they are not moved.
+     */
+    mutable shared_mutex lock;
+    list<CachedFile> lru; /**< Cached files, the most recently used one first. */
+    unordered_map<string, list<CachedFile>::iterator> index;
+    size_t usedBytes = 0;
+    uint64_t promotions = 0; /**< Number of files moved (or added) to the front of the LRU list so far. */
+
+    Data(size_t capacity, size_t maxFileSize, chrono::steady_clock::duration revalidateInterval)
+        : capacity(capacity), maxFileSize(maxFileSize), revalidateInterval(revalidateInterval) {}
+
+    /**
+     * Remove a file from the cache. Lock must be held.
+     * @param it Iterator to the file in the LRU list.
+     */
+    void erase(list<CachedFile>::iterator it) {
+        usedBytes -= it->entry->content.size();
+        index.erase(it->path);
+        lru.erase(it);
+    }
+
+    /**
+     * Move a file to the front of the LRU list. Exclusive lock must be held.
+     * @param it Iterator to the file in the LRU list.
+     */
+    void promote(list<CachedFile>::iterator it) {
+        lru.splice(lru.begin(), lru, it);
+        it->promotedAt = ++promotions;
+    }
+
+    /**
+     * Check whether a file is within the first quarter of the LRU list, as at most the files promoted after it can
+     * be in front of it. Such files are not moved on a hit, which makes the eviction order approximate. Lock must be
+     * held (shared or exclusive).
+     * @param file The file.
+     * @return True if the file is near the front.
+     */
+    [[nodiscard]] bool isNearFront(CachedFile const& file) const {
+        return promotions - file.promotedAt < max<size_t>(lru.size() / 4, 1);
+    }
+};
+
+NAWA_DEFAULT_DESTRUCTOR_IMPL(StaticFileCache)
+
+StaticFileCache::StaticFileCache(size_t capacity, size_t maxFileSize,
+                                 std::chrono::steady_clock::duration revalidateInterval) {
+    data = make_unique<Data>(capacity, maxFileSize, revalidateInterval);
+}
+
+std::shared_ptr<StaticFileCache::Entry const> StaticFileCache::get(std::string const& path) {
+    auto now = chrono::steady_clock::now();
+    {
+        shared_lock<shared_mutex> lockGuard(data->lock);
+        auto it = data->index.find(path);
+        if (it != data->index.end() && data->isNearFront(*it->second) &&
+            now - it->second->validatedAt < data->revalidateInterval) {
+            return it->second->entry;
+        }
+    }
+    optional<FileIdentity> cachedIdentity;
+    {
+        lock_guard<shared_mutex> lockGuard(data->lock);
+        auto it = data->index.find(path);
+        if (it != data->index.end()) {
+            if (!data->isNearFront(*it->second)) {
+                data->promote(it->second);
+            }
+            if (now - it->second->validatedAt < data->revalidateInterval) {
+                return it->second->entry;
+            }
+            cachedIdentity = it->second->identity;
+        }
+    }
+
+    // revalidate the cached file (without holding the lock)
+    struct stat fileStat {};
+    auto maxFileSize = min(data->maxFileSize, data->capacity);
+    // files which are too large are not even opened, they will be sent without the cache
+    bool cacheable = stat(path.c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode) &&
+                     static_cast<size_t>(fileStat.st_size) <= maxFileSize;
+    if (cachedIdentity && cacheable && FileIdentity(fileStat) == *cachedIdentity) {
+        lock_guard<shared_mutex> lockGuard(data->lock);
+        auto it = data->index.find(path);
+        if (it != data->index.end() && it->second->identity == *cachedIdentity) {
+            it->second->validatedAt = now;
+            return it->second->entry;
+        }
+    }
+
+    // (re)load the file
+    auto file = cacheable ? readFile(path, maxFileSize) : nullopt;
+    if (!file) {
+        lock_guard<shared_mutex> lockGuard(data->lock);
+        auto it = data->index.find(path);
+        if (it != data->index.end()) {
+            data->erase(it->second);
+        }
+        return nullptr;
+    }
+    auto entry = make_shared<Entry>();
+    entry->contentType = utils::contentTypeByExtension(utils::getFileExtension(path));
+    entry->etag = generateEtag(file->first);
+    entry->lastModifiedTime = file->second.lastModified;
+    try {
+        entry->lastModified = utils::makeHttpTime(entry->lastModifiedTime);
+    } catch (Exception const&) {}
+    entry->content = std::move(file->first);
+
+    lock_guard<shared_mutex> lockGuard(data->lock);
+    auto it = data->index.find(path);
+    if (it != data->index.end()) {
+        data->erase(it->second);
+    }
+    while (!data->lru.empty() && data->usedBytes + entry->content.size() > data->capacity) {
+        data->erase(prev(data->lru.end()));
+    }
+    data->lru.push_front(CachedFile{path, entry, file->second, now, ++data->promotions});
+    data->index.emplace(path, data->lru.begin());
+    data->usedBytes += entry->content.size();
+    return entry;
+}
+
+void StaticFileCache::clear() {
+    lock_guard<shared_mutex> lockGuard(data->lock);
+    data->lru.clear();
+    data->index.clear();
+    data->usedBytes = 0;
+}
+
+size_t StaticFileCache::size() const {
+    shared_lock<shared_mutex> lockGuard(data->lock);
+    return data->usedBytes;
+}
+
+size_t StaticFileCache::capacity() const {
+    return data->capacity;
+}
+
+size_t StaticFileCache::maxFileSize() const {
+    return data->maxFileSize;
+}
+
+std::chrono::steady_clock::duration StaticFileCache::revalidateInterval() const {
+    return data->revalidateInterval;
+}
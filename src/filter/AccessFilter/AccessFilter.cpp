@@ -23,7 +23,6 @@
 
 #include <nawa/filter/AccessFilter/AccessFilter.h>
 #include <nawa/util/utils.h>
-#include <sstream>
 
 using namespace nawa;
 using namespace std;
@@ -36,6 +35,7 @@ struct AccessFilter::Data {
     bool invertExtensionFilter = false;
     bool regexFilterEnabled = false;
     std::regex regexFilter;
+    std::string regexPattern; /**< Pattern of regexFilter, if it has been set as a pattern. */
     std::string response;
 };
 
@@ -63,11 +63,55 @@ NAWA_PRIMITIVE_DATA_ACCESSORS_IMPL(AccessFilter, invertExtensionFilter, bool)
 
 NAWA_PRIMITIVE_DATA_ACCESSORS_IMPL(AccessFilter, regexFilterEnabled, bool)
 
-NAWA_COMPLEX_DATA_ACCESSORS_IMPL(AccessFilter, regexFilter, regex)
+// the pattern is only known as long as the regex is set through the pattern setter
+
+std::regex& AccessFilter::regexFilter() noexcept {
+    data->regexPattern.clear();
+    return data->regexFilter;
+}
+
+std::regex const& AccessFilter::regexFilter() const noexcept {
+    return data->regexFilter;
+}
+
+AccessFilter& AccessFilter::regexFilter(std::regex value) noexcept {
+    data->regexFilter = std::move(value);
+    data->regexPattern.clear();
+    return *this;
+}
+
+AccessFilter& AccessFilter::regexFilter(std::string const& pattern) {
+    data->regexFilter = regex(pattern);
+    data->regexPattern = pattern;
+    return *this;
+}
+
+std::string const& AccessFilter::regexPattern() const noexcept {
+    return data->regexPattern;
+}
 
 NAWA_COMPLEX_DATA_ACCESSORS_IMPL(AccessFilter, response, string)
 
 bool nawa::AccessFilter::matches(std::vector<std::string> const& requestPath) const {
+    // the path string is only needed for regex filtering
+    return matches(requestPath, data->regexFilterEnabled ? mergeRequestPath(requestPath) : string());
+}
+
+bool nawa::AccessFilter::matches(std::vector<std::string> const& requestPath,
+                                 std::string const& mergedRequestPath) const {
+    if (!matchesPathAndExtension(requestPath)) {
+        return false;
+    }
+
+    if (data->regexFilterEnabled && !regex_match(mergedRequestPath, data->regexFilter)) {
+        return false;
+    }
+
+    // all conditions match or no condition has been set -> the filter matches
+    return true;
+}
+
+bool nawa::AccessFilter::matchesPathAndExtension(std::vector<std::string> const& requestPath) const {
     if (!data->pathFilter.empty()) {
         // one of the paths in the path filter must match for the path filter to match
         bool pathFilterMatches = false;
@@ -107,19 +151,21 @@ bool nawa::AccessFilter::matches(std::vector<std::string> const& requestPath) co
             (extensionFilterMatches && data->invertExtensionFilter)) {
             return false;
         }
-        // extension condition matches -> continue to the next filter condition
-    }
-
-    if (data->regexFilterEnabled) {
-        // merge request path to string
-        stringstream pathStr;
-        for (auto const& e : requestPath) {
-            pathStr << '/' << e;
-        }
-        if (!regex_match(pathStr.str(), data->regexFilter))
-            return false;
+        // extension condition matches
     }
 
-    // all conditions match or no condition has been set -> the filter matches
     return true;
 }
+
+std::string nawa::AccessFilter::mergeRequestPath(std::vector<std::string> const& requestPath) {
+    size_t length = 0;
+    for (auto const& e : requestPath) {
+        length += e.size() + 1;
+    }
+    string ret;
+    ret.reserve(length);
+    for (auto const& e : requestPath) {
+        ret.append(1, '/').append(e);
+    }
+    return ret;
+}
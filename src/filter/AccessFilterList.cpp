@@ -21,16 +21,284 @@
  * \brief Implementation of the AccessFilterList class.
  */
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <nawa/filter/AccessFilterList.h>
+#include <nawa/util/utils.h>
+#include <regex>
+#include <unordered_map>
 
 using namespace nawa;
 using namespace std;
 
+namespace {
+    /**
+     * The regexes of all regex filters of a list which have been set as patterns (see AccessFilter::regexFilter()),
+     * combined into one alternation with one group per filter, so that a request path is matched against all of them
+     * in one pass.
+     */
+    class CombinedRegex {
+        regex combined;
+        vector<size_t> positions;             /**< Position of every filter in members, or SIZE_MAX. */
+        vector<pair<size_t, size_t>> members; /**< Filter index and group in the combined regex, in filter order. */
+
+    public:
+        template<typename FilterType>
+        explicit CombinedRegex(vector<FilterType> const& filters) : positions(filters.size(), SIZE_MAX) {
+            // the groups are renumbered in the combined regex, so patterns with back-references are matched separately
+            regex const backReference(R"(\\[1-9])");
+            string pattern;
+            size_t group = 1;
+            for (size_t i = 0; i < filters.size(); ++i) {
+                auto const& flt = filters[i];
+                if (!flt.regexFilterEnabled() || flt.regexPattern().empty() ||
+                    regex_search(flt.regexPattern(), backReference)) {
+                    continue;
+                }
+                if (!members.empty()) {
+                    pattern += '|';
+                }
+                pattern.append(1, '(').append(flt.regexPattern()).append(1, ')');
+                positions[i] = members.size();
+                members.emplace_back(i, group);
+                group += flt.regexFilter().mark_count() + 1;
+            }
+            if (!members.empty()) {
+                combined = regex(pattern, regex::ECMAScript | regex::optimize);
+            }
+        }
+
+        /**
+         * Get the position of a filter in the combined regex.
+         * @param filterIndex Index of the filter in the list.
+         * @return The position, or nullopt if the regex of the filter has to be matched separately.
+         */
+        [[nodiscard]] optional<size_t> position(size_t filterIndex) const {
+            return positions[filterIndex] != SIZE_MAX ? optional<size_t>(positions[filterIndex]) : nullopt;
+        }
+
+        /**
+         * Match the request path against the combined regex. As the first matching alternative is taken, the regexes
+         * of the filters before the returned position do not match, and those after it are unknown.
+         * @param mergedRequestPath The request path as a string.
+         * @return Position of the first filter whose regex matches, or the number of combined filters if none does.
+         */
+        [[nodiscard]] size_t firstMatch(string const& mergedRequestPath) const {
+            smatch match;
+            if (!regex_match(mergedRequestPath, match, combined)) {
+                return members.size();
+            }
+            for (size_t i = 0; i < members.size(); ++i) {
+                if (match[members[i].second].matched) {
+                    return i;
+                }
+            }
+            return members.size();
+        }
+    };
+
+    /**
+     * Index over a list of filters, which yields a (small) superset of the filters that may apply to a request path:
+     * filters with a (non-inverted) path filter are found through a prefix tree over the filter paths, filters with
+     * only a (non-inverted) extension filter through a hash map over the extensions, and all other filters (inverted
+     * filters and filters without such conditions) are always checked. The candidate lists are sorted when the index
+     * is built, so that a lookup does not have to allocate or sort anything.
+     */
+    class FilterIndex {
+        struct Node {
+            unordered_map<string, unique_ptr<Node>> children;
+            vector<size_t> filters;    /**< Filters with a filter path ending at this node. */
+            vector<size_t> candidates; /**< Always checked filters and filters of this node and its ancestors. */
+        };
+
+        Node root;
+        unordered_map<string, vector<size_t>> byExtension;
+
+        /**
+         * Merge two sorted lists of filter indices.
+         * @param a First list.
+         * @param b Second list.
+         * @return The merged list, without duplicates.
+         */
+        static vector<size_t> merge(vector<size_t> const& a, vector<size_t> const& b) {
+            vector<size_t> ret;
+            ret.reserve(a.size() + b.size());
+            set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(ret));
+            ret.erase(unique(ret.begin(), ret.end()), ret.end());
+            return ret;
+        }
+
+        /**
+         * Compute the candidate lists of a node and all of its descendants.
+         * @param node The node.
+         * @param inherited The candidates of the parent node.
+         */
+        static void computeCandidates(Node& node, vector<size_t> const& inherited) {
+            sort(node.filters.begin(), node.filters.end());
+            node.candidates = merge(inherited, node.filters);
+            for (auto& child : node.children) {
+                computeCandidates(*child.second, node.candidates);
+            }
+        }
+
+    public:
+        CombinedRegex regexes;
+
+        template<typename FilterType>
+        explicit FilterIndex(vector<FilterType> const& filters) : regexes(filters) {
+            vector<size_t> alwaysChecked;
+            for (size_t i = 0; i < filters.size(); ++i) {
+                auto const& flt = filters[i];
+                if (flt.invert()) {
+                    alwaysChecked.push_back(i);
+                } else if (!flt.pathFilter().empty() && !flt.invertPathFilter()) {
+                    for (auto const& path : flt.pathFilter()) {
+                        Node* node = &root;
+                        for (auto const& element : path) {
+                            auto& child = node->children[element];
+                            if (!child) {
+                                child = make_unique<Node>();
+                            }
+                            node = child.get();
+                        }
+                        node->filters.push_back(i);
+                    }
+                } else if (!flt.extensionFilter().empty() && !flt.invertExtensionFilter()) {
+                    for (auto const& extension : flt.extensionFilter()) {
+                        byExtension[extension].push_back(i);
+                    }
+                } else {
+                    alwaysChecked.push_back(i);
+                }
+            }
+            computeCandidates(root, alwaysChecked);
+            for (auto& extension : byExtension) {
+                extension.second.erase(unique(extension.second.begin(), extension.second.end()),
+                                       extension.second.end());
+            }
+        }
+
+        /**
+         * Find the first of the filters which may apply to the given request path that satisfies a predicate.
+         * @param requestPath The request path.
+         * @param predicate Predicate called with the candidate filter indices in ascending order (without
+         * duplicates), until it returns true.
+         * @return Index of the first candidate satisfying the predicate, or nullopt if there is none.
+         */
+        template<typename Predicate>
+        optional<size_t> findCandidate(vector<string> const& requestPath, Predicate predicate) const {
+            Node const* node = &root;
+            for (auto const& element : requestPath) {
+                auto it = node->children.find(element);
+                if (it == node->children.end()) {
+                    break;
+                }
+                node = it->second.get();
+            }
+            static vector<size_t> const none;
+            auto const* extensionCandidates = &none;
+            if (!byExtension.empty() && !requestPath.empty()) {
+                auto it = byExtension.find(utils::getFileExtension(requestPath.back()));
+                if (it != byExtension.end()) {
+                    extensionCandidates = &it->second;
+                }
+            }
+            // merge the two sorted lists on the fly
+            auto a = node->candidates.begin(), aEnd = node->candidates.end();
+            auto b = extensionCandidates->begin(), bEnd = extensionCandidates->end();
+            while (a != aEnd || b != bEnd) {
+                size_t next;
+                if (b == bEnd || (a != aEnd && *a < *b)) {
+                    next = *a++;
+                } else if (a == aEnd || *b < *a) {
+                    next = *b++;
+                } else {
+                    next = *a++;
+                    ++b;
+                }
+                if (predicate(next)) {
+                    return next;
+                }
+            }
+            return nullopt;
+        }
+    };
+
+    /**
+     * Find the first filter applying to the request path (i.e., which matches, or does not match if it is inverted),
+     * using the index if available.
+     * @param filters The list of filters.
+     * @param index The index for the list of filters, or nullptr if the filters have not been compiled.
+     * @param requestPath The request path.
+     * @param mergedRequestPath The request path as a string (for regex filters), or nullptr if it should be created
+     * when needed.
+     * @return Index of the first filter applying, or nullopt if no filter applies.
+     */
+    template<typename FilterType>
+    optional<size_t> findFilter(vector<FilterType> const& filters, FilterIndex const* index,
+                                vector<string> const& requestPath, string const* mergedRequestPath) {
+        // the path string is created at most once, and only if a regex filter has to be checked
+        optional<string> ownMergedRequestPath;
+        auto getMergedRequestPath = [&]() -> string const& {
+            if (!mergedRequestPath) {
+                ownMergedRequestPath = AccessFilter::mergeRequestPath(requestPath);
+                mergedRequestPath = &*ownMergedRequestPath;
+            }
+            return *mergedRequestPath;
+        };
+        // the combined regex is matched at most once as well
+        optional<size_t> firstRegexMatch;
+        auto applies = [&](size_t i) {
+            auto const& flt = filters[i];
+            if (!flt.regexFilterEnabled()) {
+                return flt.matchesPathAndExtension(requestPath) != flt.invert();
+            }
+            auto position = index ? index->regexes.position(i) : nullopt;
+            if (position) {
+                if (!firstRegexMatch) {
+                    firstRegexMatch = index->regexes.firstMatch(getMergedRequestPath());
+                }
+                if (*position <= *firstRegexMatch) {
+                    bool regexMatches = *position == *firstRegexMatch;
+                    return (regexMatches && flt.matchesPathAndExtension(requestPath)) != flt.invert();
+                }
+            }
+            return flt.matches(requestPath, getMergedRequestPath()) != flt.invert();
+        };
+        if (index) {
+            return index->findCandidate(requestPath, applies);
+        }
+        for (size_t i = 0; i < filters.size(); ++i) {
+            if (applies(i)) {
+                return i;
+            }
+        }
+        return nullopt;
+    }
+
+    /**
+     * The compiled indices of all filter lists. Immutable after construction, so it can be shared between copies.
+     */
+    struct CompiledFilters {
+        FilterIndex blockFilters;
+        FilterIndex authFilters;
+        FilterIndex forwardFilters;
+        bool hasRegexFilters;
+    };
+
+    template<typename FilterType>
+    bool hasRegexFilter(vector<FilterType> const& filters) {
+        return any_of(filters.begin(), filters.end(), [](FilterType const& flt) { return flt.regexFilterEnabled(); });
+    }
+}// namespace
+
 struct AccessFilterList::Data {
     bool filtersEnabled = false;
     vector<BlockFilter> blockFilters;
     vector<AuthFilter> authFilters;
     vector<ForwardFilter> forwardFilters;
+    shared_ptr<CompiledFilters const> compiled;
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL(AccessFilterList)
@@ -47,8 +315,103 @@ NAWA_MOVE_ASSIGNMENT_OPERATOR_IMPL(AccessFilterList)
 
 NAWA_PRIMITIVE_DATA_ACCESSORS_IMPL(AccessFilterList, filtersEnabled, bool)
 
-NAWA_COMPLEX_DATA_ACCESSORS_IMPL(AccessFilterList, blockFilters, vector<BlockFilter>)
+// the non-const accessors of the filter lists discard the compiled index, as the filters may be modified through them
+
+std::vector<BlockFilter>& AccessFilterList::blockFilters() noexcept {
+    data->compiled.reset();
+    return data->blockFilters;
+}
+
+std::vector<BlockFilter> const& AccessFilterList::blockFilters() const noexcept {
+    return data->blockFilters;
+}
+
+AccessFilterList& AccessFilterList::blockFilters(std::vector<BlockFilter> value) noexcept {
+    data->compiled.reset();
+    data->blockFilters = std::move(value);
+    return *this;
+}
+
+std::vector<AuthFilter>& AccessFilterList::authFilters() noexcept {
+    data->compiled.reset();
+    return data->authFilters;
+}
+
+std::vector<AuthFilter> const& AccessFilterList::authFilters() const noexcept {
+    return data->authFilters;
+}
+
+AccessFilterList& AccessFilterList::authFilters(std::vector<AuthFilter> value) noexcept {
+    data->compiled.reset();
+    data->authFilters = std::move(value);
+    return *this;
+}
+
+std::vector<ForwardFilter>& AccessFilterList::forwardFilters() noexcept {
+    data->compiled.reset();
+    return data->forwardFilters;
+}
+
+std::vector<ForwardFilter> const& AccessFilterList::forwardFilters() const noexcept {
+    return data->forwardFilters;
+}
+
+AccessFilterList& AccessFilterList::forwardFilters(std::vector<ForwardFilter> value) noexcept {
+    data->compiled.reset();
+    data->forwardFilters = std::move(value);
+    return *this;
+}
+
+void AccessFilterList::compile() {
+    data->compiled = make_shared<CompiledFilters const>(CompiledFilters{FilterIndex(data->blockFilters),
+                                                                        FilterIndex(data->authFilters),
+                                                                        FilterIndex(data->forwardFilters),
+                                                                        hasRegexFilter(data->blockFilters) ||
+                                                                                hasRegexFilter(data->authFilters) ||
+                                                                                hasRegexFilter(data->forwardFilters)});
+}
+
+bool AccessFilterList::isCompiled() const noexcept {
+    return data->compiled != nullptr;
+}
+
+bool AccessFilterList::hasRegexFilters() const noexcept {
+    if (data->compiled) {
+        return data->compiled->hasRegexFilters;
+    }
+    return hasRegexFilter(data->blockFilters) || hasRegexFilter(data->authFilters) ||
+           hasRegexFilter(data->forwardFilters);
+}
+
+std::optional<size_t> AccessFilterList::findBlockFilter(std::vector<std::string> const& requestPath) const {
+    return findFilter(data->blockFilters, data->compiled ? &data->compiled->blockFilters : nullptr, requestPath,
+                      nullptr);
+}
+
+std::optional<size_t> AccessFilterList::findBlockFilter(std::vector<std::string> const& requestPath,
+                                                        std::string const& mergedRequestPath) const {
+    return findFilter(data->blockFilters, data->compiled ? &data->compiled->blockFilters : nullptr, requestPath,
+                      &mergedRequestPath);
+}
+
+std::optional<size_t> AccessFilterList::findAuthFilter(std::vector<std::string> const& requestPath) const {
+    return findFilter(data->authFilters, data->compiled ? &data->compiled->authFilters : nullptr, requestPath,
+                      nullptr);
+}
+
+std::optional<size_t> AccessFilterList::findAuthFilter(std::vector<std::string> const& requestPath,
+                                                       std::string const& mergedRequestPath) const {
+    return findFilter(data->authFilters, data->compiled ? &data->compiled->authFilters : nullptr, requestPath,
+                      &mergedRequestPath);
+}
 
-NAWA_COMPLEX_DATA_ACCESSORS_IMPL(AccessFilterList, authFilters, vector<AuthFilter>)
+std::optional<size_t> AccessFilterList::findForwardFilter(std::vector<std::string> const& requestPath) const {
+    return findFilter(data->forwardFilters, data->compiled ? &data->compiled->forwardFilters : nullptr,
+                      requestPath, nullptr);
+}
 
-NAWA_COMPLEX_DATA_ACCESSORS_IMPL(AccessFilterList, forwardFilters, vector<ForwardFilter>)
+std::optional<size_t> AccessFilterList::findForwardFilter(std::vector<std::string> const& requestPath,
+                                                          std::string const& mergedRequestPath) const {
+    return findFilter(data->forwardFilters, data->compiled ? &data->compiled->forwardFilters : nullptr,
+                      requestPath, &mergedRequestPath);
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file AccessLog.cpp
+ * \brief Implementation of the access log functions.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <nawa/Exception.h>
+#include <nawa/logging/AccessLog.h>
+#include <nawa/util/AtomicSnapshot.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace nawa;
+using namespace std;
+
+std::atomic<bool> accesslog::internal::enabled{false};
+
+namespace {
+    static_assert(atomic<uint64_t>::is_always_lock_free, "The access log requires lock-free atomics.");
+
+    constexpr uint64_t fileMagic = 0x6e617761616c6f67ULL; /**< "nawaalog" */
+    constexpr uint32_t layoutVersion = 1;
+    constexpr uint64_t blockSize = 16; /**< Number of slots reserved by a thread at a time. */
+
+    /**
+     * Header at the beginning of the file.
+     */
+    struct alignas(64) FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t slotSize;
+        uint64_t slotCount;
+        atomic<uint64_t> next; /**< Sequence number of the next slot to be reserved. */
+    };
+
+    /**
+     * A record slot. The sequence field is 0 while the slot is being written and is set to the sequence number of the
+     * record plus one afterwards, readers copy the record and skip it if the sequence field has changed in the
+     * meantime.
+     */
+    struct Slot {
+        atomic<uint64_t> sequence;
+        uint64_t timestamp;
+        uint64_t duration;
+        uint64_t bytes;
+        uint32_t thread;
+        uint16_t status;
+        uint8_t methodLength;
+        uint8_t pathLength;
+        char method[accesslog::MAX_METHOD_LENGTH];
+        char path[accesslog::MAX_PATH_LENGTH];
+    };
+    static_assert(sizeof(FileHeader) == 64 && sizeof(Slot) == 256, "Unexpected access log layout.");
+    static_assert(accesslog::MAX_PATH_LENGTH <= UINT8_MAX, "Path length must fit into the slot.");
+
+    atomic<uint64_t> nextFileId{1};
+
+    /**
+     * A mapped access log file, unmapped on destruction.
+     */
+    struct MappedFile {
+        uint64_t id = nextFileId++; /**< Unique ID, used by the threads to detect that their reserved slots are stale. */
+        char* base;
+        size_t size;
+
+        MappedFile(char* base, size_t size) : base(base), size(size) {}
+
+        MappedFile(MappedFile const&) = delete;
+
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        ~MappedFile() {
+            munmap(base, size);
+        }
+
+        [[nodiscard]] FileHeader& header() const {
+            return *reinterpret_cast<FileHeader*>(base);
+        }
+
+        [[nodiscard]] Slot& slot(uint64_t sequence) const {
+            return reinterpret_cast<Slot*>(base + sizeof(FileHeader))[sequence % header().slotCount];
+        }
+
+        /**
+         * Check whether the header describes a file of the mapped size with the current layout.
+         */
+        [[nodiscard]] bool isValid() const {
+            auto const& h = header();
+            return size >= sizeof(FileHeader) && h.magic == fileMagic && h.version == layoutVersion &&
+                   h.slotSize == sizeof(Slot) && h.slotCount > 0 && size == sizeof(FileHeader) + h.slotCount * sizeof(Slot);
+        }
+    };
+
+    /**
+     * The currently open file (nullptr if closed), read for every record.
+     */
+    AtomicSnapshot<shared_ptr<MappedFile const>> currentFile;
+
+    mutex openLock; /**< Serializes open() and close(). */
+
+    atomic<uint32_t> threadCount{0};
+
+    /**
+     * Slots reserved by the current thread, [nextSequence, blockEnd) in the file with ID fileId.
+     */
+    struct ThreadSlots {
+        uint32_t thread = ++threadCount;
+        uint64_t fileId = 0;
+        uint64_t nextSequence = 0;
+        uint64_t blockEnd = 0;
+    };
+    thread_local ThreadSlots threadSlots;
+
+    /**
+     * Map an access log file into memory.
+     * @param fd File descriptor of the file, will be closed.
+     * @param size Size of the file.
+     * @param writable Whether the file is mapped for writing.
+     * @return The mapped file.
+     */
+    shared_ptr<MappedFile> mapFile(int fd, size_t size, bool writable) {
+        void* base = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        auto mapError = errno;
+        close(fd);
+        if (base == MAP_FAILED) {
+            throw Exception(__PRETTY_FUNCTION__, 1, "Could not map access log file.", strerror(mapError));
+        }
+        return make_shared<MappedFile>(static_cast<char*>(base), size);
+    }
+}// namespace
+
+void accesslog::open(string const& path, size_t capacity) {
+    uint64_t slotCount = max<uint64_t>(blockSize, (capacity + blockSize - 1) / blockSize * blockSize);
+    size_t size = sizeof(FileHeader) + slotCount * sizeof(Slot);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not open access log file.", strerror(errno));
+    }
+
+    // a new (empty) file is extended, a file of a different size is replaced by a new one: other processes might have
+    // mapped it, and shrinking it would make their accesses fail with SIGBUS
+    struct stat fdStat {};
+    if (fstat(fd, &fdStat) != 0) {
+        auto error = errno;
+        ::close(fd);
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not open access log file.", strerror(error));
+    }
+    string tempPath;
+    if (fdStat.st_size > 0 && static_cast<size_t>(fdStat.st_size) != size) {
+        ::close(fd);
+        tempPath = path + ".XXXXXX";
+        fd = mkostemp(tempPath.data(), O_CLOEXEC);
+        if (fd < 0) {
+            throw Exception(__PRETTY_FUNCTION__, 1, "Could not create access log file.", strerror(errno));
+        }
+        fchmod(fd, 0640);
+    }
+    if (static_cast<size_t>(fdStat.st_size) != size && ftruncate(fd, size) != 0) {
+        auto error = errno;
+        ::close(fd);
+        if (!tempPath.empty()) {
+            unlink(tempPath.c_str());
+        }
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not resize access log file.", strerror(error));
+    }
+    shared_ptr<MappedFile> file;
+    try {
+        file = mapFile(fd, size, true);
+    } catch (Exception&) {
+        if (!tempPath.empty()) {
+            unlink(tempPath.c_str());
+        }
+        throw;
+    }
+
+    // continue an existing file, reinitialize everything else
+    if (!file->isValid()) {
+        memset(file->base, 0, size);
+        auto& header = file->header();
+        header.magic = fileMagic;
+        header.version = layoutVersion;
+        header.slotSize = sizeof(Slot);
+        header.slotCount = slotCount;
+    }
+    if (!tempPath.empty() && rename(tempPath.c_str(), path.c_str()) != 0) {
+        auto error = errno;
+        unlink(tempPath.c_str());
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not replace access log file.", strerror(error));
+    }
+
+    lock_guard lockGuard(openLock);
+    currentFile.update([&](shared_ptr<MappedFile const>& current) {
+        current = std::move(file);
+    });
+    internal::enabled.store(true, memory_order_relaxed);
+}
+
+void accesslog::close() {
+    lock_guard lockGuard(openLock);
+    internal::enabled.store(false, memory_order_relaxed);
+    currentFile.update([](shared_ptr<MappedFile const>& current) {
+        current.reset();
+    });
+}
+
+void accesslog::record(string_view method, string_view path, unsigned int status, uint64_t bytes,
+                       chrono::steady_clock::duration duration) noexcept {
+    if (!enabled()) {
+        return;
+    }
+    auto guard = currentFile.read();
+    auto const& file = *guard;
+    if (!file) {
+        return;
+    }
+
+    // reserve a new block of slots if the reserved ones are used up, belong to another file, or might already have
+    // been overwritten by other threads in the meantime (so that no thread writes into a slot written by another one)
+    auto& slots = threadSlots;
+    auto& header = file->header();
+    if (slots.fileId != file->id || slots.nextSequence == slots.blockEnd ||
+        header.next.load(memory_order_relaxed) - slots.nextSequence > header.slotCount - blockSize) {
+        slots.fileId = file->id;
+        slots.nextSequence = header.next.fetch_add(blockSize, memory_order_relaxed);
+        slots.blockEnd = slots.nextSequence + blockSize;
+    }
+    auto sequence = slots.nextSequence++;
+
+    auto& slot = file->slot(sequence);
+    slot.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.timestamp = chrono::duration_cast<chrono::microseconds>(
+                             chrono::system_clock::now().time_since_epoch())
+                             .count();
+    slot.duration = chrono::duration_cast<chrono::microseconds>(duration).count();
+    slot.bytes = bytes;
+    slot.thread = slots.thread;
+    slot.status = static_cast<uint16_t>(status);
+    slot.methodLength = static_cast<uint8_t>(min(method.size(), MAX_METHOD_LENGTH));
+    memcpy(slot.method, method.data(), slot.methodLength);
+    slot.pathLength = static_cast<uint8_t>(min(path.size(), MAX_PATH_LENGTH));
+    memcpy(slot.path, path.data(), slot.pathLength);
+    slot.sequence.store(sequence + 1, memory_order_release);
+}
+
+vector<accesslog::Entry> accesslog::read(string const& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not open access log file.", strerror(errno));
+    }
+    struct stat fdStat {};
+    if (fstat(fd, &fdStat) != 0 || static_cast<size_t>(fdStat.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        throw Exception(__PRETTY_FUNCTION__, 2, "Not an access log file.");
+    }
+    auto file = mapFile(fd, fdStat.st_size, false);
+    if (!file->isValid()) {
+        throw Exception(__PRETTY_FUNCTION__, 2, "Not an access log file.");
+    }
+
+    vector<Entry> entries;
+    auto slotCount = file->header().slotCount;
+    for (uint64_t i = 0; i < slotCount; ++i) {
+        auto const& slot = file->slot(i);
+        auto sequence = slot.sequence.load(memory_order_acquire);
+        if (sequence == 0 || (sequence - 1) % slotCount != i) {
+            continue;
+        }
+        Entry entry;
+        entry.sequence = sequence - 1;
+        entry.timestamp = slot.timestamp;
+        entry.duration = slot.duration;
+        entry.bytes = slot.bytes;
+        entry.status = slot.status;
+        entry.thread = slot.thread;
+        entry.method.assign(slot.method, min<size_t>(slot.methodLength, MAX_METHOD_LENGTH));
+        entry.path.assign(slot.path, min<size_t>(slot.pathLength, MAX_PATH_LENGTH));
+        atomic_thread_fence(memory_order_acquire);
+        if (slot.sequence.load(memory_order_relaxed) == sequence) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) {
+        return a.timestamp != b.timestamp ? a.timestamp < b.timestamp : a.sequence < b.sequence;
+    });
+    return entries;
+}
@@ -22,15 +22,25 @@
  */
 
 #include <atomic>
-#include <iomanip>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
 #include <mutex>
 #include <nawa/Exception.h>
 #include <nawa/logging/Log.h>
 #include <nawa/oss.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 using namespace nawa;
 using namespace std;
 
+std::atomic<int> nawa::internal::logOutputLevel{static_cast<int>(Log::Level::INFORMATIONAL)};
+
 namespace {
     struct DestructionDetector {
         bool destructed = false;
@@ -39,16 +49,469 @@ namespace {
     } destructionDetector;
 
     bool locked = false;                                /**< If true, the stream and outfile cannot be changed anymore. */
-    ostream* out;                                       /**< Stream to send the logging output to. */
-    ofstream logFile;                                   /**< Log file handle in case a file is used and managed by this class. */
-    Log::Level outputLevel = Log::Level::INFORMATIONAL; /**< Output log level. */
+    ostream* out = nullptr;                             /**< Stream to send the logging output to, if not written to outFd. */
+    int outFd = STDERR_FILENO;                          /**< File descriptor to send the logging output to (if out is nullptr). */
+    int logFileFd = -1;                                 /**< Log file descriptor in case a file is used and managed by this class. */
+    string logFileName;                                 /**< Path of the log file, for reopening it. */
     bool extendedFormat = false;                        /**< Use the extended, systemd-style logging. */
     unique_ptr<string> hostnameStr;
     pid_t pid = 0;
     atomic_uint instanceCount(0);
     mutex outLock;
+
+    /**
+     * Close the log file (if one is used) and write to stderr again.
+     */
+    void closeLogFile() {
+        if (logFileFd >= 0) {
+            close(logFileFd);
+            logFileFd = -1;
+            logFileName.clear();
+        }
+        outFd = STDERR_FILENO;
+    }
+
+    /**
+     * Get the timestamp for the extended format. It is only generated once per second and thread, as localtime_r is
+     * comparatively expensive.
+     * @return Reference to the timestamp, valid in the current thread until the next call.
+     */
+    string const& currentTimestamp() {
+        thread_local time_t cachedTime = -1;
+        thread_local string cachedTimestamp;
+        auto now = time(nullptr);
+        if (now != cachedTime) {
+            tm localTime{};
+            char buf[32];
+            localtime_r(&now, &localTime);
+            cachedTimestamp.assign(buf, strftime(buf, sizeof buf, "%b %d %H:%M:%S ", &localTime));
+            cachedTime = now;
+        }
+        return cachedTimestamp;
+    }
+
+    /**
+     * Write messages to the output, either with (as few as possible) writev calls to the output file descriptor, or
+     * to the output stream. The caller must hold outLock.
+     * @param messages Pointer to the first message. Messages must include the line break.
+     * @param count Number of messages.
+     */
+    void writeMessages(string const* messages, size_t count) {
+        if (out) {
+            for (size_t i = 0; i < count; ++i) {
+                out->write(messages[i].data(), static_cast<streamsize>(messages[i].size()));
+            }
+            out->flush();
+            return;
+        }
+        vector<iovec> iov;
+        iov.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            iov.push_back({const_cast<char*>(messages[i].data()), messages[i].size()});
+        }
+        size_t next = 0;
+        while (next < iov.size()) {
+            auto count = static_cast<int>(min(iov.size() - next, static_cast<size_t>(IOV_MAX)));
+            auto written = writev(outFd, &iov[next], count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            // skip what has been written, the last iovec might have been written partially
+            auto remaining = static_cast<size_t>(written);
+            while (next < iov.size() && remaining >= iov[next].iov_len) {
+                remaining -= iov[next].iov_len;
+                ++next;
+            }
+            if (remaining > 0) {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + remaining;
+                iov[next].iov_len -= remaining;
+            }
+        }
+    }
+
+    /**
+     * Ring buffer for log messages of one thread (single producer, single consumer). Rings are never freed, but
+     * reused by new threads after their thread has terminated.
+     */
+    struct alignas(64) MessageRing {
+        vector<string> slots;
+        alignas(64) atomic<size_t> head{0}; /**< Next slot to be read by the writer thread. */
+        alignas(64) atomic<size_t> tail{0}; /**< Next slot to be written by the owning thread. */
+        bool active = true;                 /**< Guarded by AsyncWriter::ringsLock. */
+        uint64_t generation;                /**< Guarded by AsyncWriter::ringsLock. */
+
+        MessageRing(size_t capacity, uint64_t generation) : slots(capacity), generation(generation) {}
+
+        /**
+         * Add a message to the ring (only called by the owning thread).
+         * @param message The message, will be moved from if there is space.
+         * @return False if the ring is full.
+         */
+        bool push(string& message) {
+            auto t = tail.load(memory_order_relaxed);
+            if (t - head.load(memory_order_acquire) == slots.size()) {
+                return false;
+            }
+            slots[t % slots.size()] = std::move(message);
+            tail.store(t + 1, memory_order_seq_cst);
+            return true;
+        }
+
+        /**
+         * Move all available messages out of the ring (only called by the writer thread).
+         * @param messages Vector to append the messages to.
+         */
+        void drain(vector<string>& messages) {
+            auto h = head.load(memory_order_relaxed);
+            auto t = tail.load(memory_order_acquire);
+            for (auto i = h; i != t; ++i) {
+                messages.push_back(std::move(slots[i % slots.size()]));
+            }
+            head.store(t, memory_order_release);
+        }
+
+        [[nodiscard]] bool empty() const {
+            return head.load(memory_order_relaxed) == tail.load(memory_order_seq_cst);
+        }
+    };
+
+    class AsyncWriter;
+
+    AsyncWriter& asyncWriter();
+
+    /**
+     * Background thread writing the messages of all threads in batches (async mode).
+     */
+    class AsyncWriter {
+        mutex ringsLock;
+        vector<unique_ptr<MessageRing>> rings; /**< Guarded by ringsLock. */
+        atomic<uint64_t> generation{0};        /**< Incremented on every start (with ringsLock held). */
+        size_t capacity = 0;
+        atomic<Log::OverflowPolicy> overflowPolicy{Log::OverflowPolicy::DROP};
+
+        thread writerThread;
+        atomic<bool> running{false};
+        atomic<bool> sleeping{false};
+        atomic<uint64_t> dropped{0};
+        mutex wakeLock;
+        condition_variable wakeCondition;
+        condition_variable flushedCondition;
+        uint64_t flushRequested = 0; /**< Guarded by wakeLock. */
+        uint64_t flushDone = 0;      /**< Guarded by wakeLock. */
+        bool stopRequested = false;  /**< Guarded by wakeLock. */
+
+        /**
+         * Owns the ring of the current thread and releases it when the thread terminates.
+         */
+        struct RingOwner {
+            MessageRing* ring = nullptr;
+            uint64_t generation = 0;
+
+            ~RingOwner() {
+                if (ring) {
+                    auto& writer = asyncWriter();
+                    lock_guard<mutex> lockGuard(writer.ringsLock);
+                    writer.release(ring, generation);
+                }
+            }
+        };
+
+        MessageRing* ringOfCurrentThread() {
+            thread_local RingOwner owner;
+            if (owner.ring && owner.generation == generation.load(memory_order_acquire)) {
+                return owner.ring;
+            }
+            lock_guard<mutex> lockGuard(ringsLock);
+            if (owner.ring) {
+                release(owner.ring, owner.generation);
+            }
+            owner.generation = generation;
+            for (auto& ring : rings) {
+                if ((!ring->active || ring->generation != generation) && ring->slots.size() == capacity &&
+                    ring->empty()) {
+                    ring->active = true;
+                    ring->generation = generation;
+                    owner.ring = ring.get();
+                    return owner.ring;
+                }
+            }
+            rings.push_back(make_unique<MessageRing>(capacity, generation));
+            owner.ring = rings.back().get();
+            return owner.ring;
+        }
+
+        /**
+         * Mark a ring as unused. The caller must hold ringsLock.
+         * @param ring The ring.
+         * @param ringGeneration The generation the ring has been acquired in.
+         */
+        void release(MessageRing* ring, uint64_t ringGeneration) {
+            if (ring->generation == ringGeneration) {
+                ring->active = false;
+            }
+        }
+
+        /**
+         * Write all pending messages.
+         * @return Number of messages written.
+         */
+        size_t drain() {
+            vector<string> messages;
+            {
+                lock_guard<mutex> lockGuard(ringsLock);
+                for (auto& ring : rings) {
+                    ring->drain(messages);
+                }
+            }
+            if (auto droppedMessages = dropped.exchange(0, memory_order_relaxed)) {
+                messages.push_back("[nawa] " + to_string(droppedMessages) +
+                                   " log messages have been dropped, as the log buffer was full\n");
+            }
+            if (!messages.empty()) {
+                lock_guard<mutex> lockGuard(outLock);
+                writeMessages(messages.data(), messages.size());
+            }
+            return messages.size();
+        }
+
+        bool pending() {
+            lock_guard<mutex> lockGuard(ringsLock);
+            for (auto& ring : rings) {
+                if (!ring->empty()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void wake() {
+            lock_guard<mutex> lockGuard(wakeLock);
+            wakeCondition.notify_one();
+        }
+
+        void run() {
+            while (true) {
+                uint64_t requested;
+                bool stopping;
+                {
+                    lock_guard<mutex> lockGuard(wakeLock);
+                    requested = flushRequested;
+                    stopping = stopRequested;
+                }
+                while (drain() > 0) {}
+                unique_lock<mutex> lockGuard(wakeLock);
+                if (requested > flushDone) {
+                    flushDone = requested;
+                    flushedCondition.notify_all();
+                }
+                if (stopping) {
+                    return;
+                }
+                if (flushRequested != requested || stopRequested) {
+                    continue;
+                }
+                // producers check this flag after adding a message, the timeout is just a safety net
+                sleeping.store(true, memory_order_seq_cst);
+                if (!pending()) {
+                    wakeCondition.wait_for(lockGuard, chrono::milliseconds(100));
+                }
+                sleeping.store(false, memory_order_relaxed);
+            }
+        }
+
+    public:
+        [[nodiscard]] bool isRunning() const {
+            return running.load(memory_order_acquire);
+        }
+
+        void start(Log::OverflowPolicy policy, size_t bufferSize) {
+            stop();
+            {
+                lock_guard<mutex> lockGuard(ringsLock);
+                ++generation;
+                capacity = max(bufferSize, size_t(1));
+                overflowPolicy = policy;
+            }
+            {
+                lock_guard<mutex> lockGuard(wakeLock);
+                stopRequested = false;
+            }
+            running.store(true, memory_order_release);
+            writerThread = thread([this] { run(); });
+        }
+
+        void stop() {
+            if (!writerThread.joinable()) {
+                return;
+            }
+            {
+                lock_guard<mutex> lockGuard(wakeLock);
+                stopRequested = true;
+                wakeCondition.notify_one();
+            }
+            running.store(false, memory_order_release);
+            writerThread.join();
+            // messages which have been added while stopping
+            while (drain() > 0) {}
+        }
+
+        void flush() {
+            if (!isRunning()) {
+                return;
+            }
+            unique_lock<mutex> lockGuard(wakeLock);
+            auto target = ++flushRequested;
+            wakeCondition.notify_one();
+            flushedCondition.wait(lockGuard, [&] { return flushDone >= target || stopRequested; });
+        }
+
+        /**
+         * Queue a message.
+         * @param message The message.
+         * @return False if the message could not be queued as the writer is not running.
+         */
+        bool push(string& message) {
+            auto ring = ringOfCurrentThread();
+            while (!ring->push(message)) {
+                if (!isRunning()) {
+                    return false;
+                }
+                if (overflowPolicy.load(memory_order_relaxed) == Log::OverflowPolicy::DROP) {
+                    dropped.fetch_add(1, memory_order_relaxed);
+                    return true;
+                }
+                wake();
+                this_thread::yield();
+            }
+            if (!isRunning()) {
+                // the writer has been stopped in the meantime and might already have done its final drain
+                while (drain() > 0) {}
+            } else if (sleeping.load(memory_order_seq_cst)) {
+                wake();
+            }
+            return true;
+        }
+    };
+
+    AsyncWriter& asyncWriter() {
+        // intentionally leaked: static Log objects might still log (and stop the writer) after the destruction of
+        // function-local statics, the writer thread is stopped by the destructor of the last Log object instead
+        static auto writer = new AsyncWriter;
+        return *writer;
+    }
+
+    /**
+     * Write a message synchronously or pass it to the writer thread.
+     * @param message The message, including the line break.
+     */
+    void output(string& message) {
+        auto& writer = asyncWriter();
+        if (writer.isRunning() && writer.push(message)) {
+            return;
+        }
+        lock_guard<mutex> lockGuard(outLock);
+        writeMessages(&message, 1);
+    }
 }// namespace
 
+/**
+ * Buffer of a MessageFormatter: a string and a stream writing directly into it.
+ */
+struct Log::MessageFormatter::Buffer {
+    class StringStreamBuf : public streambuf {
+        string& target;
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                target.push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+        streamsize xsputn(char const* s, streamsize n) override {
+            target.append(s, n);
+            return n;
+        }
+
+    public:
+        explicit StringStreamBuf(string& target) : target(target) {}
+    };
+
+    string message;
+    StringStreamBuf streamBuf{message};
+    ostream stream{&streamBuf};
+
+    /**
+     * The buffers of the current thread, used as a stack.
+     */
+    struct ThreadBuffers {
+        vector<unique_ptr<Buffer>> buffers;
+        size_t used = 0;
+    };
+
+    static ThreadBuffers& threadBuffers() {
+        thread_local ThreadBuffers threadBuffers;
+        return threadBuffers;
+    }
+};
+
+Log::MessageFormatter::MessageFormatter() {
+    auto& threadBuffers = Buffer::threadBuffers();
+    if (threadBuffers.used == threadBuffers.buffers.size()) {
+        threadBuffers.buffers.push_back(make_unique<Buffer>());
+    }
+    buffer = threadBuffers.buffers[threadBuffers.used++].get();
+}
+
+Log::MessageFormatter::~MessageFormatter() {
+    // keep the capacity of the string for the next message, unless it has grown very large
+    if (buffer->message.capacity() > 64 * 1024) {
+        string().swap(buffer->message);
+    } else {
+        buffer->message.clear();
+    }
+    buffer->stream.clear();
+    --Buffer::threadBuffers().used;
+}
+
+std::ostream& Log::MessageFormatter::stream() noexcept {
+    return buffer->stream;
+}
+
+std::string const& Log::MessageFormatter::str() const noexcept {
+    return buffer->message;
+}
+
+bool Log::MessageFormatter::appendUntilPlaceholder(std::string_view& fmt) {
+    auto& message = buffer->message;
+    size_t pos = 0;
+    while (pos < fmt.size()) {
+        auto next = fmt.find_first_of("{}", pos);
+        if (next == string_view::npos) {
+            break;
+        }
+        message.append(fmt.substr(pos, next - pos));
+        if (next + 1 < fmt.size() && fmt[next + 1] == fmt[next]) {
+            // escaped brace
+            message.push_back(fmt[next]);
+            pos = next + 2;
+        } else if (fmt[next] == '{' && next + 1 < fmt.size() && fmt[next + 1] == '}') {
+            fmt.remove_prefix(next + 2);
+            return true;
+        } else {
+            message.push_back(fmt[next]);
+            pos = next + 1;
+        }
+    }
+    message.append(fmt.substr(pos));
+    fmt = {};
+    return false;
+}
+
 struct Log::Data {
     string appname;     /**< Name of the current app, appears in brackets in the log. */
     Level defaultLevel; /**< Default log level of this logger object. */
@@ -60,7 +523,8 @@ Log::Log() noexcept {
     data = make_unique<Data>(Level::INFORMATIONAL);
 
     if (instanceCount == 0) {
-        out = &cerr;
+        out = nullptr;
+        outFd = STDERR_FILENO;
 
         // get hostname
         hostnameStr = make_unique<string>(oss::getSystemHostname());
@@ -101,41 +565,69 @@ Log::~Log() {
     if (!destructionDetector.destructed) {
         --instanceCount;
         if (instanceCount == 0) {
-            if (logFile.is_open()) {
-                logFile.close();
-            }
+            asyncWriter().stop();
+            closeLogFile();
             locked = false;
         }
     } else {
-        if (logFile.is_open()) {
-            logFile.close();
+        // static objects (like logFileName) might already have been destroyed, the writer is never destroyed
+        if (--instanceCount == 0) {
+            asyncWriter().stop();
+        }
+        if (logFileFd >= 0) {
+            close(logFileFd);
+            logFileFd = -1;
+            outFd = STDERR_FILENO;
         }
     }
 }
 
 void Log::setStream(std::ostream* os) noexcept {
     if (!locked) {
-        out = os;
+        // stderr is unbuffered, so it can be written to directly
+        closeLogFile();
+        out = (os == &cerr) ? nullptr : os;
     }
 }
 
 void Log::setOutfile(std::string const& filename) {
     if (!locked) {
-        if (logFile.is_open()) {
-            logFile.close();
-        }
-        logFile.open(filename, ofstream::out | ofstream::app);
-        if (!logFile) {
+        int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0) {
             throw Exception(__PRETTY_FUNCTION__, 1,
                             "Failed to open requested file for writing.");
         }
-        out = &logFile;
+        closeLogFile();
+        logFileFd = fd;
+        logFileName = filename;
+        out = nullptr;
+        outFd = fd;
     }
 }
 
+void Log::reopen() {
+    if (logFileFd < 0) {
+        return;
+    }
+    int fd = open(logFileName.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Failed to reopen the log file.", strerror(errno));
+    }
+    // replace the file behind logFileFd, writes which are in progress still go to the old file
+    while (dup2(fd, logFileFd) < 0) {
+        if (errno != EINTR && errno != EBUSY) {
+            auto error = errno;
+            close(fd);
+            throw Exception(__PRETTY_FUNCTION__, 1, "Failed to replace the log file.", strerror(error));
+        }
+    }
+    close(fd);
+    fcntl(logFileFd, F_SETFD, FD_CLOEXEC);
+}
+
 void Log::setOutputLevel(Level level) {
     if (!locked) {
-        outputLevel = level;
+        internal::logOutputLevel.store(static_cast<int>(level), memory_order_relaxed);
     }
 }
 
@@ -145,6 +637,20 @@ void Log::setExtendedFormat(bool useExtendedFormat) {
     }
 }
 
+void Log::setAsync(bool async, OverflowPolicy overflowPolicy, size_t bufferSize) {
+    if (!locked) {
+        if (async) {
+            asyncWriter().start(overflowPolicy, bufferSize);
+        } else {
+            asyncWriter().stop();
+        }
+    }
+}
+
+void Log::flush() {
+    asyncWriter().flush();
+}
+
 void Log::lockStream() noexcept {
     locked = true;
 }
@@ -161,20 +667,33 @@ void Log::setDefaultLogLevel(Level level) noexcept {
     data->defaultLevel = level;
 }
 
+Log::Level Log::getDefaultLogLevel() const noexcept {
+    return data->defaultLevel;
+}
+
 void Log::write(std::string const& msg) {
     write(msg, data->defaultLevel);
 }
 
 void Log::write(std::string const& msg, Level level) {
-    if (level <= outputLevel && outputLevel != Level::OFF && level != Level::OFF) {
-        auto now = time(nullptr);
-        lock_guard<mutex> l(outLock);
+    if (isEnabled(level)) {
+        string message;
+        message.reserve(data->appname.size() + msg.size() + 4);
         if (extendedFormat) {
-            *out << put_time(localtime(&now), "%b %d %H:%M:%S ") << *hostnameStr << ' '
-                 << oss::getProgramInvocationName() << '[' << pid << "]: ";
+            message += currentTimestamp();
+            message += *hostnameStr;
+            message += ' ';
+            message += oss::getProgramInvocationName();
+            message += '[';
+            message += to_string(pid);
+            message += "]: ";
         }
-        cerr << "[" << data->appname << "] " << msg << endl;
-        out->flush();
+        message += '[';
+        message += data->appname;
+        message += "] ";
+        message += msg;
+        message += '\n';
+        output(message);
     }
 }
 
@@ -29,6 +29,7 @@
 #include <nawa/RequestHandler/RequestHandler.h>
 #include <nawa/application.h>
 #include <nawa/config/Config.h>
+#include <nawa/logging/AccessLog.h>
 #include <nawa/logging/Log.h>
 #include <nawa/oss.h>
 #include <nawa/util/utils.h>
@@ -174,9 +175,46 @@ namespace {
         } else if (configuredLogLevel == "debug") {
             Log::setOutputLevel(Log::Level::DEBUG);
         }
+        if (!config[{"logging", "file"}].empty()) {
+            try {
+                Log::setOutfile(config[{"logging", "file"}]);
+            } catch (Exception const& e) {
+                NLOG_ERROR(logger, "ERROR: Could not open log file, logging to stderr: " << e.getMessage())
+            }
+        }
         if (config[{"logging", "extended"}] == "on") {
             Log::setExtendedFormat(true);
         }
+        if (config[{"logging", "async"}] == "on") {
+            size_t bufferSize = 1024;
+            try {
+                if (config.isSet({"logging", "async_buffer"})) {
+                    bufferSize = stoul(config[{"logging", "async_buffer"}]);
+                }
+            } catch (logic_error const&) {
+                NLOG_WARNING(logger, "WARNING: Invalid value given for logging/async_buffer given in the config file.")
+            }
+            Log::setAsync(true,
+                          config[{"logging", "async_overflow"}] == "block" ? Log::OverflowPolicy::BLOCK
+                                                                            : Log::OverflowPolicy::DROP,
+                          bufferSize);
+        }
+        if (!config[{"logging", "access_log"}].empty()) {
+            size_t accessLogRecords = 65536;
+            try {
+                if (config.isSet({"logging", "access_log_records"})) {
+                    accessLogRecords = stoul(config[{"logging", "access_log_records"}]);
+                }
+            } catch (logic_error const&) {
+                NLOG_WARNING(logger, "WARNING: Invalid value given for logging/access_log_records given in the config file.")
+            }
+            try {
+                accesslog::open(config[{"logging", "access_log"}], accessLogRecords);
+            } catch (Exception const& e) {
+                NLOG_ERROR(logger, "ERROR: Could not open the access log: " << e.getMessage())
+                NLOG_DEBUG(logger, "Debug info: " << e.getDebugMessage())
+            }
+        }
         Log::lockStream();
     }
 }// namespace
@@ -227,6 +265,14 @@ pair<init_t*, shared_ptr<HandleRequestFunctionWrapper>> nawarun::loadAppFunction
 }
 
 void nawarun::reload(int signum) {
+    // reopen the log file first (e.g., after logrotate has moved it), so that the following messages end up in the
+    // new file
+    try {
+        Log::reopen();
+    } catch (Exception const& e) {
+        NLOG_ERROR(logger, "ERROR: Could not reopen log file: " << e.getMessage())
+    }
+
     if (!configFile) {
         NLOG_WARNING(logger, "WARNING: Reloading is not supported without config file and will therefore not "
                              "happen.")
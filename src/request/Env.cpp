@@ -31,23 +31,34 @@ using namespace std;
 
 struct request::Env::Data {
     unordered_map<string, string> environment;
+    vector<string> requestPath; /**< The request path, split once on construction. */
 
-    explicit Data(RequestInitContainer const& initContainer) : environment(initContainer.environment) {}
+    explicit Data(unordered_map<string, string> environment) : environment(std::move(environment)) {
+        auto requestUri = this->environment.find("REQUEST_URI");
+        if (requestUri != this->environment.end()) {
+            requestPath = utils::splitPath(requestUri->second);
+        }
+    }
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL_WITH_NS(request, Env)
 
 request::Env::Env(RequestInitContainer const& initContainer) {
-    data = make_unique<Data>(initContainer);
+    data = make_unique<Data>(initContainer.environment);
+}
+
+request::Env::Env(RequestInitContainer&& initContainer) {
+    data = make_unique<Data>(std::move(initContainer.environment));
 }
 
 std::string request::Env::operator[](std::string const& envVar) const {
-    if (data->environment.count(envVar)) {
-        return data->environment.at(envVar);
+    auto it = data->environment.find(envVar);
+    if (it != data->environment.end()) {
+        return it->second;
     }
     return {};
 }
 
-std::vector<std::string> request::Env::getRequestPath() const {
-    return utils::splitPath(operator[]("REQUEST_URI"));
+std::vector<std::string> const& request::Env::getRequestPath() const {
+    return data->requestPath;
 }
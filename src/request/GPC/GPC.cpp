@@ -51,6 +51,21 @@ request::GPC::GPC(RequestInitContainer const& requestInit, Source source) {
     }
 }
 
+request::GPC::GPC(RequestInitContainer&& requestInit, Source source) {
+    data = make_unique<Data>(source);
+
+    switch (source) {
+        case Source::COOKIE:
+            data->dataMap = std::move(requestInit.cookieVars);
+            break;
+        case Source::POST:
+            data->dataMap = std::move(requestInit.postVars);
+            break;
+        default:
+            data->dataMap = std::move(requestInit.getVars);
+    }
+}
+
 std::string request::GPC::operator[](std::string const& gpcVar) const {
     auto e = data->dataMap.find(gpcVar);
     if (e != data->dataMap.end())
@@ -32,15 +32,22 @@ struct request::Post::Data {
     std::shared_ptr<std::string> rawPost;
     std::unordered_multimap<std::string, File> fileMap;
 
-    explicit Data(RequestInitContainer const& requestInit) : contentType(requestInit.postContentType),
-                                                             rawPost(requestInit.rawPost),
-                                                             fileMap(requestInit.postFiles) {}
+    Data(std::string contentType, std::shared_ptr<std::string> rawPost,
+         std::unordered_multimap<std::string, File> fileMap) : contentType(std::move(contentType)),
+                                                               rawPost(std::move(rawPost)),
+                                                               fileMap(std::move(fileMap)) {}
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL_WITH_NS(request, Post)
 
 request::Post::Post(RequestInitContainer const& requestInit) : GPC(requestInit, GPC::Source::POST) {
-    data = make_unique<Data>(requestInit);
+    data = make_unique<Data>(requestInit.postContentType, requestInit.rawPost, requestInit.postFiles);
+}
+
+// the GPC constructor only moves the POST variables, so the other members can still be moved here
+request::Post::Post(RequestInitContainer&& requestInit) : GPC(std::move(requestInit), GPC::Source::POST) {
+    data = make_unique<Data>(std::move(requestInit.postContentType), std::move(requestInit.rawPost),
+                             std::move(requestInit.postFiles));
 }
 
 request::Post::operator bool() const {
@@ -37,6 +37,13 @@ struct Request::Data {
                                                                get(initContainer, request::GPC::Source::GET),
                                                                post(initContainer),
                                                                cookie(initContainer, request::GPC::Source::COOKIE) {}
+
+    // every member only moves its own part out of the container
+    explicit Data(RequestInitContainer&& initContainer) : env(std::move(initContainer)),
+                                                          get(std::move(initContainer), request::GPC::Source::GET),
+                                                          post(std::move(initContainer)),
+                                                          cookie(std::move(initContainer),
+                                                                 request::GPC::Source::COOKIE) {}
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL(Request)
@@ -45,6 +52,10 @@ Request::Request(RequestInitContainer const& initContainer) {
     data = make_unique<Data>(initContainer);
 }
 
+Request::Request(RequestInitContainer&& initContainer) {
+    data = make_unique<Data>(std::move(initContainer));
+}
+
 request::Env const& nawa::Request::env() const noexcept {
     return data->env;
 }
@@ -25,79 +25,93 @@
 #include <nawa/Exception.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/session/Session.h>
+#include <nawa/session/SessionStore/impl/MemorySessionStore.h>
+#include <nawa/session/SessionStore/impl/SharedMemorySessionStore.h>
 #include <nawa/util/crypto.h>
 #include <random>
+#include <utility>
 
 using namespace nawa;
 using namespace std;
 
 namespace {
     /**
-     * SessionData objects contain all data of one session.
+     * The session store used by all Session objects. Created by getStore() on first use, unless set via
+     * Session::setStore(). Must only be accessed through atomic_load and atomic_store.
      */
-    struct SessionData {
-        mutex dLock;                     /**< Lock for data. */
-        mutex eLock;                     /**< Lock for expires.  */
-        unordered_map<string, any> data; /**< Map containing all values of this session. */
-        time_t expires;                  /**< Time when this session expires. */
-        const string sourceIP;           /**< IP address of the session initiator, for optional IP checking. */
-
-        /**
-         * Construct an empty SessionData object without a source IP.
-         */
-        SessionData() : expires(0) {}
-
-        /**
-         * Construct an empty SessionData object with a source IP.
-         * @param sIP IP address of the session initiator.
-         */
-        explicit SessionData(string sIP) : expires(0), sourceIP(std::move(sIP)) {}
-    };
-
-    mutex gLock; /**< Lock for data. */
-    /**
-    * Map containing (pointers to) the session data for all sessions. The key is the session ID string.
-    */
-    unordered_map<string, shared_ptr<SessionData>> sessionData;
+    shared_ptr<session::SessionStore> sessionStore;
+    mutex storeCreationLock; /**< Prevents concurrent creation of the session store in getStore(). */
+
+    // config keys accessed on every session start
+    Config::Key const keepaliveKey({"session", "keepalive"});
+    Config::Key const validateIpKey({"session", "validate_ip"});
+    Config::Key const gcDivisorKey({"session", "gc_divisor"});
+    Config::Key const cookieNameKey({"session", "cookie_name"});
+    Config::Key const cookieExpiresKey({"session", "cookie_expires"});
+    Config::Key const cookieSecureKey({"session", "cookie_secure"});
+    Config::Key const cookieHttpOnlyKey({"session", "cookie_httponly"});
+    Config::Key const cookieSameSiteKey({"session", "cookie_samesite"});
 
     /**
-     * Generate a random, 40 chars session ID.
-     * @param remoteAddress Remote address, which will be part of the random input.
-     * @return The session ID.
+     * Decide whether to run inline garbage collection, which should happen in 1/divisor of all calls. This does not
+     * need cryptographic randomness, so a cheap per-thread PRNG (seeded once per thread) is used.
+     * @param divisor The divisor.
+     * @return True if garbage collection should run now.
      */
-    string generateID(string const& remoteAddress) {
-        stringstream base;
-
-        // Add 2 ints from random_device (should be in fact /dev/urandom), giving us (in general) 64 bits of entropy
-        random_device rd;
-        base << rd() << rd();
-
-        // Add client IP
-        base << remoteAddress;
+    bool gcDue(unsigned long divisor) {
+        thread_local minstd_rand gcDice([] {
+            uint32_t seed;
+            crypto::randomBytes(reinterpret_cast<unsigned char*>(&seed), sizeof seed);
+            return seed;
+        }());
+        return gcDice() % divisor == 0;
+    }
 
-        // Calculate and return hex-formatted SHA1
-        return crypto::sha1(base.str(), true);
+    /**
+     * Read an unsigned integer from the config.
+     * @param config The config.
+     * @param key The config key.
+     * @param defaultValue Value to use if the key is not set or invalid.
+     * @return The value.
+     */
+    unsigned long readConfigNumber(Config const& config, pair<string, string> const& key, unsigned long defaultValue) {
+        auto valueStr = config[key];
+        if (valueStr.empty()) {
+            return defaultValue;
+        }
+        try {
+            return stoul(valueStr);
+        } catch (logic_error const& e) {
+            return defaultValue;
+        }
     }
 
     /**
-     * Garbage collection by removing every expired session from the data map.
-     * Would be best if run async and in fixed intervals (or with 0.xx chance on certain session actions -> see php)
+     * Get the session store, creating it according to the config if it does not exist yet.
+     * @param config The config.
+     * @return Pointer to the session store.
      */
-    void collectGarbage() {
-        lock_guard<mutex> lockGuard(gLock);
-        // no increment in for statement as we want to remove elements
-        for (auto it = sessionData.cbegin(); it != sessionData.cend();) {
-            bool toDelete = false;
-            {
-                lock_guard<mutex> eGuard(it->second->eLock);
-                toDelete = (it->second->expires < time(nullptr));
-            }
-            if (toDelete) {
-                it = sessionData.erase(it);
+    shared_ptr<session::SessionStore> getStore(Config const& config) {
+        auto store = atomic_load(&sessionStore);
+        if (store) {
+            return store;
+        }
+        lock_guard<mutex> lockGuard(storeCreationLock);
+        store = atomic_load(&sessionStore);
+        if (!store) {
+            if (config[{"session", "store"}] == "shm") {
+                auto name = config[{"session", "shm_name"}];
+                store = make_shared<session::SharedMemorySessionStore>(
+                        name.empty() ? "/nawa_sessions" : name,
+                        readConfigNumber(config, {"session", "shm_slots"}, 4096),
+                        readConfigNumber(config, {"session", "shm_slot_size"}, 4096));
             } else {
-                ++it;
+                store = make_shared<session::MemorySessionStore>(config[{"session", "gc_mode"}] == "background",
+                                                                 config[{"session", "snapshot_file"}]);
             }
+            atomic_store(&sessionStore, store);
         }
+        return store;
     }
 }// namespace
 
@@ -108,11 +122,19 @@ struct Session::Data {
      * Can be used to check whether a session is established by checking shared_ptr::use_count()
      * (used by established()).
      */
-    std::shared_ptr<SessionData> currentData;
+    std::shared_ptr<session::SessionStore::Handle> currentData;
+    std::shared_ptr<session::SessionStore> store; /**< The session store, as determined by start(). */
     std::string currentID;  /**< The current session ID. */
     std::string cookieName; /**< Name of the session cookie, as determined by start(). */
 
     explicit Data(Connection& connection) : connection(connection) {}
+
+    /**
+     * Read the config of the connection (through the const overload, so that the connection does not copy it).
+     */
+    [[nodiscard]] Config const& config() const {
+        return as_const(connection).config();
+    }
 };
 
 NAWA_DEFAULT_DESTRUCTOR_IMPL(Session)
@@ -131,78 +153,55 @@ std::string Session::start(std::string sessionId, std::optional<unsigned long> k
     }
 
     // session duration
-    unsigned long sessionKeepalive = 1800;
-    if (keepalive) {
-        sessionKeepalive = *keepalive;
-    } else {
-        auto sessionKStr = data->connection.config()[{"session", "keepalive"}];
-        if (!sessionKStr.empty()) {
-            try {
-                sessionKeepalive = stoul(sessionKStr);
-            } catch (invalid_argument& e) {
-                sessionKeepalive = 1800;
-            }
-        }
-    }
+    unsigned long sessionKeepalive = keepalive ? *keepalive
+                                               : data->config().getNumber(keepaliveKey).value_or(1800);
+
+    data->store = getStore(data->config());
 
     if (!sessionId.empty()) {
         // check for validity
-        // global data map may be accessed concurrently by different threads
-        lock_guard<mutex> lockGuard(gLock);
-        if (sessionData.count(sessionId) == 1) {
+        auto sessionData = data->store->find(sessionId);
+        if (sessionData) {
             // read validate_ip setting from config (needed a few lines later)
-            auto sessionValidateIP = data->connection.config()[{"session", "validate_ip"}];
+            auto const& sessionValidateIP = data->config()[validateIpKey];
             // session already expired?
-            if (sessionData.at(sessionId)->expires <= time(nullptr)) {
-                sessionData.erase(sessionId);
+            if (sessionData->expires() <= time(nullptr)) {
+                data->store->remove(sessionId);
             }
             // validate_ip enabled in NAWA config and IP mismatch?
             else if ((sessionValidateIP == "strict" || sessionValidateIP == "lax") &&
-                     sessionData.at(sessionId)->sourceIP != data->connection.request().env()["REMOTE_ADDR"]) {
+                     sessionData->sourceIP() != data->connection.request().env()["REMOTE_ADDR"]) {
                 if (sessionValidateIP == "strict") {
                     // in strict mode, session has to be invalidated
-                    sessionData.erase(sessionId);
+                    data->store->remove(sessionId);
                 }
             }
             // session is valid
             else {
-                data->currentData = sessionData.at(sessionId);
+                data->currentData = std::move(sessionData);
                 // reset expiry
-                lock_guard<mutex> currentLock(data->currentData->eLock);
-                data->currentData->expires = time(nullptr) + sessionKeepalive;
+                data->currentData->expires(time(nullptr) + sessionKeepalive);
             }
         }
     }
     // if currentData not yet set (sessionCookieStr empty or invalid) -> initiate new session
-    if (data->currentData.use_count() < 1) {
-        // generate new session ID string (and check for duplicate - should not really occur)
-        lock_guard<mutex> lockGuard(gLock);
-        do {
-            sessionId = generateID(data->connection.request().env()["REMOTE_ADDR"]);
-        } while (sessionData.count(sessionId) > 0);
-        data->currentData = make_shared<SessionData>(data->connection.request().env()["REMOTE_ADDR"]);
-        data->currentData->expires = time(nullptr) + sessionKeepalive;
-        sessionData[sessionId] = data->currentData;
+    if (!data->currentData) {
+        auto remoteAddress = data->connection.request().env()["REMOTE_ADDR"];
+        // generate new session ID (256 random bits, base64url-encoded) and check for duplicates (should not occur)
+        while (!data->currentData) {
+            sessionId = crypto::randomToken();
+            data->currentData = data->store->create(sessionId, remoteAddress, time(nullptr) + sessionKeepalive);
+        }
     }
 
     // save the ID so we can invalidate the session
     data->currentID = sessionId;
 
-    // run garbage collection in 1/x of invocations
-    unsigned long divisor;
-    try {
-        auto divisorStr = data->connection.config()[{"session", "gc_divisor"}];
-        if (!divisorStr.empty()) {
-            divisor = stoul(divisorStr);
-        } else {
-            divisor = 100;
+    // run garbage collection in 1/x of invocations, unless the store takes care of it
+    if (!data->store->collectsGarbageInBackground()) {
+        if (gcDue(data->config().getNumber(gcDivisorKey).value_or(100))) {
+            data->store->collectGarbage();
         }
-    } catch (invalid_argument const& e) {
-        divisor = 100;
-    }
-    random_device rd;
-    if (rd() % divisor == 0) {
-        collectGarbage();
     }
 
     return sessionId;
@@ -214,25 +213,15 @@ void Session::start(Cookie properties) {
         return;
 
     // get name of session cookie from config
-    data->cookieName = data->connection.config()[{"session", "cookie_name"}];
+    data->cookieName = data->config()[cookieNameKey];
     if (data->cookieName.empty()) {
         data->cookieName = "SESSION";
     }
 
     // session duration
-    unsigned long sessionKeepalive = 1800;
-    if (properties.maxAge()) {
-        sessionKeepalive = *properties.maxAge();
-    } else {
-        auto sessionKStr = data->connection.config()[{"session", "keepalive"}];
-        if (!sessionKStr.empty()) {
-            try {
-                sessionKeepalive = stoul(sessionKStr);
-            } catch (invalid_argument& e) {
-                sessionKeepalive = 1800;
-            }
-        }
-    }
+    unsigned long sessionKeepalive = properties.maxAge()
+                                             ? *properties.maxAge()
+                                             : data->config().getNumber(keepaliveKey).value_or(1800);
 
     // the session ID may be given in a session cookie, if not, the string will be empty
     // Session::start will use the session, if present, and return a valid session ID
@@ -240,7 +229,7 @@ void Session::start(Cookie properties) {
 
     // set the response cookie and its properties according to the Cookie parameter or the NAWA config
     string cookieExpiresStr;
-    if (properties.expires() || data->connection.config()[{"session", "cookie_expires"}] != "off") {
+    if (properties.expires() || data->config().getSwitch(cookieExpiresKey) != false) {
         properties.expires(time(nullptr) + sessionKeepalive)
                 .maxAge(sessionKeepalive);
     } else {
@@ -248,14 +237,14 @@ void Session::start(Cookie properties) {
         properties.maxAge(nullopt);
     }
 
-    if (!properties.secure() && data->connection.config()[{"session", "cookie_secure"}] != "off") {
+    if (!properties.secure() && data->config().getSwitch(cookieSecureKey) != false) {
         properties.secure(true);
     }
-    if (!properties.httpOnly() && data->connection.config()[{"session", "cookie_httponly"}] != "off") {
+    if (!properties.httpOnly() && data->config().getSwitch(cookieHttpOnlyKey) != false) {
         properties.httpOnly(true);
     }
     if (properties.sameSite() == Cookie::SameSite::OFF) {
-        auto sessionSameSite = data->connection.config()[{"session", "cookie_samesite"}];
+        auto const& sessionSameSite = data->config()[cookieSameSiteKey];
         if (sessionSameSite == "lax") {
             properties.sameSite(Cookie::SameSite::LAX);
         } else if (sessionSameSite != "off") {
@@ -272,42 +261,44 @@ void Session::start(Cookie properties) {
 }
 
 bool Session::established() const {
-    return (data->currentData.use_count() > 0);
+    return data->currentData != nullptr;
 }
 
 bool Session::isSet(std::string const& key) const {
     if (established()) {
-        lock_guard<mutex> lockGuard(data->currentData->dLock);
-        return (data->currentData->data.count(key) == 1);
+        return data->currentData->isSet(key);
     }
     return false;
 }
 
 std::any Session::operator[](std::string const& key) const {
     if (established()) {
-        lock_guard<mutex> lockGuard(data->currentData->dLock);
-        if (data->currentData->data.count(key) == 1) {
-            return data->currentData->data.at(key);
-        }
+        return data->currentData->get(key);
     }
     return {};
 }
 
+Session::View Session::view() const {
+    if (established()) {
+        return View(data->currentData->values());
+    }
+    static auto const emptyValues = make_shared<session::SessionStore::ValueMap const>();
+    return View(emptyValues);
+}
+
 // doxygen bug requires std:: here
 void Session::set(std::string key, std::any const& value) {
     if (!established()) {
         throw Exception(__PRETTY_FUNCTION__, 1, "Session not established.");
     }
-    lock_guard<mutex> lockGuard(data->currentData->dLock);
-    data->currentData->data[std::move(key)] = value;
+    data->currentData->set(std::move(key), value);
 }
 
 void Session::unset(std::string const& key) {
     if (!established()) {
         throw Exception(__PRETTY_FUNCTION__, 1, "Session not established.");
     }
-    lock_guard<mutex> lockGuard(data->currentData->dLock);
-    data->currentData->data.erase(key);
+    data->currentData->unset(key);
 }
 
 void Session::invalidate() {
@@ -319,11 +310,8 @@ void Session::invalidate() {
     // reset currentData pointer, this will also make established() return false
     data->currentData.reset();
 
-    // erase this session from the data map
-    {
-        lock_guard<mutex> lockGuard(gLock);
-        sessionData.erase(data->currentID);
-    }
+    // erase this session from the store
+    data->store->remove(data->currentID);
 
     // unset the session cookie, so that a new session can be started
     data->connection.unsetCookie(data->cookieName);
@@ -333,6 +321,16 @@ std::string Session::getID() const {
     return established() ? data->currentID : string();
 }
 
+void Session::setStore(std::shared_ptr<session::SessionStore> store) {
+    atomic_store(&sessionStore, std::move(store));
+}
+
 void Session::destroy() {
-    sessionData.clear();
+    // the store persists its sessions (if it supports that) now, as its destructor must not rely on anything else;
+    // destroying the store stops its background threads (if any) and frees the data of all sessions that are not
+    // currently in use
+    auto store = atomic_exchange(&sessionStore, shared_ptr<session::SessionStore>());
+    if (store) {
+        store->shutdown();
+    }
 }
@@ -0,0 +1,524 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file MemorySessionStore.cpp
+ * \brief Implementation of the MemorySessionStore class.
+ */
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <nawa/Exception.h>
+#include <nawa/logging/Log.h>
+#include <nawa/session/SessionStore/impl/MemorySessionStore.h>
+#include <nawa/session/ValueRegistry.h>
+#include <queue>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    Log logger("session");
+
+    using ValueMap = session::SessionStore::ValueMap;
+
+    /**
+     * SessionData objects contain all data of one session.
+     */
+    struct SessionData : public session::SessionStore::Handle {
+        mutable mutex dLock; /**< Serializes writers of data. */
+        /**
+         * Immutable map containing all values of this session. Only accessed via atomic_load and atomic_store:
+         * readers just grab the current map, while writers (holding dLock) copy it, modify the copy, and replace the
+         * pointer. Thus, concurrent requests reading the same session never block each other.
+         */
+        shared_ptr<ValueMap const> data;
+        atomic<time_t> expiryTime; /**< Time when this session expires. */
+        const string sourceIPStr;  /**< IP address of the session initiator, for optional IP checking. */
+
+        /**
+         * Construct an empty SessionData object with a source IP.
+         * @param sIP IP address of the session initiator.
+         * @param expires Time when this session expires.
+         */
+        SessionData(string sIP, time_t expires)
+            : data(make_shared<ValueMap const>()), expiryTime(expires), sourceIPStr(std::move(sIP)) {}
+
+        [[nodiscard]] string sourceIP() const override {
+            return sourceIPStr;
+        }
+
+        [[nodiscard]] time_t expires() const override {
+            return expiryTime;
+        }
+
+        void expires(time_t expires) override {
+            expiryTime = expires;
+        }
+
+        [[nodiscard]] bool isSet(string const& key) const override {
+            return atomic_load(&data)->count(key) == 1;
+        }
+
+        [[nodiscard]] any get(string const& key) const override {
+            auto values = atomic_load(&data);
+            auto it = values->find(key);
+            return it != values->end() ? it->second : any();
+        }
+
+        void set(string key, any const& value) override {
+            lock_guard<mutex> lockGuard(dLock);
+            auto newValues = make_shared<ValueMap>(*data);
+            (*newValues)[std::move(key)] = value;
+            atomic_store(&data, shared_ptr<ValueMap const>(std::move(newValues)));
+        }
+
+        void unset(string const& key) override {
+            lock_guard<mutex> lockGuard(dLock);
+            if (data->count(key) == 0) {
+                return;
+            }
+            auto newValues = make_shared<ValueMap>(*data);
+            newValues->erase(key);
+            atomic_store(&data, shared_ptr<ValueMap const>(std::move(newValues)));
+        }
+
+        [[nodiscard]] shared_ptr<ValueMap const> values() const override {
+            return atomic_load(&data);
+        }
+    };
+
+    /**
+     * Number of shards the session store is split into. Must be a power of two. Sessions are assigned to a shard by
+     * the hash of their ID, and every shard is locked independently, so that concurrent requests only contend if
+     * their sessions happen to be located in the same shard.
+     */
+    constexpr size_t sessionShardCount = 64;
+
+    /**
+     * A shard of the session store. Aligned to a cache line in order to avoid false sharing between the locks of
+     * neighboring shards.
+     */
+    struct alignas(64) SessionShard {
+        mutable mutex lock; /**< Lock for the session map of this shard. */
+        /**
+         * Map containing (pointers to) the session data for all sessions of this shard. The key is the session ID
+         * string.
+         */
+        unordered_map<string, shared_ptr<SessionData>> sessions;
+        /**
+         * Min-heap of (expiry time, session ID) pairs, only maintained while the background garbage collector is
+         * running (see expiryTracking). Entries may be outdated, as sessions can be touched or removed in the
+         * meantime, so the collector checks them against the session map before removing anything.
+         */
+        priority_queue<pair<time_t, string>, vector<pair<time_t, string>>, greater<>> expiryQueue;
+        bool expiryTracking = false; /**< Whether new sessions of this shard have to be added to the expiry queue. */
+    };
+
+    using SessionShards = array<SessionShard, sessionShardCount>;
+
+    /**
+     * Garbage collection by removing every expired session from the given shard.
+     * @param shard The shard to clean up.
+     */
+    void collectGarbage(SessionShard& shard) {
+        auto now = time(nullptr);
+        lock_guard<mutex> lockGuard(shard.lock);
+        for (auto it = shard.sessions.cbegin(); it != shard.sessions.cend();) {
+            if (it->second->expiryTime <= now) {
+                it = shard.sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /**
+     * Maximum number of expiry queue entries the background collector processes while holding a shard lock.
+     */
+    constexpr size_t gcSliceSize = 256;
+
+    /**
+     * Interval in which the background collector checks the expiry queues if there is no backlog.
+     */
+    constexpr chrono::seconds gcInterval(1);
+
+    /**
+     * Background garbage collector. It owns a thread that removes expired sessions from the shards in bounded
+     * slices, based on the expiry queues of the shards, so that request threads never have to pay for garbage
+     * collection.
+     */
+    class BackgroundCollector {
+        SessionShards& shards;           /**< The shards to clean up. */
+        mutex controlLock;               /**< Lock for stopRequested. */
+        condition_variable wakeup;       /**< Used to wake up the collector thread on shutdown. */
+        bool stopRequested = false;      /**< Tells the collector thread to terminate. */
+        thread worker;                   /**< The collector thread. */
+
+        /**
+         * Process at most gcSliceSize due entries of the expiry queue of a shard.
+         * @param shard The shard.
+         * @return True if the slice has been exhausted and more entries might be due, false otherwise.
+         */
+        static bool processSlice(SessionShard& shard) {
+            auto now = time(nullptr);
+            lock_guard<mutex> lockGuard(shard.lock);
+            for (size_t i = 0; i < gcSliceSize; ++i) {
+                if (shard.expiryQueue.empty() || shard.expiryQueue.top().first > now) {
+                    return false;
+                }
+                string sessionId = shard.expiryQueue.top().second;
+                shard.expiryQueue.pop();
+                auto it = shard.sessions.find(sessionId);
+                if (it == shard.sessions.end()) {
+                    // session has already been removed
+                    continue;
+                }
+                time_t expires = it->second->expiryTime;
+                if (expires <= now) {
+                    shard.sessions.erase(it);
+                } else {
+                    // session has been touched in the meantime, check it again when the new expiry time is reached
+                    shard.expiryQueue.emplace(expires, std::move(sessionId));
+                }
+            }
+            return true;
+        }
+
+        void run() {
+            unique_lock<mutex> controlGuard(controlLock);
+            while (!stopRequested) {
+                controlGuard.unlock();
+                bool backlog = false;
+                for (auto& shard : shards) {
+                    backlog = processSlice(shard) || backlog;
+                }
+                controlGuard.lock();
+                if (!backlog) {
+                    wakeup.wait_for(controlGuard, gcInterval, [this] { return stopRequested; });
+                }
+            }
+        }
+
+    public:
+        /**
+         * Start the collector thread.
+         * @param shards The shards to clean up. New sessions must be added to the expiry queues from now on.
+         */
+        explicit BackgroundCollector(SessionShards& shards) : shards(shards) {
+            for (auto& shard : shards) {
+                shard.expiryTracking = true;
+            }
+            worker = thread([this] { run(); });
+        }
+
+        /**
+         * Stop the collector thread and wait for it to terminate.
+         */
+        ~BackgroundCollector() {
+            {
+                lock_guard<mutex> controlGuard(controlLock);
+                stopRequested = true;
+            }
+            wakeup.notify_all();
+            worker.join();
+        }
+    };
+    /**
+     * Magic bytes at the beginning of a snapshot file, followed by the format version (uint32_t), the number of
+     * sessions (uint64_t), and the sessions. Each session consists of the ID and the source IP (both prefixed by
+     * their length as uint32_t), the expiry time (int64_t), the number of values (uint32_t), and the values. Each
+     * value consists of the key (prefixed by its length as uint32_t), the type name (see session::ValueRegistry,
+     * prefixed by its length as uint8_t), and the serialized value (prefixed by its length as uint32_t).
+     */
+    constexpr char snapshotMagic[8] = {'N', 'A', 'W', 'A', 'S', 'E', 'S', 'S'};
+    constexpr uint32_t snapshotVersion = 1;
+
+    template<typename T>
+    void appendRaw(string& out, T const& value) {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    template<typename LengthType>
+    void appendWithLength(string& out, string_view str) {
+        appendRaw(out, static_cast<LengthType>(str.size()));
+        out += str;
+    }
+
+    /**
+     * Sequential reader for a memory-mapped snapshot file. All read functions return false if the end of the data
+     * has been reached.
+     */
+    class SnapshotReader {
+        string_view input;
+        size_t pos = 0;
+
+    public:
+        explicit SnapshotReader(string_view input) : input(input) {}
+
+        template<typename T>
+        bool read(T& value) {
+            if (input.size() - pos < sizeof(T)) {
+                return false;
+            }
+            memcpy(&value, input.data() + pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        template<typename LengthType>
+        bool readWithLength(string_view& str) {
+            LengthType length;
+            if (!read(length) || input.size() - pos < length) {
+                return false;
+            }
+            str = input.substr(pos, length);
+            pos += length;
+            return true;
+        }
+    };
+}// namespace
+
+struct session::MemorySessionStore::Data {
+    SessionShards shards;
+    string snapshotFile;
+    // declared after the shards, so that the collector thread is stopped before the shards are destroyed
+    unique_ptr<BackgroundCollector> backgroundCollector;
+
+    /**
+     * Get the shard responsible for the given session ID.
+     * @param sessionId The session ID.
+     * @return Reference to the shard.
+     */
+    SessionShard& getShard(string const& sessionId) {
+        return shards[hash<string>()(sessionId) & (sessionShardCount - 1)];
+    }
+};
+
+NAWA_DEFAULT_DESTRUCTOR_IMPL_WITH_NS(session, MemorySessionStore)
+
+session::MemorySessionStore::MemorySessionStore(bool backgroundGC, std::string snapshotFile) {
+    data = make_unique<Data>();
+    data->snapshotFile = std::move(snapshotFile);
+    if (backgroundGC) {
+        data->backgroundCollector = make_unique<BackgroundCollector>(data->shards);
+    }
+    if (!data->snapshotFile.empty() && access(data->snapshotFile.c_str(), F_OK) == 0) {
+        try {
+            auto count = loadSnapshot(data->snapshotFile);
+            NLOG_INFO(logger, "Restored " << count << " sessions from " << data->snapshotFile)
+        } catch (Exception const& e) {
+            NLOG_WARNING(logger, "WARNING: Could not restore session snapshot: " << e.getMessage())
+        }
+    }
+}
+
+size_t session::MemorySessionStore::saveSnapshot(std::string const& path) const {
+    string tmpPath = path + ".tmp";
+    ofstream out(tmpPath, ios::binary | ios::trunc);
+    if (!out) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not open snapshot file for writing.", tmpPath);
+    }
+
+    // the number of sessions is only known at the end, it will be written into the header afterwards
+    string buffer(snapshotMagic, sizeof snapshotMagic);
+    appendRaw(buffer, snapshotVersion);
+    auto countPos = buffer.size();
+    appendRaw(buffer, uint64_t(0));
+
+    uint64_t count = 0;
+    auto now = time(nullptr);
+    for (auto const& shard : data->shards) {
+        {
+            lock_guard<mutex> lockGuard(shard.lock);
+            for (auto const& [sessionId, sessionData] : shard.sessions) {
+                time_t expires = sessionData->expiryTime;
+                if (expires <= now) {
+                    continue;
+                }
+                appendWithLength<uint32_t>(buffer, sessionId);
+                appendWithLength<uint32_t>(buffer, sessionData->sourceIPStr);
+                appendRaw(buffer, static_cast<int64_t>(expires));
+                auto valueCountPos = buffer.size();
+                appendRaw(buffer, uint32_t(0));
+                uint32_t valueCount = 0;
+                for (auto const& [key, value] : *sessionData->values()) {
+                    auto serialized = ValueRegistry::serialize(value);
+                    if (!serialized || serialized->first.size() > UINT8_MAX) {
+                        continue;
+                    }
+                    appendWithLength<uint32_t>(buffer, key);
+                    appendWithLength<uint8_t>(buffer, serialized->first);
+                    appendWithLength<uint32_t>(buffer, serialized->second);
+                    ++valueCount;
+                }
+                memcpy(&buffer[valueCountPos], &valueCount, sizeof valueCount);
+                ++count;
+            }
+        }
+        // write the data shard by shard, so that the buffer does not grow too large
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    out.seekp(countPos);
+    out.write(reinterpret_cast<char const*>(&count), sizeof count);
+    out.close();
+    if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not write snapshot file.", path);
+    }
+    return count;
+}
+
+size_t session::MemorySessionStore::loadSnapshot(std::string const& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 2, "Could not open snapshot file.", strerror(errno));
+    }
+    struct stat fdStat {};
+    if (fstat(fd, &fdStat) != 0) {
+        close(fd);
+        throw Exception(__PRETTY_FUNCTION__, 2, "Could not open snapshot file.", strerror(errno));
+    }
+    size_t size = fdStat.st_size;
+    void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw Exception(__PRETTY_FUNCTION__, 2, "Could not map snapshot file.", path);
+    }
+    // the file is read sequentially
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    SnapshotReader reader(string_view(static_cast<char const*>(mapped), size));
+    auto invalidSnapshot = [&]() {
+        munmap(mapped, size);
+        return Exception(__PRETTY_FUNCTION__, 3, "Invalid snapshot file.", path);
+    };
+    char magic[sizeof snapshotMagic];
+    uint32_t version;
+    uint64_t count;
+    if (!reader.read(magic) || memcmp(magic, snapshotMagic, sizeof snapshotMagic) != 0 || !reader.read(version) ||
+        version != snapshotVersion || !reader.read(count)) {
+        throw invalidSnapshot();
+    }
+
+    size_t restored = 0;
+    auto now = time(nullptr);
+    for (uint64_t i = 0; i < count; ++i) {
+        string_view sessionId, sourceIP;
+        int64_t expires;
+        uint32_t valueCount;
+        if (!reader.readWithLength<uint32_t>(sessionId) || !reader.readWithLength<uint32_t>(sourceIP) ||
+            !reader.read(expires) || !reader.read(valueCount)) {
+            throw invalidSnapshot();
+        }
+        auto values = make_shared<ValueMap>();
+        for (uint32_t j = 0; j < valueCount; ++j) {
+            string_view key, typeName, bytes;
+            if (!reader.readWithLength<uint32_t>(key) || !reader.readWithLength<uint8_t>(typeName) ||
+                !reader.readWithLength<uint32_t>(bytes)) {
+                throw invalidSnapshot();
+            }
+            auto value = ValueRegistry::deserialize(typeName, bytes);
+            if (value) {
+                values->emplace(key, std::move(*value));
+            }
+        }
+        auto sessionData = make_shared<SessionData>(string(sourceIP), expires);
+        sessionData->data = std::move(values);
+        if (expires <= now) {
+            continue;
+        }
+        string id(sessionId);
+        auto& shard = data->getShard(id);
+        lock_guard<mutex> lockGuard(shard.lock);
+        if (shard.sessions.try_emplace(id, sessionData).second) {
+            if (shard.expiryTracking) {
+                shard.expiryQueue.emplace(expires, std::move(id));
+            }
+            ++restored;
+        }
+    }
+    munmap(mapped, size);
+    return restored;
+}
+
+shared_ptr<session::SessionStore::Handle> session::MemorySessionStore::find(string const& sessionId) {
+    auto& shard = data->getShard(sessionId);
+    lock_guard<mutex> lockGuard(shard.lock);
+    auto it = shard.sessions.find(sessionId);
+    if (it == shard.sessions.end()) {
+        return nullptr;
+    }
+    return it->second;
+}
+
+shared_ptr<session::SessionStore::Handle>
+session::MemorySessionStore::create(string const& sessionId, string const& sourceIP, time_t expires) {
+    auto newData = make_shared<SessionData>(sourceIP, expires);
+    auto& shard = data->getShard(sessionId);
+    lock_guard<mutex> lockGuard(shard.lock);
+    if (!shard.sessions.try_emplace(sessionId, newData).second) {
+        return nullptr;
+    }
+    if (shard.expiryTracking) {
+        shard.expiryQueue.emplace(expires, sessionId);
+    }
+    return newData;
+}
+
+void session::MemorySessionStore::remove(string const& sessionId) {
+    auto& shard = data->getShard(sessionId);
+    lock_guard<mutex> lockGuard(shard.lock);
+    shard.sessions.erase(sessionId);
+}
+
+void session::MemorySessionStore::collectGarbage() {
+    // only one shard is locked at a time, so that requests accessing sessions in other shards are not blocked
+    for (auto& shard : data->shards) {
+        ::collectGarbage(shard);
+    }
+}
+
+bool session::MemorySessionStore::collectsGarbageInBackground() const {
+    return data->backgroundCollector != nullptr;
+}
+
+void session::MemorySessionStore::shutdown() {
+    if (data->snapshotFile.empty()) {
+        return;
+    }
+    try {
+        auto count = saveSnapshot(data->snapshotFile);
+        NLOG_INFO(logger, "Saved " << count << " sessions to " << data->snapshotFile)
+    } catch (Exception const& e) {
+        NLOG_ERROR(logger, "ERROR: Could not save session snapshot: " << e.getMessage())
+    }
+}
@@ -0,0 +1,670 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file SharedMemorySessionStore.cpp
+ * \brief Implementation of the SharedMemorySessionStore class.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <nawa/Exception.h>
+#include <nawa/session/SessionStore/impl/SharedMemorySessionStore.h>
+#include <nawa/session/ValueRegistry.h>
+#include <optional>
+#include <signal.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    static_assert(atomic<uint32_t>::is_always_lock_free && atomic<int64_t>::is_always_lock_free,
+                  "The shared memory session store requires lock-free atomics.");
+
+    constexpr uint64_t segmentMagic = 0x6e61776173657373ULL; /**< "nawasess" */
+    constexpr uint32_t layoutVersion = 3;
+    constexpr size_t maxIdLength = 64;
+    constexpr size_t maxIPLength = 48;
+    constexpr unsigned int lockSpins = 1000;  /**< Attempts before checking whether the owner of a lock is alive. */
+    constexpr chrono::seconds lockTimeout(5); /**< Maximum time to wait for a lock held by a live process. */
+
+    /**
+     * Header at the beginning of the shared memory segment.
+     */
+    struct alignas(64) SegmentHeader {
+        atomic<uint32_t> state;         /**< 0 = uninitialized, 1 = being initialized, 2 = ready. */
+        atomic<uint32_t> structureLock; /**< Serializes claiming slots against turning deleted slots into empty ones. */
+        uint32_t version;
+        uint64_t magic;
+        uint64_t slotCount;
+        uint64_t slotSize;
+    };
+
+    enum SlotState : uint32_t {
+        EMPTY = 0,
+        USED = 1,
+        DELETED = 2
+    };
+
+    /**
+     * Metadata at the beginning of every slot, followed by the serialized session values. The sequence counter is
+     * odd while the slot is being modified, readers copy the data they need and retry if the counter has changed in
+     * the meantime. Writers have to hold the write lock, which contains the pid of its owner, so that the lock of a
+     * process which crashed while modifying the slot can be recovered (the session in that slot is discarded then).
+     */
+    struct alignas(64) SlotHeader {
+        atomic<uint32_t> writeLock;
+        atomic<uint32_t> sequence;
+        atomic<uint32_t> state;
+        atomic<int64_t> expires;
+        uint32_t idLength;
+        uint32_t ipLength;
+        uint32_t payloadSize;
+        char id[maxIdLength];
+        char sourceIP[maxIPLength];
+    };
+
+    /**
+     * The mapped shared memory segment. Shared by the store and all handles, so that handles stay usable even if
+     * the store is destroyed.
+     */
+    struct Segment {
+        char* base = nullptr;
+        size_t size = 0;
+        size_t slotCount = 0;
+        size_t slotSize = 0;
+
+        ~Segment() {
+            if (base) {
+                munmap(base, size);
+            }
+        }
+
+        SegmentHeader& header() {
+            return *reinterpret_cast<SegmentHeader*>(base);
+        }
+
+        SlotHeader& slot(size_t index) {
+            return *reinterpret_cast<SlotHeader*>(base + sizeof(SegmentHeader) + index * slotSize);
+        }
+
+        char* payload(size_t index) {
+            return reinterpret_cast<char*>(&slot(index)) + sizeof(SlotHeader);
+        }
+
+        [[nodiscard]] size_t payloadCapacity() const {
+            return slotSize - sizeof(SlotHeader);
+        }
+    };
+
+    /**
+     * 64-bit FNV-1a hash, which (unlike std::hash) is guaranteed to be identical in all processes.
+     * @param str The string to hash.
+     * @return The hash.
+     */
+    uint64_t stableHash(string_view str) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (unsigned char c : str) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    /**
+     * Acquire a lock word in shared memory, which contains the pid of the owning process, or 0 if it is free. A lock
+     * held by a process which does not exist anymore is taken over. Throws a nawa::Exception with error code 14 if a
+     * live process holds the lock for longer than lockTimeout.
+     * @param lockWord The lock word.
+     * @return True if the lock has been taken over from a process which does not exist anymore.
+     */
+    bool acquireLock(atomic<uint32_t>& lockWord) {
+        auto const self = static_cast<uint32_t>(getpid());
+        optional<chrono::steady_clock::time_point> deadline;
+        for (unsigned int spins = 0;; ++spins) {
+            uint32_t owner = 0;
+            if (lockWord.compare_exchange_weak(owner, self, memory_order_acquire, memory_order_relaxed)) {
+                return false;
+            }
+            if (owner == 0 || spins < lockSpins) {
+                this_thread::yield();
+                continue;
+            }
+            if (kill(static_cast<pid_t>(owner), 0) != 0 && errno == ESRCH) {
+                if (lockWord.compare_exchange_strong(owner, self, memory_order_acquire, memory_order_relaxed)) {
+                    return true;
+                }
+                continue;
+            }
+            auto now = chrono::steady_clock::now();
+            if (!deadline) {
+                deadline = now + lockTimeout;
+            } else if (now > *deadline) {
+                throw Exception(__PRETTY_FUNCTION__, 14,
+                                "Timed out waiting for a lock of the shared memory session store.",
+                                "Lock held by pid " + to_string(owner));
+            }
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+
+    /**
+     * RAII lock for modifying a slot, which also marks the modification in the sequence counter.
+     */
+    class SlotWriteLock {
+        SlotHeader& slot;
+        uint32_t sequence;
+
+    public:
+        explicit SlotWriteLock(SlotHeader& slot) : slot(slot) {
+            bool recovered = acquireLock(slot.writeLock);
+            sequence = slot.sequence.load(memory_order_relaxed);
+            // an odd counter after recovering means that the previous owner died while modifying the slot
+            bool interrupted = recovered && (sequence & 1);
+            if (interrupted) {
+                --sequence;
+            }
+            slot.sequence.store(sequence + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            if (interrupted) {
+                slot.state.store(DELETED, memory_order_relaxed);
+            }
+        }
+
+        ~SlotWriteLock() {
+            slot.sequence.store(sequence + 2, memory_order_release);
+            slot.writeLock.store(0, memory_order_release);
+        }
+    };
+
+    /**
+     * Run a read operation on a slot, retrying it until no writer has interfered.
+     * @param slot The slot.
+     * @param readFunction Function copying the needed data out of the slot.
+     * @return The return value of the read function.
+     */
+    template<typename F>
+    auto readConsistent(SlotHeader& slot, F&& readFunction) {
+        for (unsigned int spins = 0;; ++spins) {
+            uint32_t sequence = slot.sequence.load(memory_order_acquire);
+            if (sequence & 1) {
+                if (spins >= lockSpins) {
+                    // wait for the writer (or recover the slot if the writer does not exist anymore)
+                    SlotWriteLock lock(slot);
+                    spins = 0;
+                } else {
+                    this_thread::yield();
+                }
+                continue;
+            }
+            auto result = readFunction();
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.sequence.load(memory_order_relaxed) == sequence) {
+                return result;
+            }
+        }
+    }
+
+    /**
+     * Check (without synchronization) whether the slot currently belongs to the given session. Only to be used
+     * inside readConsistent() or while holding the write lock.
+     */
+    bool belongsTo(SlotHeader const& slot, string_view sessionId) {
+        return slot.state.load(memory_order_relaxed) == USED && slot.idLength == sessionId.size() &&
+               memcmp(slot.id, sessionId.data(), sessionId.size()) == 0;
+    }
+
+    /**
+     * RAII lock serializing the creation of sessions and the reclamation of deleted slots.
+     */
+    class StructureLock {
+        SegmentHeader& header;
+
+    public:
+        explicit StructureLock(SegmentHeader& header) : header(header) {
+            acquireLock(header.structureLock);
+        }
+
+        ~StructureLock() {
+            header.structureLock.store(0, memory_order_release);
+        }
+    };
+
+    template<typename T>
+    void appendRaw(string& out, T const& value) {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    /**
+     * Append a serialized (key, value) entry to the given payload. Entries consist of the key length (uint32_t), the
+     * key, the length of the type name (uint8_t), the type name (see session::ValueRegistry), the value length
+     * (uint32_t), and the value. Throws a nawa::Exception with error code 13 if the type of the value has not been
+     * registered.
+     * @param out The payload.
+     * @param key The key.
+     * @param value The value.
+     */
+    void appendEntry(string& out, string const& key, any const& value) {
+        auto serialized = session::ValueRegistry::serialize(value);
+        if (!serialized || serialized->first.size() > UINT8_MAX) {
+            throw Exception(__PRETTY_FUNCTION__, 13,
+                            "Values of this type cannot be stored in shared memory (type not registered).",
+                            value.type().name());
+        }
+        auto const& [typeName, bytes] = *serialized;
+        appendRaw(out, static_cast<uint32_t>(key.size()));
+        out += key;
+        out.push_back(static_cast<char>(typeName.size()));
+        out += typeName;
+        appendRaw(out, static_cast<uint32_t>(bytes.size()));
+        out += bytes;
+    }
+
+    /**
+     * A (key, value) entry of a serialized payload, pointing into the payload.
+     */
+    struct Entry {
+        string_view key;
+        string_view typeName;
+        string_view value;
+        string_view raw; /**< The complete serialized entry. */
+    };
+
+    /**
+     * Call a function for every entry of a serialized payload, until the function returns false.
+     * @param payload The payload.
+     * @param f Function taking an Entry and returning a bool.
+     */
+    template<typename F>
+    void forEachEntry(string_view payload, F&& f) {
+        size_t pos = 0;
+        auto readLength = [&](uint32_t& length) {
+            if (payload.size() - pos < sizeof(uint32_t)) {
+                return false;
+            }
+            memcpy(&length, payload.data() + pos, sizeof(uint32_t));
+            pos += sizeof(uint32_t);
+            return true;
+        };
+        while (pos < payload.size()) {
+            Entry entry;
+            size_t entryStart = pos;
+            uint32_t keyLength, valueLength;
+            if (!readLength(keyLength) || payload.size() - pos < keyLength + 1ULL) {
+                return;
+            }
+            entry.key = payload.substr(pos, keyLength);
+            pos += keyLength;
+            size_t typeNameLength = static_cast<unsigned char>(payload[pos++]);
+            if (payload.size() - pos < typeNameLength) {
+                return;
+            }
+            entry.typeName = payload.substr(pos, typeNameLength);
+            pos += typeNameLength;
+            if (!readLength(valueLength) || payload.size() - pos < valueLength) {
+                return;
+            }
+            entry.value = payload.substr(pos, valueLength);
+            pos += valueLength;
+            entry.raw = payload.substr(entryStart, pos - entryStart);
+            if (!f(entry)) {
+                return;
+            }
+        }
+    }
+
+    using ValueMap = session::SessionStore::ValueMap;
+
+    /**
+     * Handle for a session in a shared memory slot.
+     */
+    class SlotHandle : public session::SessionStore::Handle {
+        shared_ptr<Segment> segment;
+        size_t index;
+        string sessionId;
+
+        /**
+         * Copy the payload out of the slot.
+         * @return The payload, or nullopt if the slot does not belong to this session anymore.
+         */
+        [[nodiscard]] optional<string> readPayload() const {
+            auto& slot = segment->slot(index);
+            return readConsistent(slot, [&]() -> optional<string> {
+                if (!belongsTo(slot, sessionId)) {
+                    return nullopt;
+                }
+                return string(segment->payload(index), min<size_t>(slot.payloadSize, segment->payloadCapacity()));
+            });
+        }
+
+        /**
+         * Replace the value for the given key (or remove it, if value is nullptr). Throws a nawa::Exception with
+         * error code 12 if the resulting payload does not fit into the slot.
+         */
+        void modify(string const& key, any const* value) {
+            auto& slot = segment->slot(index);
+            SlotWriteLock lock(slot);
+            if (!belongsTo(slot, sessionId)) {
+                return;
+            }
+            string newPayload;
+            forEachEntry(string_view(segment->payload(index), slot.payloadSize), [&](Entry const& entry) {
+                if (entry.key != key) {
+                    newPayload += entry.raw;
+                }
+                return true;
+            });
+            if (value) {
+                appendEntry(newPayload, key, *value);
+            }
+            if (newPayload.size() > segment->payloadCapacity()) {
+                throw Exception(__PRETTY_FUNCTION__, 12, "Session data does not fit into a shared memory slot.");
+            }
+            memcpy(segment->payload(index), newPayload.data(), newPayload.size());
+            slot.payloadSize = newPayload.size();
+        }
+
+    public:
+        SlotHandle(shared_ptr<Segment> segment, size_t index, string sessionId)
+            : segment(std::move(segment)), index(index), sessionId(std::move(sessionId)) {}
+
+        [[nodiscard]] string sourceIP() const override {
+            auto& slot = segment->slot(index);
+            return readConsistent(slot, [&]() {
+                return belongsTo(slot, sessionId) ? string(slot.sourceIP, min(size_t(slot.ipLength), maxIPLength))
+                                                  : string();
+            });
+        }
+
+        [[nodiscard]] time_t expires() const override {
+            auto& slot = segment->slot(index);
+            return readConsistent(slot, [&]() -> time_t {
+                return belongsTo(slot, sessionId) ? slot.expires.load(memory_order_relaxed) : 0;
+            });
+        }
+
+        void expires(time_t expires) override {
+            auto& slot = segment->slot(index);
+            SlotWriteLock lock(slot);
+            if (belongsTo(slot, sessionId)) {
+                slot.expires.store(expires, memory_order_relaxed);
+            }
+        }
+
+        [[nodiscard]] bool isSet(string const& key) const override {
+            auto payload = readPayload();
+            bool found = false;
+            if (payload) {
+                forEachEntry(*payload, [&](Entry const& entry) {
+                    found = entry.key == key;
+                    return !found;
+                });
+            }
+            return found;
+        }
+
+        [[nodiscard]] any get(string const& key) const override {
+            auto payload = readPayload();
+            any ret;
+            if (payload) {
+                forEachEntry(*payload, [&](Entry const& entry) {
+                    if (entry.key == key) {
+                        ret = session::ValueRegistry::deserialize(entry.typeName, entry.value).value_or(any());
+                        return false;
+                    }
+                    return true;
+                });
+            }
+            return ret;
+        }
+
+        [[nodiscard]] shared_ptr<ValueMap const> values() const override {
+            auto payload = readPayload();
+            auto ret = make_shared<ValueMap>();
+            if (payload) {
+                forEachEntry(*payload, [&](Entry const& entry) {
+                    auto value = session::ValueRegistry::deserialize(entry.typeName, entry.value);
+                    if (value) {
+                        ret->insert_or_assign(string(entry.key), std::move(*value));
+                    }
+                    return true;
+                });
+            }
+            return ret;
+        }
+
+        void set(string key, any const& value) override {
+            modify(key, &value);
+        }
+
+        void unset(string const& key) override {
+            modify(key, nullptr);
+        }
+    };
+}// namespace
+
+struct session::SharedMemorySessionStore::Data {
+    shared_ptr<Segment> segment;
+
+    /**
+     * Find the slot currently holding the given session.
+     * @param sessionId The session ID.
+     * @return The slot index, or nullopt if the session does not exist.
+     */
+    optional<size_t> findSlot(string const& sessionId) {
+        auto start = stableHash(sessionId) % segment->slotCount;
+        for (size_t i = 0; i < segment->slotCount; ++i) {
+            size_t index = (start + i) % segment->slotCount;
+            auto& slot = segment->slot(index);
+            auto [state, matches] = readConsistent(slot, [&]() {
+                return make_pair(slot.state.load(memory_order_relaxed), belongsTo(slot, sessionId));
+            });
+            if (state == EMPTY) {
+                // end of the probe sequence
+                return nullopt;
+            }
+            if (matches) {
+                return index;
+            }
+        }
+        return nullopt;
+    }
+
+    /**
+     * Turn the given slot and the slots before it into empty slots, as long as they are deleted and followed by an
+     * empty slot. No probe sequence can continue behind such a slot, so this keeps lookups of missing sessions from
+     * having to scan ever more tombstones. Must be called while holding the StructureLock, so that no session can be
+     * placed behind a slot while it is turned into an empty one.
+     * @param index Index of the slot.
+     */
+    void reclaim(size_t index) {
+        for (size_t i = 0; i < segment->slotCount; ++i) {
+            auto& slot = segment->slot(index);
+            size_t next = (index + 1) % segment->slotCount;
+            if (slot.state.load(memory_order_relaxed) != DELETED ||
+                (next != index && segment->slot(next).state.load(memory_order_relaxed) != EMPTY)) {
+                return;
+            }
+            {
+                SlotWriteLock lock(slot);
+                slot.state.store(EMPTY, memory_order_relaxed);
+            }
+            index = (index + segment->slotCount - 1) % segment->slotCount;
+        }
+    }
+};
+
+NAWA_DEFAULT_DESTRUCTOR_IMPL_WITH_NS(session, SharedMemorySessionStore)
+
+session::SharedMemorySessionStore::SharedMemorySessionStore(string const& name, size_t slotCount, size_t slotSize) {
+    data = make_unique<Data>();
+    // slots must be large enough for the metadata and aligned to cache lines
+    slotSize = max(slotSize, sizeof(SlotHeader) + 64);
+    slotSize = (slotSize + 63) & ~size_t(63);
+    slotCount = max(slotCount, size_t(1));
+    size_t segmentSize = sizeof(SegmentHeader) + slotCount * slotSize;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not open shared memory segment for sessions.", strerror(errno));
+    }
+    struct stat fdStat {};
+    if (fstat(fd, &fdStat) != 0 || (fdStat.st_size == 0 && ftruncate(fd, segmentSize) != 0)) {
+        auto err = errno;
+        close(fd);
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not resize shared memory segment for sessions.",
+                        strerror(err));
+    }
+    if (fdStat.st_size != 0 && static_cast<size_t>(fdStat.st_size) != segmentSize) {
+        close(fd);
+        throw Exception(__PRETTY_FUNCTION__, 2,
+                        "Existing shared memory segment for sessions has a different size than configured.");
+    }
+    void* base = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Could not map shared memory segment for sessions.",
+                        strerror(errno));
+    }
+    data->segment = make_shared<Segment>();
+    data->segment->base = static_cast<char*>(base);
+    data->segment->size = segmentSize;
+    data->segment->slotCount = slotCount;
+    data->segment->slotSize = slotSize;
+
+    // the first process initializes the header (the slots are zero-filled by ftruncate), the others wait for it
+    auto& header = data->segment->header();
+    uint32_t expected = 0;
+    if (header.state.compare_exchange_strong(expected, 1, memory_order_acq_rel)) {
+        header.version = layoutVersion;
+        header.magic = segmentMagic;
+        header.slotCount = slotCount;
+        header.slotSize = slotSize;
+        header.state.store(2, memory_order_release);
+    } else {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (header.state.load(memory_order_acquire) != 2) {
+            if (chrono::steady_clock::now() > deadline) {
+                throw Exception(__PRETTY_FUNCTION__, 2, "Shared memory segment for sessions was not initialized.");
+            }
+            this_thread::yield();
+        }
+    }
+    if (header.magic != segmentMagic || header.version != layoutVersion || header.slotCount != slotCount ||
+        header.slotSize != slotSize) {
+        throw Exception(__PRETTY_FUNCTION__, 2,
+                        "Existing shared memory segment for sessions has an incompatible layout.");
+    }
+}
+
+shared_ptr<session::SessionStore::Handle> session::SharedMemorySessionStore::find(string const& sessionId) {
+    auto index = data->findSlot(sessionId);
+    if (!index) {
+        return nullptr;
+    }
+    return make_shared<SlotHandle>(data->segment, *index, sessionId);
+}
+
+shared_ptr<session::SessionStore::Handle>
+session::SharedMemorySessionStore::create(string const& sessionId, string const& sourceIP, time_t expires) {
+    if (sessionId.size() > maxIdLength || sourceIP.size() > maxIPLength) {
+        throw Exception(__PRETTY_FUNCTION__, 11, "Session ID or source IP too long for the shared memory store.");
+    }
+    if (data->findSlot(sessionId)) {
+        return nullptr;
+    }
+
+    // claim the first slot which is empty, deleted, or holds an expired session
+    auto& segment = *data->segment;
+    StructureLock structureLock(segment.header());
+    auto now = time(nullptr);
+    auto isFree = [&](SlotHeader const& slot) {
+        auto state = slot.state.load(memory_order_relaxed);
+        return state != USED || slot.expires.load(memory_order_relaxed) <= now;
+    };
+    auto start = stableHash(sessionId) % segment.slotCount;
+    for (size_t i = 0; i < segment.slotCount; ++i) {
+        size_t index = (start + i) % segment.slotCount;
+        auto& slot = segment.slot(index);
+        if (!isFree(slot)) {
+            continue;
+        }
+        SlotWriteLock lock(slot);
+        if (!isFree(slot)) {
+            continue;
+        }
+        slot.idLength = sessionId.size();
+        memcpy(slot.id, sessionId.data(), sessionId.size());
+        slot.ipLength = sourceIP.size();
+        memcpy(slot.sourceIP, sourceIP.data(), sourceIP.size());
+        slot.payloadSize = 0;
+        slot.expires.store(expires, memory_order_relaxed);
+        slot.state.store(USED, memory_order_relaxed);
+        return make_shared<SlotHandle>(data->segment, index, sessionId);
+    }
+    throw Exception(__PRETTY_FUNCTION__, 10, "All slots of the shared memory session store are in use.");
+}
+
+void session::SharedMemorySessionStore::remove(string const& sessionId) {
+    auto index = data->findSlot(sessionId);
+    if (!index) {
+        return;
+    }
+    auto& slot = data->segment->slot(*index);
+    {
+        SlotWriteLock lock(slot);
+        if (!belongsTo(slot, sessionId)) {
+            return;
+        }
+        // deleted slots must not simply be marked empty, as this would interrupt the probe sequences of other sessions
+        slot.state.store(DELETED, memory_order_relaxed);
+    }
+    StructureLock structureLock(data->segment->header());
+    data->reclaim(*index);
+}
+
+void session::SharedMemorySessionStore::collectGarbage() {
+    auto now = time(nullptr);
+    auto& segment = *data->segment;
+    for (size_t i = 0; i < segment.slotCount; ++i) {
+        auto& slot = segment.slot(i);
+        if (slot.state.load(memory_order_relaxed) != USED || slot.expires.load(memory_order_relaxed) > now) {
+            continue;
+        }
+        SlotWriteLock lock(slot);
+        if (slot.state.load(memory_order_relaxed) == USED && slot.expires.load(memory_order_relaxed) <= now) {
+            slot.state.store(DELETED, memory_order_relaxed);
+        }
+    }
+
+    // reclaim all runs of deleted slots which are followed by an empty slot
+    StructureLock structureLock(segment.header());
+    for (size_t i = 0; i < segment.slotCount; ++i) {
+        if (segment.slot(i).state.load(memory_order_relaxed) == EMPTY) {
+            data->reclaim((i + segment.slotCount - 1) % segment.slotCount);
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file ValueRegistry.cpp
+ * \brief Implementation of the ValueRegistry class.
+ */
+
+#include <mutex>
+#include <nawa/session/ValueRegistry.h>
+#include <shared_mutex>
+#include <unordered_map>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    struct RegisteredType {
+        string name;
+        session::ValueRegistry::Serializer serializer;
+        session::ValueRegistry::Deserializer deserializer;
+    };
+
+    /**
+     * The registered types, both by type and by name.
+     */
+    struct Registry {
+        shared_mutex lock;
+        unordered_map<type_index, RegisteredType> byType;
+        unordered_map<string, type_index> byName;
+    };
+
+    void registerTypeUnlocked(Registry& registry, type_index type, string const& typeName,
+                              session::ValueRegistry::Serializer serializer,
+                              session::ValueRegistry::Deserializer deserializer) {
+        auto oldType = registry.byType.find(type);
+        if (oldType != registry.byType.end()) {
+            registry.byName.erase(oldType->second.name);
+        }
+        auto oldName = registry.byName.find(typeName);
+        if (oldName != registry.byName.end()) {
+            registry.byType.erase(oldName->second);
+            registry.byName.erase(oldName);
+        }
+        registry.byType.insert_or_assign(type, RegisteredType{typeName, std::move(serializer), std::move(deserializer)});
+        registry.byName.emplace(typeName, type);
+    }
+
+    template<typename T>
+    void registerTrivialUnlocked(Registry& registry, string const& typeName) {
+        auto [serializer, deserializer] = session::ValueRegistry::trivialSerialization<T>();
+        registerTypeUnlocked(registry, type_index(typeid(T)), typeName, std::move(serializer), std::move(deserializer));
+    }
+
+    /**
+     * Get the registry, which will be initialized with the default types on first use.
+     * @return Reference to the registry.
+     */
+    Registry& getRegistry() {
+        static Registry registry;
+        static once_flag defaultsRegistered;
+        call_once(defaultsRegistered, [] {
+            registerTypeUnlocked(
+                    registry, type_index(typeid(string)), "string",
+                    [](any const& value) { return any_cast<string const&>(value); },
+                    [](string_view bytes) { return any(string(bytes)); });
+            registerTrivialUnlocked<bool>(registry, "bool");
+            registerTrivialUnlocked<int>(registry, "int");
+            registerTrivialUnlocked<unsigned int>(registry, "unsigned int");
+            registerTrivialUnlocked<long>(registry, "long");
+            registerTrivialUnlocked<unsigned long>(registry, "unsigned long");
+            registerTrivialUnlocked<long long>(registry, "long long");
+            registerTrivialUnlocked<unsigned long long>(registry, "unsigned long long");
+            registerTrivialUnlocked<float>(registry, "float");
+            registerTrivialUnlocked<double>(registry, "double");
+        });
+        return registry;
+    }
+}// namespace
+
+void session::ValueRegistry::registerType(type_index type, string const& typeName, Serializer serializer,
+                                          Deserializer deserializer) {
+    auto& registry = getRegistry();
+    unique_lock<shared_mutex> lockGuard(registry.lock);
+    registerTypeUnlocked(registry, type, typeName, std::move(serializer), std::move(deserializer));
+}
+
+bool session::ValueRegistry::isRegistered(type_index type) {
+    if (type == type_index(typeid(void))) {
+        return true;
+    }
+    auto& registry = getRegistry();
+    shared_lock<shared_mutex> lockGuard(registry.lock);
+    return registry.byType.count(type) == 1;
+}
+
+optional<pair<string, string>> session::ValueRegistry::serialize(any const& value) {
+    if (!value.has_value()) {
+        return make_pair(string(), string());
+    }
+    auto& registry = getRegistry();
+    shared_lock<shared_mutex> lockGuard(registry.lock);
+    auto it = registry.byType.find(type_index(value.type()));
+    if (it == registry.byType.end()) {
+        return nullopt;
+    }
+    return make_pair(it->second.name, it->second.serializer(value));
+}
+
+optional<any> session::ValueRegistry::deserialize(string_view typeName, string_view bytes) {
+    if (typeName.empty()) {
+        return any();
+    }
+    auto& registry = getRegistry();
+    shared_lock<shared_mutex> lockGuard(registry.lock);
+    auto nameIt = registry.byName.find(string(typeName));
+    if (nameIt == registry.byName.end()) {
+        return nullopt;
+    }
+    auto value = registry.byType.at(nameIt->second).deserializer(bytes);
+    if (!value.has_value()) {
+        return nullopt;
+    }
+    return value;
+}
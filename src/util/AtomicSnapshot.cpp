@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file AtomicSnapshot.cpp
+ * \brief Hazard pointer registry for AtomicSnapshot.
+ */
+
+#include <array>
+#include <nawa/util/AtomicSnapshot.h>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    /**
+     * The hazard pointers of one thread. Records are never freed, but reused by new threads after their thread has
+     * terminated. Each record occupies its own cache lines, so that readers do not interfere with each other.
+     */
+    struct alignas(64) HazardRecord {
+        array<atomic<void const*>, hazard::SLOTS_PER_THREAD> slots{};
+        atomic<bool> active{true};
+        HazardRecord* next = nullptr; /**< Immutable after the record has been added to the list. */
+    };
+
+    atomic<HazardRecord*> hazardRecords{nullptr}; /**< Lock-free singly-linked list of all records. */
+
+    /**
+     * Take an inactive record or add a new one to the list.
+     * @return The record, owned by the calling thread until it terminates.
+     */
+    HazardRecord* acquireRecord() {
+        for (auto record = hazardRecords.load(memory_order_acquire); record; record = record->next) {
+            bool expected = false;
+            if (record->active.compare_exchange_strong(expected, true, memory_order_acq_rel)) {
+                return record;
+            }
+        }
+        auto record = new HazardRecord;
+        record->next = hazardRecords.load(memory_order_relaxed);
+        while (!hazardRecords.compare_exchange_weak(record->next, record, memory_order_acq_rel)) {}
+        return record;
+    }
+
+    /**
+     * Owns the record of the current thread and releases it when the thread terminates.
+     */
+    struct ThreadRecord {
+        HazardRecord* record = acquireRecord();
+
+        ~ThreadRecord() {
+            for (auto& slot : record->slots) {
+                slot.store(nullptr, memory_order_relaxed);
+            }
+            record->active.store(false, memory_order_release);
+        }
+    };
+}// namespace
+
+std::atomic<void const*>* hazard::acquire() noexcept {
+    thread_local ThreadRecord threadRecord;
+    for (auto& slot : threadRecord.record->slots) {
+        if (slot.load(memory_order_relaxed) == nullptr) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+bool hazard::isProtected(void const* object) noexcept {
+    for (auto record = hazardRecords.load(memory_order_acquire); record; record = record->next) {
+        for (auto& slot : record->slots) {
+            if (slot.load(memory_order_seq_cst) == object) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
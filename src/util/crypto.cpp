@@ -25,6 +25,7 @@
 #include <nawa/util/crypto.h>
 #include <nawa/util/utils.h>
 #include <openssl/md5.h>
+#include <openssl/rand.h>
 #include <openssl/sha.h>
 
 using namespace nawa;
@@ -102,6 +103,53 @@ std::string crypto::md5(std::string const& input, bool hex) {
     return ret;
 }
 
+void crypto::randomBytes(unsigned char* buffer, size_t size) {
+    // RAND_priv_bytes takes an int, so large requests have to be split
+    while (size > 0) {
+        int chunk = static_cast<int>(min<size_t>(size, 1 << 20));
+        if (RAND_priv_bytes(buffer, chunk) != 1) {
+            throw Exception(__PRETTY_FUNCTION__, 1, "Could not generate random bytes.");
+        }
+        buffer += chunk;
+        size -= chunk;
+    }
+}
+
+std::string crypto::randomToken(size_t bytes) {
+    static char const alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    // encode in chunks of 48 random bytes (64 chars), so that the random bytes fit into a small buffer on the stack
+    string ret((bytes * 4 + 2) / 3, '\0');
+    unsigned char buffer[48];
+    size_t outPos = 0;
+    for (size_t remaining = bytes; remaining > 0;) {
+        size_t chunk = min(remaining, sizeof buffer);
+        randomBytes(buffer, chunk);
+        remaining -= chunk;
+        size_t i = 0;
+        for (; i + 3 <= chunk; i += 3) {
+            uint32_t triple = (buffer[i] << 16) | (buffer[i + 1] << 8) | buffer[i + 2];
+            ret[outPos++] = alphabet[(triple >> 18) & 0x3f];
+            ret[outPos++] = alphabet[(triple >> 12) & 0x3f];
+            ret[outPos++] = alphabet[(triple >> 6) & 0x3f];
+            ret[outPos++] = alphabet[triple & 0x3f];
+        }
+        // the last chunk may end with one or two bytes, which are encoded without padding
+        if (i < chunk) {
+            uint32_t triple = buffer[i] << 16;
+            if (i + 1 < chunk) {
+                triple |= buffer[i + 1] << 8;
+            }
+            ret[outPos++] = alphabet[(triple >> 18) & 0x3f];
+            ret[outPos++] = alphabet[(triple >> 12) & 0x3f];
+            if (i + 1 < chunk) {
+                ret[outPos++] = alphabet[(triple >> 6) & 0x3f];
+            }
+        }
+    }
+    return ret;
+}
+
 std::string crypto::passwordHash(std::string const& password, hashing::HashingEngine const& hashingEngine) {
     // use the provided HashingEngine for generation
     return hashingEngine.generateHash(password);
@@ -24,14 +24,12 @@
 #include <base64/base64.h>
 #include <boost/algorithm/string.hpp>
 #include <codecvt>
-#include <iomanip>
 #include <nawa/util/encoding.h>
 #include <nawa/util/utils.h>
 #include <punycode/punycode.h>
 #include <regex>
 #include <sstream>
 #include <unordered_map>
-#include <unordered_set>
 
 using namespace nawa;
 using namespace std;
@@ -105,11 +103,24 @@ namespace {
 
     unordered_map<u32string, pair<char32_t, char32_t>> htmlDecodeTable;
 
-    unordered_set<char> const urlUnreserved =
-            {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S',
-             'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l',
-             'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '0', '1', '2', '3', '4',
-             '5', '6', '7', '8', '9', '-', '_', '.', '~'};
+    /**
+     * Lookup tables for URL encoding and decoding, indexed by the (unsigned) character.
+     */
+    struct UrlCodingTables {
+        bool unreserved[256] = {};   /**< True for characters which do not need to be URL-encoded. */
+        signed char hexValue[256] = {}; /**< Value of a hex digit, -1 for other characters. */
+
+        UrlCodingTables() {
+            for (int c = 0; c < 256; ++c) {
+                unreserved[c] = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                                c == '-' || c == '_' || c == '.' || c == '~';
+                hexValue[c] = static_cast<signed char>((c >= '0' && c <= '9')   ? c - '0'
+                                                       : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+                                                       : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                                                                                : -1);
+            }
+        }
+    } const urlCodingTables;
 
     void initializeHtmlDecodeTable() {
         // add entities
@@ -236,37 +247,48 @@ std::string encoding::htmlDecode(std::string input) {
 }
 
 std::string encoding::urlEncode(std::string const& input) {
-    stringstream out;
+    static char const hexDigits[] = "0123456789ABCDEF";
+    string out;
+    out.reserve(input.size());
 
     // check if character is valid, unreserved URL character, otherwise apply url encoding
     for (char c : input) {
-        if (urlUnreserved.count(c) == 1) {
-            out << c;
+        auto uc = static_cast<unsigned char>(c);
+        if (urlCodingTables.unreserved[uc]) {
+            out.push_back(c);
         } else {
-            ios init(nullptr);
-            init.copyfmt(out);
-            out << '%' << uppercase << hex << setw(2) << setfill('0') << (int) (unsigned char) c;
-            out.copyfmt(init);
+            out.push_back('%');
+            out.push_back(hexDigits[uc >> 4]);
+            out.push_back(hexDigits[uc & 0x0F]);
         }
     }
 
-    return out.str();
+    return out;
 }
 
 std::string encoding::urlDecode(std::string input) {
-    // match url codes by regex
-    regex matchCode(R"(%([0-9A-F]{2}))");
-
-    // replacement function
-    auto replaceCode = [](vector<string> const& matches) -> string {
-        return string(1, (char) stoul(matches.at(1), nullptr, 16));
-    };
-
-    utils::regexReplaceCallback(input, matchCode, replaceCode);
-
+    urlDecodeInPlace(input);
     return input;
 }
 
+void encoding::urlDecodeInPlace(std::string& input) {
+    // the decoded string can only be shorter, so it is written over the input from the beginning
+    size_t out = 0;
+    for (size_t in = 0; in < input.size(); ++in, ++out) {
+        if (input[in] == '%' && in + 2 < input.size()) {
+            auto high = urlCodingTables.hexValue[static_cast<unsigned char>(input[in + 1])];
+            auto low = urlCodingTables.hexValue[static_cast<unsigned char>(input[in + 2])];
+            if (high >= 0 && low >= 0) {
+                input[out] = static_cast<char>((high << 4) | low);
+                in += 2;
+                continue;
+            }
+        }
+        input[out] = input[in];
+    }
+    input.resize(out);
+}
+
 bool encoding::isBase64(std::string const& input, bool allowWhitespaces) {
     regex rgx;
     if (allowWhitespaces) {
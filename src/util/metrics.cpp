@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file metrics.cpp
+ * \brief Implementation of the metrics functions.
+ */
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <nawa/util/metrics.h>
+
+using namespace nawa;
+using namespace std;
+
+std::atomic<bool> metrics::internal::enabled{false};
+
+namespace {
+    size_t const COUNTERS = 4;
+    size_t const HISTOGRAMS = 5;
+    size_t const BUCKETS = 256; /**< Four buckets per power of two, for 64-bit values. */
+
+    /**
+     * Get the bucket index of a value: values 0 to 3 have their own buckets, larger values are sorted into one of
+     * four buckets per power of two.
+     * @param value The value.
+     * @return The bucket index.
+     */
+    size_t bucketIndex(uint64_t value) {
+        if (value < 4) {
+            return value;
+        }
+        auto msb = static_cast<size_t>(63 - __builtin_clzll(value));
+        return 4 * (msb - 1) + ((value >> (msb - 2)) & 3);
+    }
+
+    /**
+     * Get the largest value which belongs to a bucket.
+     * @param index The bucket index.
+     * @return The upper bound of the bucket.
+     */
+    uint64_t bucketUpperBound(size_t index) {
+        if (index < 4) {
+            return index;
+        }
+        size_t msb = index / 4 + 1;
+        uint64_t lower = (4 + index % 4) << (msb - 2);
+        return lower + ((uint64_t(1) << (msb - 2)) - 1);
+    }
+
+    /**
+     * The metrics of one thread. Only the owning thread writes to them (so plain loads and stores are sufficient,
+     * no atomic read-modify-write operations are needed), other threads read them when aggregating. Records are
+     * never freed, but reused by new threads after their thread has terminated, so that no counts are lost.
+     */
+    struct alignas(64) ThreadMetrics {
+        struct HistogramData {
+            array<atomic<uint64_t>, BUCKETS> buckets{};
+            atomic<uint64_t> count{0};
+            atomic<uint64_t> sum{0};
+        };
+
+        array<atomic<uint64_t>, COUNTERS> counters{};
+        array<HistogramData, HISTOGRAMS> histograms;
+        bool active = true; /**< Guarded by registryLock. */
+    };
+
+    mutex registryLock;
+    vector<unique_ptr<ThreadMetrics>> registry; /**< Guarded by registryLock. */
+
+    void add(atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+
+    /**
+     * Owns the metrics record of the current thread and releases it when the thread terminates.
+     */
+    struct ThreadRecord {
+        ThreadMetrics* metrics;
+
+        ThreadRecord() {
+            lock_guard<mutex> lockGuard(registryLock);
+            for (auto& record : registry) {
+                if (!record->active) {
+                    record->active = true;
+                    metrics = record.get();
+                    return;
+                }
+            }
+            registry.push_back(make_unique<ThreadMetrics>());
+            metrics = registry.back().get();
+        }
+
+        ~ThreadRecord() {
+            lock_guard<mutex> lockGuard(registryLock);
+            metrics->active = false;
+        }
+    };
+
+    ThreadMetrics& threadMetrics() {
+        thread_local ThreadRecord record;
+        return *record.metrics;
+    }
+
+    /**
+     * Properties of a metric for the Prometheus output.
+     */
+    struct MetricInfo {
+        char const* name;
+        char const* help;
+    };
+
+    array<MetricInfo, COUNTERS> const counterInfo{{
+            {"nawa_requests_total", "Requests passed to the request handler."},
+            {"nawa_filtered_requests_total", "Requests answered by an access filter."},
+            {"nawa_flushes_total", "Response flushes."},
+            {"nawa_response_bytes_total", "Response body bytes sent."},
+    }};
+
+    array<MetricInfo, HISTOGRAMS> const histogramInfo{{
+            {"nawa_queue_wait_seconds", "Time from the arrival of a request until it is handled."},
+            {"nawa_filter_duration_seconds", "Time spent applying the access filters."},
+            {"nawa_app_duration_seconds", "Time spent in the request handling function of the app."},
+            {"nawa_flush_duration_seconds", "Time spent flushing responses."},
+            {"nawa_response_size_bytes", "Response body bytes per request."},
+    }};
+
+    /**
+     * Format a number of microseconds as seconds.
+     * @param microseconds The number of microseconds.
+     * @return String representation in seconds.
+     */
+    string formatSeconds(uint64_t microseconds) {
+        auto fraction = to_string(microseconds % 1000000);
+        return to_string(microseconds / 1000000) + '.' + string(6 - fraction.size(), '0') + fraction;
+    }
+}// namespace
+
+uint64_t metrics::HistogramSnapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(count));
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return bucketUpperBound(i);
+        }
+    }
+    return bucketUpperBound(buckets.size() - 1);
+}
+
+uint64_t metrics::HistogramSnapshot::countBelowPowerOfTwo(unsigned int exponent) const {
+    // all values in the buckets before the first bucket of 2^exponent are smaller
+    size_t end = exponent < 2 ? (size_t(1) << exponent) : 4 * (size_t(exponent) - 1);
+    uint64_t result = 0;
+    for (size_t i = 0; i < end && i < buckets.size(); ++i) {
+        result += buckets[i];
+    }
+    return result;
+}
+
+void metrics::enable(bool enable) noexcept {
+    internal::enabled.store(enable, memory_order_relaxed);
+}
+
+void metrics::count(Counter counter, uint64_t amount) noexcept {
+    if (!enabled()) {
+        return;
+    }
+    add(threadMetrics().counters[static_cast<size_t>(counter)], amount);
+}
+
+void metrics::record(Histogram histogram, uint64_t value) noexcept {
+    if (!enabled()) {
+        return;
+    }
+    auto& data = threadMetrics().histograms[static_cast<size_t>(histogram)];
+    add(data.buckets[bucketIndex(value)], 1);
+    add(data.count, 1);
+    add(data.sum, value);
+}
+
+void metrics::recordSince(Histogram histogram, std::chrono::steady_clock::time_point start) noexcept {
+    if (start == chrono::steady_clock::time_point()) {
+        return;
+    }
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    record(histogram, elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0);
+}
+
+uint64_t metrics::getCounter(Counter counter) {
+    uint64_t result = 0;
+    lock_guard<mutex> lockGuard(registryLock);
+    for (auto const& record : registry) {
+        result += record->counters[static_cast<size_t>(counter)].load(memory_order_relaxed);
+    }
+    return result;
+}
+
+metrics::HistogramSnapshot metrics::getHistogram(Histogram histogram) {
+    HistogramSnapshot result;
+    result.buckets.resize(BUCKETS);
+    lock_guard<mutex> lockGuard(registryLock);
+    for (auto const& record : registry) {
+        auto const& data = record->histograms[static_cast<size_t>(histogram)];
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            result.buckets[i] += data.buckets[i].load(memory_order_relaxed);
+        }
+        result.count += data.count.load(memory_order_relaxed);
+        result.sum += data.sum.load(memory_order_relaxed);
+    }
+    return result;
+}
+
+std::string metrics::prometheusText() {
+    string out;
+    for (size_t i = 0; i < COUNTERS; ++i) {
+        auto const& info = counterInfo[i];
+        out += string("# HELP ") + info.name + ' ' + info.help + "\n# TYPE " + info.name + " counter\n";
+        out += string(info.name) + ' ' + to_string(getCounter(static_cast<Counter>(i))) + '\n';
+    }
+    for (size_t i = 0; i < HISTOGRAMS; ++i) {
+        auto const& info = histogramInfo[i];
+        auto histogram = getHistogram(static_cast<Histogram>(i));
+        // durations are recorded in microseconds, but exposed in seconds
+        bool isDuration = static_cast<Histogram>(i) != Histogram::RESPONSE_SIZE;
+        auto format = [isDuration](uint64_t value) { return isDuration ? formatSeconds(value) : to_string(value); };
+        // bucket boundaries: 2^4-1 us to 2^26-1 us (about 67 s), or 2^6-1 bytes to 2^30-1 bytes
+        unsigned int firstExponent = isDuration ? 4 : 6;
+        unsigned int lastExponent = isDuration ? 26 : 30;
+        out += string("# HELP ") + info.name + ' ' + info.help + "\n# TYPE " + info.name + " histogram\n";
+        for (auto exponent = firstExponent; exponent <= lastExponent; ++exponent) {
+            out += string(info.name) + "_bucket{le=\"" + format((uint64_t(1) << exponent) - 1) + "\"} " +
+                   to_string(histogram.countBelowPowerOfTwo(exponent)) + '\n';
+        }
+        out += string(info.name) + "_bucket{le=\"+Inf\"} " + to_string(histogram.count) + '\n';
+        out += string(info.name) + "_sum " + format(histogram.sum) + '\n';
+        out += string(info.name) + "_count " + to_string(histogram.count) + '\n';
+    }
+    return out;
+}
@@ -21,12 +21,13 @@
  * \brief Implementation of the Utils class.
  */
 
-#include <boost/algorithm/string.hpp>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <nawa/Exception.h>
 #include <nawa/util/encoding.h>
 #include <nawa/util/utils.h>
+#include <optional>
 #include <unordered_map>
 
 using namespace nawa;
@@ -120,6 +121,198 @@ namespace {
             {"3g2", "video/3gpp2"},
             {"7z", "application/x-7z-compressed"}};
 
+    char const* const httpDayNames[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    char const* const httpMonthNames[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                          "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    /**
+     * Write a number with a fixed number of digits (with leading zeros) into a buffer.
+     * @param out Pointer to the buffer, will be advanced by the number of digits.
+     * @param value The number.
+     * @param digits Number of digits.
+     */
+    inline void writeDigits(char*& out, unsigned int value, int digits) {
+        for (int i = digits - 1; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        out += digits;
+    }
+
+    /**
+     * Parse a fixed number of decimal digits.
+     * @param in The string view, will be advanced by the number of digits on success.
+     * @param digits Number of digits.
+     * @return The value, or nullopt if the view does not start with the given number of digits.
+     */
+    inline optional<int> readDigits(string_view& in, size_t digits) {
+        if (in.size() < digits) {
+            return nullopt;
+        }
+        int value = 0;
+        for (size_t i = 0; i < digits; ++i) {
+            if (in[i] < '0' || in[i] > '9') {
+                return nullopt;
+            }
+            value = value * 10 + (in[i] - '0');
+        }
+        in.remove_prefix(digits);
+        return value;
+    }
+
+    /**
+     * Consume an expected prefix.
+     * @param in The string view, will be advanced on success.
+     * @param expected The expected prefix.
+     * @return True if the view started with the expected prefix.
+     */
+    inline bool readLiteral(string_view& in, string_view expected) {
+        if (in.substr(0, expected.size()) != expected) {
+            return false;
+        }
+        in.remove_prefix(expected.size());
+        return true;
+    }
+
+    /**
+     * Parse a three-letter month name (as used in HTTP dates).
+     * @param in The string view, will be advanced on success.
+     * @return The month (0-11), or nullopt if it is not a valid month name.
+     */
+    inline optional<int> readMonth(string_view& in) {
+        for (int i = 0; i < 12; ++i) {
+            if (readLiteral(in, httpMonthNames[i])) {
+                return i;
+            }
+        }
+        return nullopt;
+    }
+
+    /**
+     * Convert a UTC date and time to a UNIX timestamp, without depending on the time zone or locale (algorithm
+     * days_from_civil by Howard Hinnant).
+     * @return The UNIX timestamp, or nullopt if a component is out of range.
+     */
+    optional<time_t> makeUnixTime(int year, int month, int day, int hour, int minute, int second) {
+        if (month < 0 || month > 11 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+            return nullopt;
+        }
+        int y = year - (month < 2 ? 1 : 0);
+        int m = month + 1;
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yoe = y - era * 400;
+        int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        time_t days = static_cast<time_t>(era) * 146097 + doe - 719468;
+        return days * 86400 + hour * 3600 + minute * 60 + second;
+    }
+
+    /**
+     * Parse the time of day in the format "HH:MM:SS".
+     * @param in The string view, will be advanced on success.
+     * @return Tuple of hour, minute, and second, or nullopt on failure.
+     */
+    optional<tuple<int, int, int>> readTimeOfDay(string_view& in) {
+        auto hour = readDigits(in, 2);
+        if (!hour || !readLiteral(in, ":")) {
+            return nullopt;
+        }
+        auto minute = readDigits(in, 2);
+        if (!minute || !readLiteral(in, ":")) {
+            return nullopt;
+        }
+        auto second = readDigits(in, 2);
+        if (!second) {
+            return nullopt;
+        }
+        return make_tuple(*hour, *minute, *second);
+    }
+
+    /**
+     * Parse a HTTP date in one of the three formats defined in RFC 7231, section 7.1.1.1.
+     * @param in The HTTP date string, which must not contain anything after the date.
+     * @return The UNIX timestamp, or nullopt if parsing failed.
+     */
+    optional<time_t> parseHttpTime(string_view in) {
+        auto comma = in.find(',');
+        // IMF-fixdate (preferred format): "Sun, 06 Nov 1994 08:49:37 GMT"
+        if (comma == 3) {
+            in.remove_prefix(4);
+            if (!readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto day = readDigits(in, 2);
+            if (!day || !readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto month = readMonth(in);
+            if (!month || !readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto year = readDigits(in, 4);
+            if (!year || !readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto timeOfDay = readTimeOfDay(in);
+            if (!timeOfDay || !readLiteral(in, " GMT") || !in.empty()) {
+                return nullopt;
+            }
+            auto [hour, minute, second] = *timeOfDay;
+            return makeUnixTime(*year, *month, *day, hour, minute, second);
+        }
+        // obsolete RFC 850 format: "Sunday, 06-Nov-94 08:49:37 GMT"
+        if (comma != string_view::npos) {
+            in.remove_prefix(comma + 1);
+            if (!readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto day = readDigits(in, 2);
+            if (!day || !readLiteral(in, "-")) {
+                return nullopt;
+            }
+            auto month = readMonth(in);
+            if (!month || !readLiteral(in, "-")) {
+                return nullopt;
+            }
+            auto year = readDigits(in, 2);
+            if (!year || !readLiteral(in, " ")) {
+                return nullopt;
+            }
+            auto timeOfDay = readTimeOfDay(in);
+            if (!timeOfDay || !readLiteral(in, " GMT") || !in.empty()) {
+                return nullopt;
+            }
+            auto [hour, minute, second] = *timeOfDay;
+            // two-digit years below 70 are interpreted as 20xx, as UNIX timestamps start in 1970
+            return makeUnixTime(*year < 70 ? 2000 + *year : 1900 + *year, *month, *day, hour, minute, second);
+        }
+        // ANSI C asctime() format: "Sun Nov  6 08:49:37 1994"
+        if (in.size() < 4 || in[3] != ' ') {
+            return nullopt;
+        }
+        in.remove_prefix(4);
+        auto month = readMonth(in);
+        if (!month || !readLiteral(in, " ")) {
+            return nullopt;
+        }
+        // the day of month is padded with a space instead of a zero
+        bool padded = readLiteral(in, " ");
+        auto day = readDigits(in, padded ? 1 : 2);
+        if (!day || !readLiteral(in, " ")) {
+            return nullopt;
+        }
+        auto timeOfDay = readTimeOfDay(in);
+        if (!timeOfDay || !readLiteral(in, " ")) {
+            return nullopt;
+        }
+        auto year = readDigits(in, 4);
+        if (!year || !in.empty()) {
+            return nullopt;
+        }
+        auto [hour, minute, second] = *timeOfDay;
+        return makeUnixTime(*year, *month, *day, hour, minute, second);
+    }
+
     /**
      * Get the day of week as a string. This function is used instead of the %a specifier, as it is locale-independent,
      * and checking and setting the locale is not the best idea (not thread-safe).
@@ -245,12 +438,14 @@ void utils::regexReplaceCallback(std::string& s, std::regex const& rgx,
 }
 
 std::string utils::hexDump(std::string const& in) {
-    stringstream rets;
-    rets << hex << setfill('0');
-    for (char c : in) {
-        rets << setw(2) << (int) (unsigned char) c;
+    static char const digits[] = "0123456789abcdef";
+    string ret(in.size() * 2, '\0');
+    for (size_t i = 0; i < in.size(); ++i) {
+        auto c = static_cast<unsigned char>(in[i]);
+        ret[2 * i] = digits[c >> 4];
+        ret[2 * i + 1] = digits[c & 0x0f];
     }
-    return rets.str();
+    return ret;
 }
 
 std::string utils::toLowercase(std::string s) {
@@ -357,36 +552,50 @@ std::string utils::contentTypeByExtension(std::string extension) {
 }
 
 std::string utils::makeHttpTime(time_t time) {
-    stringstream httpTime;
     tm gmt{};
     auto retPtr = gmtime_r(&time, &gmt);
     if (retPtr == nullptr) {
         throw Exception(__PRETTY_FUNCTION__, 1, "Interpretation of UNIX timestamp failed.", strerror(errno));
     }
 
-    httpTime << getDayOfWeek(gmt.tm_wday) << put_time(&gmt, ", %d ") << getMonth(gmt.tm_mon);
-    httpTime << put_time(&gmt, " %Y %H:%M:%S GMT");
-
-    return httpTime.str();
+    // fixed format (IMF-fixdate): "Sun, 06 Nov 1994 08:49:37 GMT"
+    string httpTime(29, ' ');
+    char* out = &httpTime[0];
+    memcpy(out, httpDayNames[gmt.tm_wday], 3);
+    out[3] = ',';
+    out += 5;
+    writeDigits(out, gmt.tm_mday, 2);
+    memcpy(++out, httpMonthNames[gmt.tm_mon], 3);
+    out += 4;
+    writeDigits(out, gmt.tm_year + 1900, 4);
+    ++out;
+    writeDigits(out, gmt.tm_hour, 2);
+    *out++ = ':';
+    writeDigits(out, gmt.tm_min, 2);
+    *out++ = ':';
+    writeDigits(out, gmt.tm_sec, 2);
+    memcpy(out, " GMT", 4);
+
+    return httpTime;
 }
 
 time_t utils::readHttpTime(std::string const& httpTime) {
-    tm timeStruct{};
-    istringstream timeStream(httpTime);
-    timeStream.exceptions(ifstream::failbit);
-    try {
-        timeStream >> get_time(&timeStruct, "%a, %d %b %Y %H:%M:%S GMT");
-    } catch (ios_base::failure const& e) {
-        throw Exception(__PRETTY_FUNCTION__, 1, "Parsing of HTTP timestamp failed.", e.what());
+    auto unixTime = parseHttpTime(httpTime);
+    if (!unixTime) {
+        throw Exception(__PRETTY_FUNCTION__, 1, "Parsing of HTTP timestamp failed.");
     }
+    return *unixTime;
+}
 
-    // timegm will interpret the tm as UTC and convert it to a time_t
-    time_t unixTime = timegm(&timeStruct);
-    if (unixTime == -1) {
-        throw Exception(__PRETTY_FUNCTION__, 1, "Conversion of parsed HTTP timestamp to a UNIX timestamp failed.", strerror(errno));
+std::string const& utils::currentHttpTime() {
+    thread_local time_t cachedTime = -1;
+    thread_local string cachedHttpTime;
+    auto now = time(nullptr);
+    if (now != cachedTime) {
+        cachedHttpTime = makeHttpTime(now);
+        cachedTime = now;
     }
-
-    return unixTime;
+    return cachedHttpTime;
 }
 
 std::string utils::makeSmtpTime(time_t time) {
@@ -447,17 +656,16 @@ time_t utils::readSmtpTime(std::string const& smtpTime) {
 
 std::vector<std::string> utils::splitString(std::string str, char delimiter, bool ignoreEmpty) {
     vector<string> ret;
-    for (size_t pos = 0; !str.empty();) {
-        pos = str.find_first_of(delimiter);
-        auto token = str.substr(0, pos);
-        if (!ignoreEmpty || !token.empty()) {
-            ret.push_back(str.substr(0, pos));
+    // search from the current position instead of cutting off the string, so that splitting is linear
+    for (size_t start = 0; start < str.length();) {
+        auto pos = str.find(delimiter, start);
+        if (pos == string::npos) {
+            pos = str.length();
         }
-        if (pos < str.length()) {
-            str = str.substr(pos + 1);
-        } else {
-            break;
+        if (!ignoreEmpty || pos > start) {
+            ret.emplace_back(str, start, pos - start);
         }
+        start = pos + 1;
     }
     return ret;
 }
@@ -474,9 +682,17 @@ std::string utils::mergePath(std::vector<std::string> const& path) {
 }
 
 std::vector<std::string> utils::splitPath(std::string const& pathString) {
-    // remove query string
-    string rawPath = pathString.substr(0, pathString.find('?'));
-    return splitString(rawPath, '/', true);
+    // ignore the query string
+    auto end = min(pathString.find('?'), pathString.length());
+    vector<string> ret;
+    for (size_t start = 0; start < end;) {
+        auto pos = min(pathString.find('/', start), end);
+        if (pos > start) {
+            ret.emplace_back(pathString, start, pos - start);
+        }
+        start = pos + 1;
+    }
+    return ret;
 }
 
 std::string utils::convertLineEndings(std::string const& in, std::string const& ending) {
@@ -529,58 +745,94 @@ std::string utils::stringReplace(std::string input, std::unordered_map<std::stri
 }
 
 std::unordered_multimap<std::string, std::string> utils::splitQueryString(std::string const& queryString) {
-    string qs;
-    size_t qmrkPos = queryString.find_first_of('?');
     unordered_multimap<string, string> ret;
-    if (qmrkPos != string::npos && queryString.length() > qmrkPos) {
-        qs = queryString.substr(qmrkPos + 1);
-    } else if (qmrkPos == string::npos) {
-        qs = queryString;
-    }
-    auto pairs = splitString(qs, '&', true);
-    for (auto const& p : pairs) {
-        size_t eqPos = p.find_first_of('=');
-        string k = p.substr(0, eqPos);
-        string v = (eqPos < p.length() - 1) ? encoding::urlDecode(p.substr(eqPos + 1)) : "";
-        ret.insert({k, v});
+    for (auto const& [key, value] : splitQueryStringView(queryString)) {
+        string decodedValue(value);
+        encoding::urlDecodeInPlace(decodedValue);
+        ret.insert({string(key), std::move(decodedValue)});
+    }
+    return ret;
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> utils::splitQueryStringView(std::string_view queryString) {
+    auto qmrkPos = queryString.find('?');
+    if (qmrkPos != string_view::npos) {
+        queryString.remove_prefix(qmrkPos + 1);
+    }
+    vector<pair<string_view, string_view>> ret;
+    for (size_t start = 0; start < queryString.length();) {
+        auto pos = min(queryString.find('&', start), queryString.length());
+        if (pos > start) {
+            auto pair = queryString.substr(start, pos - start);
+            auto eqPos = pair.find('=');
+            if (eqPos == string_view::npos) {
+                ret.emplace_back(pair, string_view());
+            } else {
+                ret.emplace_back(pair.substr(0, eqPos), pair.substr(eqPos + 1));
+            }
+        }
+        start = pos + 1;
     }
     return ret;
 }
 
 std::unordered_map<std::string, std::string> utils::parseHeaders(std::string rawHeaders) {
     unordered_map<string, string> ret;
-    // filter out carriage returns
-    boost::erase_all(rawHeaders, "\r");
-    // split
-    auto lines = splitString(rawHeaders, '\n', true);
-    for (auto const& line : lines) {
-        auto colonPos = line.find_first_of(':');
-        if (line.length() < colonPos + 2) {
+    for (auto const& [key, value] : parseHeadersView(rawHeaders)) {
+        ret[toLowercase(string(key))] = value;
+    }
+    return ret;
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> utils::parseHeadersView(std::string_view rawHeaders) {
+    vector<pair<string_view, string_view>> ret;
+    for (size_t start = 0; start < rawHeaders.length();) {
+        auto pos = min(rawHeaders.find('\n', start), rawHeaders.length());
+        auto line = rawHeaders.substr(start, pos - start);
+        start = pos + 1;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        auto colonPos = line.find(':');
+        if (colonPos == string_view::npos) {
             continue;
         }
-        auto key = toLowercase(line.substr(0, colonPos));
-        auto val = line.substr(colonPos + 1);
-        boost::trim_left(val);
-        ret[key] = val;
+        auto value = line.substr(colonPos + 1);
+        value.remove_prefix(min(value.find_first_not_of(" \t"), value.length()));
+        if (value.empty()) {
+            continue;
+        }
+        ret.emplace_back(line.substr(0, colonPos), value);
     }
     return ret;
 }
 
 std::unordered_multimap<std::string, std::string> utils::parseCookies(std::string const& rawCookies) {
     unordered_multimap<string, string> ret;
-    // split by ;
-    auto cookies = splitString(rawCookies, ';', true);
-    for (auto c : cookies) {
+    for (auto const& [key, value] : parseCookiesView(rawCookies)) {
+        ret.insert({string(key), string(value)});
+    }
+    return ret;
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> utils::parseCookiesView(std::string_view rawCookies) {
+    vector<pair<string_view, string_view>> ret;
+    for (size_t start = 0; start < rawCookies.length();) {
+        auto pos = min(rawCookies.find(';', start), rawCookies.length());
+        auto cookie = rawCookies.substr(start, pos - start);
+        start = pos + 1;
         // remove whitespaces
-        boost::trim(c);
+        auto first = cookie.find_first_not_of(" \t");
+        if (first == string_view::npos) {
+            continue;
+        }
+        cookie = cookie.substr(first, cookie.find_last_not_of(" \t") - first + 1);
         // key and value
-        auto eqPos = c.find_first_of('=');
-        if (c.length() < eqPos + 2) {
+        auto eqPos = cookie.find('=');
+        if (eqPos == string_view::npos || eqPos + 1 == cookie.length()) {
             continue;
         }
-        auto key = c.substr(0, eqPos);
-        auto val = c.substr(eqPos + 1);
-        ret.insert({key, val});
+        ret.emplace_back(cookie.substr(0, eqPos), cookie.substr(eqPos + 1));
     }
     return ret;
 }
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file http.cpp
+ * \brief Benchmark for the HTTP request handler engines (requests per second with keep-alive and pipelining).
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <nawa/Exception.h>
+#include <nawa/RequestHandler/RequestHandler.h>
+#include <nawa/connection/Connection.h>
+#include <nawa/util/utils.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace nawa;
+using namespace std;
+
+namespace {
+    struct Options {
+        int connections = 64;
+        int threads = 4;      /**< Worker threads of the request handler. */
+        int seconds = 5;
+        int pipeline = 1;     /**< Number of requests sent at once on every connection. */
+        string engine = "both";
+        int port = 8090;
+    };
+
+    /**
+     * A client connection which sends requests and counts the complete responses. If the server closes the
+     * connection (e.g., because it does not support keep-alive), a new connection is opened.
+     */
+    class BenchmarkClient {
+        int port;
+        int pipeline;
+        int fd = -1;
+        string request;
+        string input;
+
+        bool connectToServer() {
+            if (fd >= 0) {
+                close(fd);
+            }
+            input.clear();
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            return connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0;
+        }
+
+        /**
+         * Receive more data.
+         * @return False if the connection has been closed.
+         */
+        bool receive() {
+            char buffer[16384];
+            auto received = recv(fd, buffer, sizeof buffer, 0);
+            if (received < 0 && errno == EINTR) {
+                return true;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            input.append(buffer, received);
+            return true;
+        }
+
+        /**
+         * Read one response.
+         * @param keepAlive Set to false if the server closes the connection after this response.
+         * @return True if a complete response has been received.
+         */
+        bool readResponse(bool& keepAlive) {
+            size_t headerEnd;
+            while ((headerEnd = input.find("\r\n\r\n")) == string::npos) {
+                if (!receive()) {
+                    return false;
+                }
+            }
+            auto head = utils::toLowercase(input.substr(0, headerEnd + 4));
+            keepAlive = head.find("\r\nconnection: close\r\n") == string::npos;
+            auto lengthPos = head.find("\r\ncontent-length:");
+            if (lengthPos == string::npos) {
+                // the body ends when the connection is closed
+                while (receive()) {}
+                keepAlive = false;
+                input.clear();
+                return true;
+            }
+            auto bodySize = stoul(head.substr(lengthPos + 17));
+            while (input.size() < headerEnd + 4 + bodySize) {
+                if (!receive()) {
+                    return false;
+                }
+            }
+            input.erase(0, headerEnd + 4 + bodySize);
+            return true;
+        }
+
+    public:
+        BenchmarkClient(int port, int pipeline) : port(port), pipeline(pipeline) {
+            string single = "GET /hello HTTP/1.1\r\nhost: 127.0.0.1:" + to_string(port) + "\r\nuser-agent: nawa-benchmark\r\n\r\n";
+            for (int i = 0; i < pipeline; ++i) {
+                request += single;
+            }
+        }
+
+        ~BenchmarkClient() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        /**
+         * Send requests until the stop flag is set.
+         * @return Number of complete responses.
+         */
+        unsigned long run(atomic<bool> const& stopFlag, unsigned long& errors) {
+            unsigned long responses = 0;
+            bool connected = connectToServer();
+            while (!stopFlag.load(memory_order_relaxed)) {
+                if (!connected || send(fd, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())) {
+                    ++errors;
+                    connected = connectToServer();
+                    continue;
+                }
+                bool keepAlive = true;
+                for (int i = 0; i < pipeline && keepAlive; ++i) {
+                    if (!readResponse(keepAlive)) {
+                        ++errors;
+                        keepAlive = false;
+                        break;
+                    }
+                    ++responses;
+                }
+                if (!keepAlive) {
+                    connected = connectToServer();
+                }
+            }
+            return responses;
+        }
+    };
+
+    /**
+     * Run the benchmark against one engine.
+     * @return Requests per second, or -1 if the request handler could not be created.
+     */
+    double runBenchmark(Options const& options, string const& engine) {
+        Config config;
+        config.insert({
+                {{"system", "request_handler"}, "http"},
+                {{"http", "engine"}, engine},
+                {{"http", "listen"}, "127.0.0.1"},
+                {{"http", "port"}, to_string(options.port)},
+                {{"http", "reuseaddr"}, "on"},
+                {{"logging", "level"}, "error"},
+        });
+        unique_ptr<RequestHandler> requestHandler;
+        try {
+            requestHandler = RequestHandler::newRequestHandler(
+                    [](Connection& connection) {
+                        connection.setHeader("content-type", "text/plain");
+                        connection.responseStream() << "Hello World!";
+                        return 0;
+                    },
+                    config, options.threads);
+            requestHandler->start();
+        } catch (Exception const& e) {
+            cerr << "Could not start the " << engine << " engine: " << e.getMessage() << endl;
+            return -1;
+        }
+
+        atomic<bool> stopFlag(false);
+        vector<thread> clientThreads;
+        vector<unsigned long> responses(options.connections);
+        vector<unsigned long> errors(options.connections);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < options.connections; ++i) {
+            clientThreads.emplace_back([&, i] {
+                BenchmarkClient client(options.port, options.pipeline);
+                responses[i] = client.run(stopFlag, errors[i]);
+            });
+        }
+        this_thread::sleep_for(chrono::seconds(options.seconds));
+        stopFlag = true;
+        for (auto& t : clientThreads) {
+            t.join();
+        }
+        chrono::duration<double> duration = chrono::steady_clock::now() - start;
+
+        requestHandler->terminate();
+        requestHandler->join();
+
+        unsigned long totalResponses = 0;
+        unsigned long totalErrors = 0;
+        for (int i = 0; i < options.connections; ++i) {
+            totalResponses += responses[i];
+            totalErrors += errors[i];
+        }
+        auto requestsPerSecond = totalResponses / duration.count();
+        cout << engine << ": " << totalResponses << " requests in " << duration.count() << " s, "
+             << static_cast<unsigned long>(requestsPerSecond) << " requests/s, " << totalErrors << " errors" << endl;
+        return requestsPerSecond;
+    }
+}// namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto valueStart = arg.find('=');
+        auto name = arg.substr(0, valueStart);
+        auto value = valueStart == string::npos ? string() : arg.substr(valueStart + 1);
+        try {
+            if (name == "--connections") {
+                options.connections = stoi(value);
+            } else if (name == "--threads") {
+                options.threads = stoi(value);
+            } else if (name == "--seconds") {
+                options.seconds = stoi(value);
+            } else if (name == "--pipeline") {
+                options.pipeline = stoi(value);
+            } else if (name == "--port") {
+                options.port = stoi(value);
+            } else if (name == "--engine" && (value == "native" || value == "netlib" || value == "both")) {
+                options.engine = value;
+            } else {
+                throw invalid_argument(arg);
+            }
+        } catch (logic_error const&) {
+            cerr << "Usage: " << argv[0]
+                 << " [--connections=N] [--threads=N] [--seconds=N] [--pipeline=N] [--port=N]"
+                    " [--engine=native|netlib|both]"
+                 << endl;
+            return 1;
+        }
+    }
+    if (options.connections < 1 || options.threads < 1 || options.seconds < 1 || options.pipeline < 1) {
+        cerr << "All numbers must be positive." << endl;
+        return 1;
+    }
+
+    cout << options.connections << " connections, " << options.threads << " server threads, pipeline depth "
+         << options.pipeline << ", " << options.seconds << " s per engine" << endl;
+    double native = -1;
+    double netlib = -1;
+    if (options.engine != "netlib") {
+        native = runBenchmark(options, "native");
+    }
+    if (options.engine != "native") {
+        netlib = runBenchmark(options, "netlib");
+    }
+    if (native > 0 && netlib > 0) {
+        cout << "native/netlib: " << native / netlib << endl;
+    }
+    return (native < 0 && netlib < 0) ? 1 : 0;
+}
@@ -27,6 +27,10 @@
 #include <nawa/RequestHandler/RequestHandler.h>
 #include <nawa/connection/Connection.h>
 #include <nawa/util/utils.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace nawa;
 using namespace std;
@@ -69,6 +73,30 @@ namespace {
         isEnvironmentInitialized = true;
         return true;
     }
+
+    /**
+     * Send raw data to the server and read everything it sends until it closes the connection.
+     * @param rawRequest The data to send (one or more requests).
+     * @return The raw response(s).
+     */
+    string sendRawRequest(string const& rawRequest) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(stoi(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        string response;
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) == 0 &&
+            send(fd, rawRequest.data(), rawRequest.size(), 0) == ssize_t(rawRequest.size())) {
+            char buffer[4096];
+            ssize_t received;
+            while ((received = recv(fd, buffer, sizeof buffer, 0)) > 0) {
+                response.append(buffer, received);
+            }
+        }
+        close(fd);
+        return response;
+    }
 }// namespace
 
 TEST_CASE("Basic request handling (HTTP)", "[basic][http]") {
@@ -203,3 +231,133 @@ TEST_CASE("Sessions (HTTP)", "[sessions][http]") {
     REQUIRE_NOTHROW(response = client.get(request));
     CHECK(response.body() == "testVal");
 }
+
+TEST_CASE("Keep-alive and pipelining (HTTP)", "[keepalive][http]") {
+    REQUIRE(initializeEnvironmentIfNotYetDone());
+    auto& requestHandler = httpRequestHandler;
+
+    auto handlingFunction = [](Connection& connection) -> int {
+        auto const& env = connection.request().env();
+        if (env["REQUEST_URI"] == "/stream") {
+            connection.responseStream() << "first";
+            connection.flushResponse();
+            connection.responseStream() << "second";
+            return 0;
+        }
+        connection.responseStream() << env["REQUEST_METHOD"] << " " << env["REQUEST_URI"];
+        return 0;
+    };
+    REQUIRE_NOTHROW(
+            requestHandler->reconfigure(make_shared<HandleRequestFunctionWrapper>(handlingFunction), nullopt, config));
+    REQUIRE_NOTHROW(requestHandler->start());
+
+    SECTION("Pipelined requests on one connection") {
+        auto response = sendRawRequest("GET /r1 HTTP/1.1\r\nhost: localhost\r\n\r\n"
+                                       "POST /r2 HTTP/1.1\r\nhost: localhost\r\ncontent-length: 3\r\n\r\na=b"
+                                       "GET /r3 HTTP/1.1\r\nhost: localhost\r\nconnection: close\r\n\r\n");
+        auto first = response.find("\r\n\r\nGET /r1");
+        auto second = response.find("\r\n\r\nPOST /r2");
+        auto third = response.find("\r\n\r\nGET /r3");
+        CHECK(response.substr(0, 17) == "HTTP/1.1 200 OK\r\n");
+        REQUIRE(first != string::npos);
+        REQUIRE(second != string::npos);
+        REQUIRE(third != string::npos);
+        CHECK(first < second);
+        CHECK(second < third);
+        CHECK(response.find("content-length: 7\r\n") != string::npos);
+        CHECK(response.find("connection: close\r\n") > second);
+    }
+
+    SECTION("Streamed response") {
+        auto response = sendRawRequest("GET /stream HTTP/1.1\r\nhost: localhost\r\nconnection: close\r\n\r\n");
+        CHECK(response.find("transfer-encoding: chunked\r\n") != string::npos);
+        CHECK(response.substr(response.find("\r\n\r\n") + 4) == "5\r\nfirst\r\n6\r\nsecond\r\n0\r\n\r\n");
+
+        response = sendRawRequest("GET /stream HTTP/1.0\r\n\r\n");
+        CHECK(response.find("transfer-encoding") == string::npos);
+        CHECK(response.substr(response.find("\r\n\r\n") + 4) == "firstsecond");
+    }
+
+    SECTION("Malformed requests") {
+        CHECK(sendRawRequest("GARBAGE\r\n\r\n").substr(0, 24) == "HTTP/1.1 400 Bad Request");
+        CHECK(sendRawRequest("GET / HTTP/2.0\r\n\r\n").substr(0, 12) == "HTTP/1.1 505");
+        CHECK(sendRawRequest("POST / HTTP/1.1\r\ncontent-length: 5000\r\n\r\n").substr(0, 12) == "HTTP/1.1 413");
+    }
+}
+
+TEST_CASE("Large POST bodies (HTTP)", "[post][http]") {
+    REQUIRE(initializeEnvironmentIfNotYetDone());
+    auto& requestHandler = httpRequestHandler;
+
+    auto handlingFunction = [](Connection& connection) -> int {
+        connection.responseStream() << connection.request().post()["a"].size();
+        return 0;
+    };
+    // the body is larger than the amount of input the native engine buffers for pipelined requests
+    auto largePostConfig = config;
+    largePostConfig.set({"post", "max_size"}, "1000");
+    REQUIRE_NOTHROW(requestHandler->reconfigure(make_shared<HandleRequestFunctionWrapper>(handlingFunction), nullopt,
+                                                largePostConfig));
+    REQUIRE_NOTHROW(requestHandler->start());
+
+    string body = "a=" + string(500000, 'b');
+    auto response = sendRawRequest("POST / HTTP/1.1\r\nhost: localhost\r\nconnection: close\r\n"
+                                   "content-type: application/x-www-form-urlencoded\r\ncontent-length: " +
+                                   to_string(body.size()) + "\r\n\r\n" + body);
+    CHECK(response.substr(0, 17) == "HTTP/1.1 200 OK\r\n");
+    CHECK(response.substr(response.find("\r\n\r\n") + 4) == "500000");
+}
+
+TEST_CASE("Concurrent streamed responses (HTTP)", "[streaming][http]") {
+    REQUIRE(initializeEnvironmentIfNotYetDone());
+    auto& requestHandler = httpRequestHandler;
+
+    // both responses are much larger than the socket buffers, so that the worker cannot send them at once
+    size_t const chunkSize = 512 * 1024;
+    int const chunkCount = 8;
+    auto handlingFunction = [=](Connection& connection) -> int {
+        for (int i = 0; i < chunkCount; ++i) {
+            connection.responseStream() << string(chunkSize, static_cast<char>('a' + i));
+            connection.flushResponse();
+        }
+        return 0;
+    };
+    REQUIRE_NOTHROW(
+            requestHandler->reconfigure(make_shared<HandleRequestFunctionWrapper>(handlingFunction), nullopt, config));
+    REQUIRE_NOTHROW(requestHandler->start());
+
+    string responses[2];
+    vector<thread> clients;
+    for (auto& response : responses) {
+        clients.emplace_back([&response] {
+            response = sendRawRequest("GET /stream HTTP/1.1\r\nhost: localhost\r\nconnection: close\r\n\r\n");
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    for (auto const& response : responses) {
+        auto pos = response.find("\r\n\r\n");
+        REQUIRE(pos != string::npos);
+        CHECK(response.find("transfer-encoding: chunked\r\n") < pos);
+        // decode the chunked body
+        string body;
+        pos += 4;
+        while (pos < response.size()) {
+            auto lineEnd = response.find("\r\n", pos);
+            REQUIRE(lineEnd != string::npos);
+            auto size = stoul(response.substr(pos, lineEnd - pos), nullptr, 16);
+            if (size == 0) {
+                break;
+            }
+            body += response.substr(lineEnd + 2, size);
+            pos = lineEnd + 2 + size + 2;
+        }
+        REQUIRE(body.size() == chunkSize * chunkCount);
+        for (int i = 0; i < chunkCount; ++i) {
+            auto chunkEnd = i + 1 < chunkCount ? (i + 1) * chunkSize : string::npos;
+            CHECK(body.find_first_not_of(static_cast<char>('a' + i), i * chunkSize) == chunkEnd);
+        }
+    }
+}
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file connection.cpp
+ * \brief Unit tests for the nawa::Connection class.
+ */
+
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <nawa/Exception.h>
+#include <nawa/connection/Connection.h>
+#include <nawa/connection/ConnectionInitContainer.h>
+#include <nawa/connection/StaticFileCache.h>
+#include <nawa/filter/AccessFilterList.h>
+#include <nawa/logging/AccessLog.h>
+#include <nawa/util/ThreadLocalPool.h>
+#include <nawa/util/utils.h>
+
+using namespace nawa;
+using namespace std;
+
+TEST_CASE("nawa::Connection class", "[unit][connection]") {
+    ConnectionInitContainer connectionInit;
+    vector<string> flushedBodies;
+    size_t headerFlushes = 0;
+    connectionInit.flushCallback = [&](FlushCallbackContainer const& flushInfo) {
+        if (!flushInfo.flushedBefore) {
+            ++headerFlushes;
+            CHECK(flushInfo.headers.count("content-type") == 1);
+        } else {
+            CHECK(flushInfo.headers.empty());
+        }
+        flushedBodies.emplace_back(flushInfo.body);
+        CHECK(flushInfo.forEachFileChunk([&](string_view chunk) { flushedBodies.back() += chunk; }, 7));
+    };
+
+    SECTION("Buffered response") {
+        Connection connection(connectionInit);
+        connection.responseStream() << "Hello" << ' ' << 42;
+        connection.write("!");
+        CHECK(connection.getResponseBody() == "Hello 42!");
+        connection.flushResponse();
+        connection.responseStream() << "more";
+        connection.flushResponse();
+        CHECK(headerFlushes == 1);
+        CHECK(flushedBodies == vector<string>{"Hello 42!", "more"});
+        CHECK(connection.getResponseBody().empty());
+    }
+
+    SECTION("Request data") {
+        connectionInit.requestInit.environment["REQUEST_URI"] = "/dir/page?x=1";
+        connectionInit.requestInit.getVars = utils::splitQueryString("/dir/page?x=1");
+        connectionInit.requestInit.cookieVars = utils::parseCookies("c=2");
+        connectionInit.requestInit.postVars.insert({"p", "3"});
+        connectionInit.requestInit.postContentType = "application/x-www-form-urlencoded";
+
+        Connection copied(connectionInit);
+        CHECK(connectionInit.requestInit.getVars.size() == 1);
+        Connection moved(std::move(connectionInit));
+        for (auto connection : {&copied, &moved}) {
+            auto const& request = connection->request();
+            CHECK(request.env().getRequestPath() == vector<string>{"dir", "page"});
+            CHECK(request.get()["x"] == "1");
+            CHECK(request.cookie()["c"] == "2");
+            CHECK(request.post()["p"] == "3");
+            CHECK(request.post().getContentType() == "application/x-www-form-urlencoded");
+        }
+    }
+
+    SECTION("Buffer recycling") {
+        {
+            Connection connection(connectionInit);
+            connection.write(string(10000, 'a'));
+            connection.flushResponse();
+        }
+        // the body buffer of the destroyed connection is reused by the next connection in this thread
+        auto recycled = ThreadLocalPool<string>::acquire();
+        CHECK(recycled.empty());
+        CHECK(recycled.capacity() >= 10000);
+    }
+
+    SECTION("Config snapshot") {
+        connectionInit.config.set({"app", "key"}, "original");
+        Connection connection(connectionInit);
+        CHECK(connection.config()[{"app", "key"}] == "original");
+        // modifications during a request only affect the copy of the connection
+        connection.config().set({"app", "key"}, "modified");
+        CHECK(connection.config()[{"app", "key"}] == "modified");
+        CHECK(connectionInit.config[{"app", "key"}] == "original");
+        Config copy = connectionInit.config;
+        connectionInit.config.override({{{"app", "key"}, "overridden"}});
+        CHECK(copy[{"app", "key"}] == "original");
+    }
+
+    SECTION("Shared config") {
+        Config shared({{{"app", "key"}, "shared"}});
+        connectionInit.sharedConfig = &shared;
+        Connection connection(connectionInit);
+        // reading does not copy the shared config, modifying does
+        CHECK(&as_const(connection).config() == &shared);
+        connection.config().set({"app", "key"}, "modified");
+        CHECK(&as_const(connection).config() != &shared);
+        CHECK(connection.config()[{"app", "key"}] == "modified");
+        CHECK(shared[{"app", "key"}] == "shared");
+    }
+
+    SECTION("Config keys") {
+        Config::Key const numberKey({"app", "number"});
+        Config::Key const switchKey({"app", "switch"});
+        CHECK(Config::Key({"app", "number"}).getId() == numberKey.getId());
+        CHECK(numberKey.getPair() == pair<string, string>{"app", "number"});
+        Config config{{{"app", "number"}, "42"}, {{"app", "switch"}, "off"}};
+        CHECK(config.isSet(numberKey));
+        CHECK(config[numberKey] == "42");
+        CHECK(config.getNumber(numberKey) == 42);
+        CHECK(config.getSwitch(switchKey) == false);
+        CHECK_FALSE(config.getNumber(switchKey));
+        config.set({"app", "switch"}, "on");
+        CHECK(config.getSwitch(switchKey) == true);
+        // cached values of a copy are not affected by modifications
+        Config copy = config;
+        config.set({"app", "number"}, "invalid");
+        CHECK_FALSE(config.getNumber(numberKey));
+        CHECK(copy.getNumber(numberKey) == 42);
+        // keys interned after the last modification are looked up directly
+        Config::Key const lateKey({"app", "late_key"});
+        CHECK_FALSE(config.isSet(lateKey));
+        config.set({"app", "late_key"}, "7");
+        CHECK(config.getNumber(lateKey) == 7);
+        CHECK(Config()[lateKey].empty());
+    }
+
+    SECTION("High-water mark") {
+        connectionInit.config.set({"response", "high_water_mark"}, "1");
+        Connection connection(connectionInit);
+        string kib(1024, 'a');
+        connection.write(kib.substr(0, 1000));
+        CHECK(flushedBodies.empty());
+        connection.responseStream() << kib;
+        REQUIRE(flushedBodies.size() == 1);
+        CHECK(flushedBodies[0].size() == 2024);
+        CHECK(connection.getResponseBody().empty());
+    }
+
+    SECTION("Chunks") {
+        Connection connection(connectionInit);
+        connection.write("buffered");
+        connection.flushChunk("chunk1");
+        connection.flushChunk("chunk2");
+        CHECK(headerFlushes == 1);
+        CHECK(flushedBodies == vector<string>{"buffered", "chunk1", "chunk2"});
+    }
+
+    SECTION("Access log") {
+        auto path = (filesystem::temp_directory_path() / "nawa_test_connection_accesslog.bin").string();
+        filesystem::remove(path);
+        accesslog::open(path, 16);
+        connectionInit.requestInit.environment["REQUEST_METHOD"] = "GET";
+        connectionInit.requestInit.environment["REQUEST_URI"] = "/page?x=1";
+        {
+            Connection connection(connectionInit);
+            connection.setStatus(404);
+            connection.write("not found");
+            connection.flushResponse();
+            connection.flushChunk("!");
+        }
+        { Connection unflushed(connectionInit); }
+        accesslog::close();
+
+        auto entries = accesslog::read(path);
+        REQUIRE(entries.size() == 1);
+        CHECK(entries[0].method == "GET");
+        CHECK(entries[0].path == "/page?x=1");
+        CHECK(entries[0].status == 404);
+        CHECK(entries[0].bytes == 10);
+        filesystem::remove(path);
+    }
+
+    SECTION("Files") {
+        auto path = filesystem::temp_directory_path() / "nawa_test_sendfile.txt";
+        string fileContent = "This file is sent without loading it into memory first.";
+        ofstream(path, ios::binary) << fileContent;
+
+        Connection connection(connectionInit);
+        connection.write("replaced");
+        connection.sendFile(path.string());
+        auto headers = connection.getHeaders();
+        REQUIRE(headers.count("content-length") == 1);
+        CHECK(headers.find("content-length")->second == to_string(fileContent.size()));
+        connection.flushResponse();
+        REQUIRE(flushedBodies.size() == 1);
+        CHECK(flushedBodies[0] == fileContent);
+
+        // the file has to be read into memory if the body is extended
+        connection.sendFile(path.string());
+        connection.write("!");
+        CHECK(connection.getResponseBody() == fileContent + "!");
+
+        CHECK_THROWS_AS(connection.sendFile(path.string() + ".missing"), Exception);
+
+        // conditional request with a real HTTP date
+        connectionInit.requestInit.environment["if-modified-since"] = utils::makeHttpTime(time(nullptr) + 60);
+        Connection conditionalConnection(connectionInit);
+        conditionalConnection.sendFile(path.string(), "", false, "", true);
+        CHECK(conditionalConnection.getStatus() == 304);
+        CHECK(conditionalConnection.getResponseBody().empty());
+        CHECK(conditionalConnection.getHeaders().find("content-type")->second == "text/plain");
+        filesystem::remove(path);
+    }
+
+    SECTION("Static file cache") {
+        auto dir = filesystem::temp_directory_path() / "nawa_test_static";
+        filesystem::create_directories(dir);
+        ofstream(dir / "style.css", ios::binary) << "body { color: red; }";
+
+        AccessFilterList accessFilters;
+        accessFilters.filtersEnabled() = true;
+        ForwardFilter forwardFilter;
+        forwardFilter.pathFilter() = {{"static"}};
+        forwardFilter.basePath() = dir.string();
+        accessFilters.forwardFilters().push_back(forwardFilter);
+
+        connectionInit.config.set({"static_cache", "size"}, "64");
+        connectionInit.config.set({"static_cache", "revalidate_interval"}, "0");
+        connectionInit.requestInit.environment["REQUEST_URI"] = "/static/style.css";
+
+        string etag;
+        {
+            Connection connection(connectionInit);
+            REQUIRE(connection.applyFilters(accessFilters));
+            auto headers = connection.getHeaders();
+            REQUIRE(headers.count("etag") == 1);
+            etag = headers.find("etag")->second;
+            CHECK(headers.find("content-type")->second == "text/css");
+            connection.flushResponse();
+            CHECK(flushedBodies.back() == "body { color: red; }");
+        }
+
+        // conditional request for the unchanged file
+        connectionInit.requestInit.environment["if-none-match"] = "\"other\", " + etag;
+        {
+            Connection connection(connectionInit);
+            REQUIRE(connection.applyFilters(accessFilters));
+            CHECK(connection.getStatus() == 304);
+            CHECK(connection.getResponseBody().empty());
+            CHECK(connection.getHeaders().find("content-type")->second == "text/css");
+            connection.flushResponse();
+        }
+
+        // the modification must be detected on revalidation
+        ofstream(dir / "style.css", ios::binary) << "body { color: blue; background: none; }";
+        {
+            Connection connection(connectionInit);
+            REQUIRE(connection.applyFilters(accessFilters));
+            CHECK(connection.getHeaders().find("etag")->second != etag);
+            CHECK(connection.getResponseBody() == "body { color: blue; background: none; }");
+        }
+
+        // least recently used files are evicted
+        ofstream(dir / "a.txt", ios::binary) << string(40, 'a');
+        ofstream(dir / "b.txt", ios::binary) << string(40, 'b');
+        StaticFileCache cache(64, 64, chrono::seconds(60));
+        CHECK(cache.get((dir / "a.txt").string()));
+        CHECK(cache.get((dir / "b.txt").string()));
+        CHECK(cache.size() == 40);
+        CHECK_FALSE(cache.get((dir / "missing.txt").string()));
+
+        // files larger than the maximum file size are not cached
+        ofstream(dir / "large.txt", ios::binary) << string(100, 'l');
+        CHECK_FALSE(cache.get((dir / "large.txt").string()));
+        CHECK(cache.size() == 40);
+
+        // a hit moves a file which is not near the front of the LRU list to the front
+        StaticFileCache lruCache(64, 64, chrono::seconds(60));
+        for (char c = 'c'; c <= 'g'; ++c) {
+            ofstream(dir / (string(1, c) + ".txt"), ios::binary) << string(16, c);
+        }
+        for (char c = 'c'; c <= 'f'; ++c) {
+            CHECK(lruCache.get((dir / (string(1, c) + ".txt")).string()));
+        }
+        CHECK(lruCache.get((dir / "c.txt").string()));
+        CHECK(lruCache.get((dir / "g.txt").string()));
+        // cached files are served without touching the file system until they are revalidated
+        filesystem::remove(dir / "c.txt");
+        filesystem::remove(dir / "d.txt");
+        CHECK(lruCache.get((dir / "c.txt").string()));
+        CHECK_FALSE(lruCache.get((dir / "d.txt").string()));
+
+        filesystem::remove_all(dir);
+    }
+
+    SECTION("Compiled filters") {
+        AccessFilterList accessFilters;
+        for (int i = 0; i < 100; ++i) {
+            BlockFilter tenantFilter;
+            tenantFilter.pathFilter() = {{"tenant" + to_string(i), "private"}};
+            tenantFilter.status(403 + i % 2);
+            accessFilters.blockFilters().push_back(tenantFilter);
+        }
+        BlockFilter extensionFilter;
+        extensionFilter.extensionFilter() = {"php"};
+        accessFilters.blockFilters().push_back(extensionFilter);
+        BlockFilter invertedFilter;
+        invertedFilter.invert(true).pathFilter() = {{"tenant7"}, {"tenant8"}, {}};
+        accessFilters.blockFilters().push_back(invertedFilter);
+        BlockFilter regexFilter;
+        regexFilter.pathFilter() = {{"tenant7"}};
+        regexFilter.regexFilterEnabled(true).regexFilter(regex(R"(/tenant7/.*\.bak)"));
+        accessFilters.blockFilters().push_back(regexFilter);
+
+        vector<vector<string>> requestPaths = {{"tenant5", "private", "file"},
+                                               {"tenant5", "public", "file"},
+                                               {"tenant99", "private"},
+                                               {"tenant7", "index.php"},
+                                               {"tenant7", "index.bak"},
+                                               {"tenant8", "private", "x.php"},
+                                               {"other"}};
+        vector<optional<size_t>> expected;
+        CHECK_FALSE(accessFilters.isCompiled());
+        for (auto const& requestPath : requestPaths) {
+            expected.push_back(accessFilters.findBlockFilter(requestPath));
+        }
+        CHECK(expected[0] == 5);
+        CHECK(expected[1] == nullopt);
+        CHECK(expected[3] == 100);
+        CHECK(expected[4] == 102);
+
+        accessFilters.compile();
+        AccessFilterList const& compiledFilters = accessFilters;
+        CHECK(compiledFilters.isCompiled());
+        for (size_t i = 0; i < requestPaths.size(); ++i) {
+            CHECK(compiledFilters.findBlockFilter(requestPaths[i]) == expected[i]);
+        }
+
+        auto mergedRequestPath = AccessFilter::mergeRequestPath(requestPaths[4]);
+        CHECK(mergedRequestPath == "/tenant7/index.bak");
+        CHECK(AccessFilter::mergeRequestPath({}).empty());
+        CHECK(compiledFilters.findBlockFilter(requestPaths[4], mergedRequestPath) == 102);
+        CHECK(compiledFilters.hasRegexFilters());
+
+        // regexes set as patterns are combined into one regex, which must yield the same results
+        AccessFilterList regexFilters;
+        vector<string> patterns = {R"(/(a|b)/x)", R"(/a/(.*))", R"(/(c)/\1)", R"(/.*\.(png|jpg))", R"(/d/.*)"};
+        for (auto const& pattern : patterns) {
+            BlockFilter patternFilter;
+            patternFilter.regexFilterEnabled(true).regexFilter(pattern);
+            CHECK(patternFilter.regexPattern() == pattern);
+            regexFilters.blockFilters().push_back(patternFilter);
+        }
+        regexFilters.blockFilters()[3].pathFilter() = {{"img"}};
+        regexFilters.blockFilters()[4].invert(true);
+        CHECK(regexFilters.hasRegexFilters());
+        vector<vector<string>> regexPaths = {{"a", "x"}, {"b", "x"}, {"a", "y"}, {"c", "c"}, {"c", "d"},
+                                             {"img", "i.png"}, {"pub", "i.png"}, {"d", "e"}};
+        vector<optional<size_t>> regexExpected;
+        for (auto const& requestPath : regexPaths) {
+            regexExpected.push_back(regexFilters.findBlockFilter(requestPath));
+        }
+        CHECK(regexExpected == vector<optional<size_t>>{0, 0, 1, 2, 4, 3, 4, nullopt});
+        regexFilters.compile();
+        for (size_t i = 0; i < regexPaths.size(); ++i) {
+            CHECK(as_const(regexFilters).findBlockFilter(regexPaths[i]) == regexExpected[i]);
+        }
+
+        // modifying the filters discards the index
+        accessFilters.blockFilters().clear();
+        CHECK_FALSE(compiledFilters.isCompiled());
+        CHECK(compiledFilters.findBlockFilter(requestPaths[0]) == nullopt);
+    }
+}
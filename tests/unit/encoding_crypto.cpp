@@ -97,6 +97,7 @@ TEST_CASE("nawa::encoding functions", "[unit][encoding]") {
         auto urlEncodedRand = encoding::urlEncode(decoded);
         CHECK(encoding::urlDecode(urlEncoded) == urlDecoded);
         CHECK(encoding::urlDecode(urlEncodedRand) == decoded);
+        CHECK(encoding::urlDecode("%41%zz%4a%4") == "A%zzJ%4");
     }
 
     SECTION("Base64 encoding") {
@@ -128,6 +129,17 @@ TEST_CASE("nawa::crypto functions", "[unit][crypto]") {
         CHECK(crypto::passwordVerify(decoded, hashedPw));
     }
 
+    SECTION("random tokens") {
+        auto token1 = crypto::randomToken();
+        auto token2 = crypto::randomToken();
+        CHECK(token1.size() == 43);
+        CHECK(token1 != token2);
+        CHECK(token1.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_") ==
+              string::npos);
+        CHECK(crypto::randomToken(1).size() == 2);
+        CHECK(crypto::randomToken(100).size() == 134);
+    }
+
     SECTION("argon2 password hashing") {
         auto hashedPw = crypto::passwordHash(decoded,
                                              hashing::Argon2HashingEngine(
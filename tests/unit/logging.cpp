@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2019-2022 Tobias Flaig.
+ *
+ * This file is part of nawa.
+ *
+ * nawa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License,
+ * version 3, as published by the Free Software Foundation.
+ *
+ * nawa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nawa.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file logging.cpp
+ * \brief Unit tests for the nawa::Log class and the access log.
+ */
+
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <nawa/Exception.h>
+#include <nawa/logging/AccessLog.h>
+#include <nawa/logging/Log.h>
+#include <thread>
+
+using namespace nawa;
+using namespace std;
+
+TEST_CASE("nawa::Log class", "[unit][logging]") {
+    ostringstream output;
+    Log::setStream(&output);
+    Log logger("test");
+
+    SECTION("Synchronous logging") {
+        logger.write("hello");
+        NLOG_DEBUG(logger, "not logged")
+        NLOG_ERROR(logger, "number " << 42)
+        CHECK(output.str() == "[test] hello\n[test] number 42\n");
+    }
+
+    SECTION("Lazy formatting") {
+        int evaluated = 0;
+        auto expensive = [&evaluated] { return ++evaluated; };
+        // debug messages are not written with the default output level, so they must not be formatted
+        CHECK_FALSE(Log::isEnabled(Log::Level::DEBUG));
+        NLOG_DEBUG(logger, "value: " << expensive())
+        NLOGF_DEBUG(logger, "value: {}", expensive())
+        CHECK(evaluated == 0);
+        NLOG_INFO(logger, "value: " << expensive())
+        CHECK(evaluated == 1);
+
+        NLOGF_WARNING(logger, "{} + {} = {}, {{literal}}, missing: {}", 1, 2.5, "3.5")
+        CHECK(output.str() == "[test] value: 1\n[test] 1 + 2.5 = 3.5, {literal}, missing: {}\n");
+
+        // formatting a message may log another message
+        auto nested = [&logger] {
+            NLOG_ERROR(logger, "inner")
+            return "outer";
+        };
+        NLOG_ERROR(logger, nested())
+        CHECK(output.str().substr(output.str().size() - 26) == "[test] inner\n[test] outer\n");
+    }
+
+    SECTION("Async logging") {
+        Log::setAsync(true, Log::OverflowPolicy::BLOCK, 4);
+        vector<thread> threads;
+        for (int t = 0; t < 3; ++t) {
+            threads.emplace_back([t] {
+                Log threadLogger("t" + to_string(t));
+                for (int i = 0; i < 100; ++i) {
+                    threadLogger.write(to_string(i));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        Log::flush();
+
+        // all messages must have been written, in order per thread
+        istringstream lines(output.str());
+        string line;
+        vector<int> next(3, 0);
+        size_t count = 0;
+        while (getline(lines, line)) {
+            REQUIRE(line.size() > 5);
+            auto t = line[2] - '0';
+            REQUIRE((t >= 0 && t < 3));
+            CHECK(line.substr(5) == to_string(next[t]++));
+            ++count;
+        }
+        CHECK(count == 300);
+
+        // disabling async mode writes synchronously again
+        Log::setAsync(false);
+        logger.write("sync");
+        CHECK(output.str().substr(output.str().size() - 12) == "[test] sync\n");
+    }
+
+    SECTION("Reopening the log file") {
+        auto path = filesystem::temp_directory_path() / "nawa_test_log.txt";
+        auto rotatedPath = filesystem::temp_directory_path() / "nawa_test_log.txt.1";
+        filesystem::remove(path);
+        filesystem::remove(rotatedPath);
+        Log::setOutfile(path.string());
+        logger.write("before");
+        filesystem::rename(path, rotatedPath);
+        logger.write("moved");
+        Log::reopen();
+        logger.write("after");
+
+        auto readFile = [](filesystem::path const& file) {
+            ifstream stream(file);
+            return string(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+        };
+        CHECK(readFile(rotatedPath) == "[test] before\n[test] moved\n");
+        CHECK(readFile(path) == "[test] after\n");
+        CHECK(output.str().empty());
+        filesystem::remove(path);
+        filesystem::remove(rotatedPath);
+    }
+
+    Log::setStream(&cerr);
+}
+
+TEST_CASE("nawa::accesslog functions", "[unit][logging]") {
+    auto path = (filesystem::temp_directory_path() / "nawa_test_accesslog.bin").string();
+    filesystem::remove(path);
+    accesslog::open(path, 20);
+    CHECK(accesslog::enabled());
+
+    SECTION("Records are decoded") {
+        accesslog::record("GET", "/index?a=b", 200, 1234, chrono::microseconds(56));
+        accesslog::record("POST", string(300, 'x'), 404, 0, chrono::milliseconds(2));
+        auto entries = accesslog::read(path);
+        REQUIRE(entries.size() == 2);
+        CHECK(entries[0].method == "GET");
+        CHECK(entries[0].path == "/index?a=b");
+        CHECK(entries[0].status == 200);
+        CHECK(entries[0].bytes == 1234);
+        CHECK(entries[0].duration == 56);
+        CHECK(entries[0].thread == entries[1].thread);
+        CHECK(entries[1].path == string(accesslog::MAX_PATH_LENGTH, 'x'));
+        CHECK(entries[1].duration == 2000);
+        CHECK(entries[0].timestamp <= entries[1].timestamp);
+    }
+
+    SECTION("Ring buffer and concurrent writers") {
+        // the capacity has been rounded up to 32, so only the newest records are kept
+        for (unsigned int i = 0; i < 100; ++i) {
+            accesslog::record("GET", "/" + to_string(i), 200, i, chrono::microseconds(0));
+        }
+        auto entries = accesslog::read(path);
+        REQUIRE(entries.size() == 32);
+        CHECK(entries.back().bytes == 99);
+
+        // a file of a different capacity is replaced instead of being truncated under other mappers
+        ifstream oldFile(path, ios::binary | ios::ate);
+        auto oldSize = oldFile.tellg();
+        accesslog::open(path, 4096);
+        oldFile.seekg(0, ios::end);
+        CHECK(oldFile.tellg() == oldSize);
+        CHECK(filesystem::file_size(path) > static_cast<uintmax_t>(oldSize));
+        vector<thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([] {
+                for (unsigned int i = 0; i < 500; ++i) {
+                    accesslog::record("GET", "/", 200, i, chrono::microseconds(0));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        entries = accesslog::read(path);
+        CHECK(entries.size() == 2000);
+
+        // reopening a file with the same capacity continues it
+        accesslog::open(path, 4096);
+        accesslog::record("DELETE", "/", 204, 0, chrono::microseconds(0));
+        entries = accesslog::read(path);
+        CHECK(entries.size() == 2001);
+        CHECK(entries.back().method == "DELETE");
+    }
+
+    accesslog::close();
+    CHECK_FALSE(accesslog::enabled());
+    accesslog::record("GET", "/", 200, 0, chrono::microseconds(0));
+    ofstream(path) << "not an access log";
+    CHECK_THROWS_AS(accesslog::read(path), Exception);
+    filesystem::remove(path);
+}
@@ -26,6 +26,12 @@
 #include <nawa/connection/Connection.h>
 #include <nawa/connection/ConnectionInitContainer.h>
 #include <nawa/session/Session.h>
+#include <nawa/session/SessionStore/impl/MemorySessionStore.h>
+#include <nawa/session/SessionStore/impl/SharedMemorySessionStore.h>
+#include <nawa/session/ValueRegistry.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace nawa;
 using namespace std;
@@ -94,6 +100,23 @@ TEST_CASE("nawa::Session class", "[unit][session]") {
         }
     }
 
+    SECTION("Session views") {
+        Connection connection(connectionInit);
+        auto& session = connection.session();
+        CHECK_FALSE(session.view().isSet("testKey"));
+        session.start();
+        session.set("testKey", "testVal");
+        auto view = session.view();
+        session.set("testKey", "newVal");
+        session.set("otherKey", 1);
+        REQUIRE(view.get<string>("testKey"));
+        CHECK(*view.get<string>("testKey") == "testVal");
+        CHECK_FALSE(view.get<int>("testKey"));
+        CHECK_FALSE(view.isSet("otherKey"));
+        CHECK_FALSE(view["otherKey"].has_value());
+        CHECK(session.view().all().size() == 2);
+    }
+
     SECTION("Attempt to access and modify inactive session") {
         Connection connection(connectionInit);
         auto& session = connection.session();
@@ -197,4 +220,167 @@ TEST_CASE("nawa::Session class", "[unit][session]") {
             CHECK_FALSE(session.isSet("testKey"));
         }
     }
+
+    SECTION("Background garbage collection") {
+        Session::setStore(make_shared<session::MemorySessionStore>(true));
+        string sessionId;
+        {
+            Connection connection(connectionInit);
+            auto& session = connection.session();
+            sessionId = session.start("");
+            CHECK_NOTHROW(session.set("testKey", "testVal"));
+        }
+        {
+            Connection connection(connectionInit);
+            auto& session = connection.session();
+            REQUIRE(session.start(sessionId) == sessionId);
+            CHECK(any_cast<string>(session["testKey"]) == "testVal");
+        }
+        Session::setStore(nullptr);
+
+        // expired sessions are removed by the collector thread, without any call to collectGarbage()
+        session::MemorySessionStore store(true);
+        auto now = time(nullptr);
+        CHECK(store.create("expired", "1.2.3.4", now - 1));
+        CHECK(store.create("short", "1.2.3.4", now + 1));
+        auto touched = store.create("touched", "1.2.3.4", now + 1);
+        REQUIRE(touched);
+        touched->expires(now + 60);
+        CHECK(store.create("live", "1.2.3.4", now + 60));
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while ((store.find("expired") || store.find("short")) && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+        CHECK_FALSE(store.find("expired"));
+        CHECK_FALSE(store.find("short"));
+        CHECK(store.find("touched"));
+        CHECK(store.find("live"));
+    }
+
+    SECTION("Shared memory session store") {
+        string shmName = "/nawa_unittest_" + to_string(getpid());
+        {
+            session::SharedMemorySessionStore store1(shmName, 16, 1024);
+            // a second store object on the same segment behaves like another process
+            session::SharedMemorySessionStore store2(shmName, 16, 1024);
+            auto handle1 = store1.create("id1", "1.2.3.4", time(nullptr) + 60);
+            REQUIRE(handle1);
+            CHECK_FALSE(store2.create("id1", "1.2.3.4", time(nullptr) + 60));
+            CHECK_NOTHROW(handle1->set("str", string("testVal")));
+            CHECK_NOTHROW(handle1->set("num", 42));
+            CHECK_THROWS_AS(handle1->set("vec", vector<int>{1, 2}), Exception);
+            CHECK_THROWS_AS(handle1->set("big", string(2048, 'a')), Exception);
+
+            auto handle2 = store2.find("id1");
+            REQUIRE(handle2);
+            CHECK(handle2->sourceIP() == "1.2.3.4");
+            CHECK(any_cast<string>(handle2->get("str")) == "testVal");
+            CHECK(any_cast<int>(handle2->get("num")) == 42);
+            CHECK_FALSE(handle2->isSet("vec"));
+            handle2->unset("str");
+            CHECK_FALSE(handle1->isSet("str"));
+
+            // expired sessions are removed by the garbage collector
+            handle1->expires(time(nullptr) - 1);
+            store2.collectGarbage();
+            CHECK_FALSE(store1.find("id1"));
+            CHECK_FALSE(handle2->isSet("num"));
+            CHECK_THROWS_AS(session::SharedMemorySessionStore(shmName, 32, 1024), Exception);
+
+            // removing sessions (and reclaiming their slots) must not break the probe sequences of other sessions
+            for (int round = 0; round < 4; ++round) {
+                for (int i = 0; i < 16; ++i) {
+                    REQUIRE(store1.create("s" + to_string(i), "1.2.3.4", time(nullptr) + 60));
+                }
+                CHECK_THROWS_AS(store1.create("full", "1.2.3.4", time(nullptr) + 60), Exception);
+                for (int i = round % 2; i < 16; i += 2) {
+                    store2.remove("s" + to_string(i));
+                }
+                for (int i = 0; i < 16; ++i) {
+                    CHECK(static_cast<bool>(store1.find("s" + to_string(i))) == (i % 2 != round % 2));
+                }
+                for (int i = 0; i < 16; ++i) {
+                    store1.remove("s" + to_string(i));
+                }
+                CHECK_FALSE(store2.find("s0"));
+            }
+        }
+        shm_unlink(shmName.c_str());
+    }
+
+    SECTION("Session snapshots") {
+        struct Point {
+            int x;
+            int y;
+        };
+        session::ValueRegistry::registerTrivialType<Point>("unittest::Point");
+        string snapshotFile = "/tmp/nawa_unittest_snapshot_" + to_string(getpid());
+        {
+            session::MemorySessionStore store;
+            auto handle = store.create("id1", "1.2.3.4", time(nullptr) + 60);
+            handle->set("str", string("testVal"));
+            handle->set("num", 42UL);
+            handle->set("point", Point{3, 4});
+            handle->set("vec", vector<int>{1, 2});
+            auto expiredHandle = store.create("id2", "1.2.3.4", time(nullptr) - 1);
+            CHECK(store.saveSnapshot(snapshotFile) == 1);
+        }
+        {
+            session::MemorySessionStore store;
+            CHECK(store.loadSnapshot(snapshotFile) == 1);
+            CHECK_FALSE(store.find("id2"));
+            auto handle = store.find("id1");
+            REQUIRE(handle);
+            CHECK(handle->sourceIP() == "1.2.3.4");
+            CHECK(any_cast<string>(handle->get("str")) == "testVal");
+            CHECK(any_cast<unsigned long>(handle->get("num")) == 42);
+            CHECK(any_cast<Point>(handle->get("point")).y == 4);
+            CHECK_FALSE(handle->isSet("vec"));
+        }
+        unlink(snapshotFile.c_str());
+        CHECK_THROWS_AS(session::MemorySessionStore().loadSnapshot(snapshotFile), Exception);
+
+        // the configured snapshot file is written by shutdown(), the destructor does not write anything
+        {
+            session::MemorySessionStore store(false, snapshotFile);
+            CHECK(store.create("id3", "1.2.3.4", time(nullptr) + 60));
+        }
+        CHECK(access(snapshotFile.c_str(), F_OK) != 0);
+        {
+            session::MemorySessionStore store(false, snapshotFile);
+            CHECK(store.create("id3", "1.2.3.4", time(nullptr) + 60));
+            store.shutdown();
+        }
+        CHECK(session::MemorySessionStore(false, snapshotFile).find("id3"));
+        unlink(snapshotFile.c_str());
+    }
+
+    SECTION("Concurrent session handling") {
+        vector<thread> threads;
+        vector<int> failures(8, 0);
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 50; ++i) {
+                    string sessionId;
+                    {
+                        Connection connection(connectionInit);
+                        sessionId = connection.session().start("");
+                        connection.session().set("counter", i);
+                    }
+                    Connection connection(connectionInit);
+                    auto& session = connection.session();
+                    if (session.start(sessionId) != sessionId || any_cast<int>(session["counter"]) != i) {
+                        ++failures[t];
+                    }
+                    session.invalidate();
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto f : failures) {
+            CHECK(f == 0);
+        }
+    }
 }
@@ -23,7 +23,10 @@
 
 #include "nawa/Exception.h"
 #include <catch2/catch.hpp>
+#include <nawa/util/AtomicSnapshot.h>
+#include <nawa/util/metrics.h>
 #include <nawa/util/utils.h>
+#include <thread>
 
 using namespace nawa;
 using namespace std;
@@ -43,6 +46,17 @@ TEST_CASE("nawa::utils functions", "[unit][utils]") {
         CHECK(smtpTime2 == currentTime);
         CHECK_THROWS_AS(utils::readSmtpTime("test"), Exception);
         CHECK_THROWS_AS(utils::readHttpTime("test"), Exception);
+        CHECK(utils::makeHttpTime(784111777) == "Sun, 06 Nov 1994 08:49:37 GMT");
+        CHECK(utils::readHttpTime("Sun, 06 Nov 1994 08:49:37 GMT") == 784111777);
+        CHECK(utils::readHttpTime("Sunday, 06-Nov-94 08:49:37 GMT") == 784111777);
+        CHECK(utils::readHttpTime("Sun Nov  6 08:49:37 1994") == 784111777);
+        CHECK(utils::readHttpTime("Thu, 29 Feb 2024 23:59:59 GMT") == 1709251199);
+        CHECK_THROWS_AS(utils::readHttpTime("Sun, 06 Foo 1994 08:49:37 GMT"), Exception);
+        CHECK_THROWS_AS(utils::readHttpTime("1573140590"), Exception);
+        CHECK_THROWS_AS(utils::readHttpTime("Sun, 06 Nov 1994 08:49:37 GMTjunk"), Exception);
+        CHECK_THROWS_AS(utils::readHttpTime("Sunday, 06-Nov-94 08:49:37 GMT junk"), Exception);
+        CHECK_THROWS_AS(utils::readHttpTime("Sun Nov  6 08:49:37 19945"), Exception);
+        CHECK(utils::readHttpTime(utils::currentHttpTime()) >= currentTime);
     }
 
     SECTION("Path splitting") {
@@ -56,5 +70,115 @@ TEST_CASE("nawa::utils functions", "[unit][utils]") {
         CHECK(t1_split == utils::splitPath(t3));
         CHECK(t1_split == utils::splitPath(t4));
         CHECK(t1_split == utils::splitPath(t5));
+        CHECK(t1_split == vector<string>{"p1", "p2", "p3"});
+        CHECK(utils::splitPath("/?test=/xyz").empty());
+        CHECK(utils::splitPath("//p1//p2").size() == 2);
     }
+
+    SECTION("Query strings, headers, and cookies") {
+        auto getVars = utils::splitQueryString("/path?a=1&b=x%2Fy%2fz&&c&d=&a=2");
+        CHECK(getVars.count("a") == 2);
+        CHECK(getVars.find("b")->second == "x/y/z");
+        CHECK(getVars.find("c")->second.empty());
+        CHECK(getVars.find("d")->second.empty());
+        auto getVarsView = utils::splitQueryStringView("a=1&b=x%2Fy");
+        REQUIRE(getVarsView.size() == 2);
+        CHECK(getVarsView[1] == pair<string_view, string_view>("b", "x%2Fy"));
+
+        auto headers = utils::parseHeaders("Content-Type: text/plain\r\nX-Empty:\r\ninvalid\r\nX-Test:  a:b\r\n");
+        CHECK(headers.size() == 2);
+        CHECK(headers["content-type"] == "text/plain");
+        CHECK(headers["x-test"] == "a:b");
+
+        auto cookies = utils::parseCookies(" SESSION=abc; empty=; invalid ;theme=dark ");
+        CHECK(cookies.size() == 2);
+        CHECK(cookies.find("SESSION")->second == "abc");
+        CHECK(cookies.find("theme")->second == "dark");
+    }
+
+    SECTION("String splitting") {
+        CHECK(utils::splitString(",a,,b,", ',') == vector<string>{"", "a", "", "b"});
+        CHECK(utils::splitString(",a,,b,", ',', true) == vector<string>{"a", "b"});
+        CHECK(utils::splitString("", ',').empty());
+        CHECK(utils::splitString("abc", ',') == vector<string>{"abc"});
+    }
+}
+
+TEST_CASE("nawa::AtomicSnapshot class", "[unit][utils]") {
+    AtomicSnapshot<vector<int>> snapshot({1});
+
+    SECTION("Replacement while reading") {
+        auto outer = snapshot.read();
+        {
+            // nested guards use further hazard pointers
+            auto inner = snapshot.read();
+            CHECK(&*inner == &*outer);
+        }
+        snapshot.update([](vector<int>& v) { v.push_back(2); });
+        // the guard keeps the replaced object alive
+        CHECK(*outer == vector<int>{1});
+        CHECK(*snapshot.read() == vector<int>{1, 2});
+    }
+
+    SECTION("Concurrent readers") {
+        atomic<bool> stop = false;
+        vector<thread> readers;
+        atomic<size_t> inconsistent = 0;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&] {
+                while (!stop) {
+                    auto guard = snapshot.read();
+                    // every generation contains 1, 2, ..., n
+                    for (size_t j = 0; j < guard->size(); ++j) {
+                        if ((*guard)[j] != static_cast<int>(j) + 1) {
+                            ++inconsistent;
+                        }
+                    }
+                }
+            });
+        }
+        for (int i = 2; i <= 1000; ++i) {
+            snapshot.update([i](vector<int>& v) { v.push_back(i); });
+        }
+        stop = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        CHECK(inconsistent == 0);
+        CHECK(snapshot.read()->size() == 1000);
+    }
+}
+
+TEST_CASE("nawa::metrics functions", "[unit][utils]") {
+    metrics::enable(false);
+    auto requestsBefore = metrics::getCounter(metrics::Counter::REQUESTS);
+    metrics::count(metrics::Counter::REQUESTS);
+    CHECK(metrics::getCounter(metrics::Counter::REQUESTS) == requestsBefore);
+    CHECK(metrics::startTimer() == chrono::steady_clock::time_point());
+
+    metrics::enable();
+    metrics::count(metrics::Counter::REQUESTS, 2);
+    thread([] { metrics::count(metrics::Counter::REQUESTS); }).join();
+    // counts of terminated threads are kept
+    CHECK(metrics::getCounter(metrics::Counter::REQUESTS) == requestsBefore + 3);
+
+    auto histogramBefore = metrics::getHistogram(metrics::Histogram::RESPONSE_SIZE);
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        metrics::record(metrics::Histogram::RESPONSE_SIZE, value);
+    }
+    auto histogram = metrics::getHistogram(metrics::Histogram::RESPONSE_SIZE);
+    CHECK(histogram.count == histogramBefore.count + 1000);
+    CHECK(histogram.sum == histogramBefore.sum + 500500);
+    if (histogramBefore.count == 0) {
+        CHECK(histogram.quantile(0.5) >= 500);
+        CHECK(histogram.quantile(0.5) < 625);
+        CHECK(histogram.quantile(1) >= 1000);
+        CHECK(histogram.countBelowPowerOfTwo(4) == 15);
+    }
+
+    auto text = metrics::prometheusText();
+    CHECK(text.find("# TYPE nawa_requests_total counter\nnawa_requests_total ") != string::npos);
+    CHECK(text.find("nawa_app_duration_seconds_bucket{le=\"0.000015\"} ") != string::npos);
+    CHECK(text.find("nawa_response_size_bytes_bucket{le=\"+Inf\"} ") != string::npos);
+    metrics::enable(false);
 }